@@ -3,42 +3,72 @@
 
 #include <memory>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "batch_lookup.hpp"
+#include "frozen.hpp"
+#include "in_order.hpp"
+#include "node_allocator.hpp"
+#include "node_data.hpp"
+#include "order_statistics.hpp"
 
 namespace avl {
     /* C-like structure representing an AVL tree node.
      * To have a std::set-like interface, see the avl class below.
+     *
+     * The key and the value (none if Value is void) come from node_data,
+     * and the subtree size (none without order statistics) from subtree_size.
+     * The Allocator policy (see node_allocator.hpp)
+     * chooses the deleter of the child pointers.
      */
-    struct node {
-        int key;
+    template< typename Key, typename Value, typename Allocator,
+        typename Statistics = no_order_statistics >
+    struct basic_node : node_data<Key, Value>, subtree_size<Statistics> {
+        using pointer = std::unique_ptr<basic_node,
+              typename Allocator::template deleter<basic_node>>;
+
         int h;
-        std::unique_ptr<node> lchild, rchild;
+        pointer lchild, rchild;
 
-        node() = default;
-        node( int k ) : key(k) {}
-        node( int k, std::unique_ptr<node>&& lchild, std::unique_ptr<node>&& rchild ) :
-            key(k), lchild(std::move(lchild)), rchild(std::move(rchild))
+        // The arguments after the key construct the value.
+        template< typename ... Args, typename = std::enable_if_t<
+            std::is_constructible<node_data<Key, Value>, const Key &, Args...>::value>>
+        explicit basic_node( const Key & k, Args && ... args ) :
+            node_data<Key, Value>( k, std::forward<Args>(args)... )
         {}
 
+        basic_node( const Key & k, pointer&& lchild, pointer&& rchild ) :
+            node_data<Key, Value>(k), lchild(std::move(lchild)), rchild(std::move(rchild))
+        {}
     };
 
+    using node = basic_node<int, void, malloc_allocator>;
+
     /* Returns the height of the given node.
      * If the node is a null pointer, -1 is returned.
      */
-    int height( const std::unique_ptr<node> & ptr ) {
+    template< typename Node, typename Deleter >
+    int height( const std::unique_ptr<Node, Deleter> & ptr ) {
         return ptr ? ptr->h : -1;
     }
 
     /* Recompute and set the height attribute from the lchild and rchild nodes.
      */
-    void update_height( std::unique_ptr<node> & ptr ) {
+    template< typename Node, typename Deleter >
+    void update_height( std::unique_ptr<Node, Deleter> & ptr ) {
         ptr->h = std::max( height(ptr->lchild), height(ptr->rchild) ) + 1;
     }
 
     /* Assigns ptr2 to ptr1, ptr3 to ptr2, and ptr1 to ptr3,
      * without destroying any object.
      */
-    inline void circular_shift_unique_ptr( std::unique_ptr<node> & ptr1,
-            std::unique_ptr<node> & ptr2, std::unique_ptr<node> & ptr3 )
+    template< typename Node, typename Deleter >
+    inline void circular_shift_unique_ptr( std::unique_ptr<Node, Deleter> & ptr1,
+            std::unique_ptr<Node, Deleter> & ptr2, std::unique_ptr<Node, Deleter> & ptr3 )
     {
         ptr1.swap(ptr2);
         ptr2.swap(ptr3);
@@ -48,27 +78,34 @@ namespace avl {
      * Node heights are adjusted accordingly.
      * ptr->rchild is assumed to be non-null.
      */
-    inline void rotate_left( std::unique_ptr<node> & ptr ) {
+    template< typename Node, typename Deleter >
+    inline void rotate_left( std::unique_ptr<Node, Deleter> & ptr ) {
         circular_shift_unique_ptr(ptr, ptr->rchild, ptr->rchild->lchild);
         update_height( ptr->lchild );
         update_height( ptr );
+        order_stats::update_size( ptr->lchild );
+        order_stats::update_size( ptr );
     }
 
     /* Performs a right rotation.
      * Node heights are adjusted accordingly.
      * ptr->lchild is assumed to be non-null.
      */
-    inline void rotate_right( std::unique_ptr<node> & ptr ) {
+    template< typename Node, typename Deleter >
+    inline void rotate_right( std::unique_ptr<Node, Deleter> & ptr ) {
         circular_shift_unique_ptr(ptr, ptr->lchild, ptr->lchild->rchild);
         update_height( ptr->rchild );
         update_height( ptr );
+        order_stats::update_size( ptr->rchild );
+        order_stats::update_size( ptr );
     }
 
     /* Make the tree rooted at ptr an AVL tree,
      * provided that both ptr->lchild and ptr->rchild are AVL trees
      * whose height differ by at most two.
      */
-    inline void fix_avl( std::unique_ptr<node> & ptr ) {
+    template< typename Node, typename Deleter >
+    inline void fix_avl( std::unique_ptr<Node, Deleter> & ptr ) {
         if( height(ptr->lchild) < height(ptr->rchild) - 1 ) {
             // There is too much weight in the right.
             if( height(ptr->rchild->lchild) > height(ptr->rchild->rchild) )
@@ -85,92 +122,574 @@ namespace avl {
             update_height( ptr );
     }
 
+    /* Upper bound for the height of any AVL tree that fits in memory.
+     * (An AVL tree of height 128 has more than 2**88 nodes.)
+     * Used to size the explicit paths of the non-recursive algorithms below.
+     */
+    constexpr int max_height = 128;
+
+    /* Restores the AVL property along path[0], ..., path[depth-1],
+     * which are the pointers from some root down to the subtree
+     * whose height just changed by one.
+     * Subtree sizes, if any, must already be right.
+     * The path is walked bottom-up, and the walk stops as soon as
+     * a subtree ends with the same height it had before;
+     * nothing above it can have changed.
+     * Returns the index in path where the walk stopped,
+     * or -1 if the height of *path[0] changed.
+     */
+    template< typename Node, typename Deleter >
+    inline int retrace( std::unique_ptr<Node, Deleter> ** path, int depth ) {
+        while( depth-- > 0 ) {
+            std::unique_ptr<Node, Deleter> & ptr = *path[depth];
+            int old_height = ptr->h;
+            fix_avl( ptr );
+            if( ptr->h == old_height )
+                return depth;
+        }
+        return -1;
+    }
+
     /* Inserts the given key in the given tree
      * and adjust it so that it continues to be an AVL tree.
      * tree->h is increased by at most one.
+     * New nodes are obtained from the given arena,
+     * and their value (if any) is constructed from args.
+     * Keys are ordered by comp.
+     *
+     * At most one (single or double) rotation is done,
+     * after which the retracing stops.
+     *
+     * Returns the node with the key,
+     * and whether it was inserted (false if the key was already there).
+     */
+    template< typename Node, typename Deleter, typename Arena,
+        typename Compare = std::less<>, typename ... Args >
+    inline std::pair<Node *, bool> insert( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, Arena & arena,
+            const Compare & comp = Compare(), Args && ... args )
+    {
+        std::unique_ptr<Node, Deleter> * path[max_height];
+        int depth = 0;
+        std::unique_ptr<Node, Deleter> * slot = &tree;
+        while( *slot ) {
+            path[depth++] = slot;
+            if( comp(key, (*slot)->key) )
+                slot = &(*slot)->lchild;
+            else if( comp((*slot)->key, key) )
+                slot = &(*slot)->rchild;
+            else
+                return {slot->get(), false}; // Key is already here.
+        }
+        *slot = arena.make( key, std::forward<Args>(args)... );
+        update_height( *slot );
+        Node * ret = slot->get();
+        order_stats::adjust_sizes( path, depth, +1 );
+        retrace( path, depth );
+        return {ret, true};
+    }
+
+    /* Same as above, allocating the new node with operator new.
      */
     inline void insert( std::unique_ptr<node> & tree, int key ) {
-        if( !tree )
-            tree = std::make_unique<node>(key);
-        else if( key < tree->key )
-            insert( tree->lchild, key );
-        else if( tree->key < key )
-            insert( tree->rchild, key );
+        malloc_arena<node> arena;
+        insert( tree, key, arena );
+    }
+
+    /* Path from the root to the node of the last insert_with_finger,
+     * together with the range of keys each subtree in the path may hold.
+     * The finger stays valid while the tree is only changed by insert_with_finger;
+     * any other change must reset it, setting depth to zero.
+     */
+    template< typename Pointer >
+    struct finger {
+        using key_type = typename Pointer::element_type::key_type;
+
+        Pointer * slot[max_height];
+        /* The keys in *slot[i] lie in the open interval (*lo[i], *hi[i]).
+         * The bounds point to the keys of ancestors, which never move;
+         * a null bound is infinite.
+         */
+        const key_type * lo[max_height];
+        const key_type * hi[max_height];
+        int depth = 0;
+
+        void push( Pointer * s, const key_type * l, const key_type * h ) {
+            slot[depth] = s;
+            lo[depth] = l;
+            hi[depth] = h;
+            depth++;
+        }
+
+        // Whether the last subtree of the path may hold key.
+        template< typename Compare >
+        bool covers( const key_type & key, const Compare & comp ) const {
+            return (!lo[depth-1] || comp(*lo[depth-1], key)) &&
+                   (!hi[depth-1] || comp(key, *hi[depth-1]));
+        }
+
+        /* Extends the path down from its last slot towards key,
+         * until reaching the node with that key (returns true)
+         * or an empty slot (returns false).
+         */
+        template< typename Compare >
+        bool descend( const key_type & key, const Compare & comp ) {
+            while( Pointer & ptr = *slot[depth-1] ) {
+                if( comp(key, ptr->key) )
+                    push( &ptr->lchild, lo[depth-1], &ptr->key );
+                else if( comp(ptr->key, key) )
+                    push( &ptr->rchild, &ptr->key, hi[depth-1] );
+                else
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    /* Same as insert, but the search starts from the finger f
+     * rather than from the root: the finger is first shortened
+     * until its last subtree may hold the key, and then extended down.
+     * So when the keys arrive in (nearly) ascending or descending order,
+     * the search and the retracing are both amortized O(1).
+     * (With order statistics, the sizes of all the ancestors
+     * must be updated anyway, so this is O(log n).)
+     *
+     * f must have been reset (or used only with this tree since).
+     * Afterwards, f ends at the node with the key.
+     * Returns the same as insert.
+     */
+    template< typename Node, typename Deleter, typename Arena,
+        typename Compare = std::less<>, typename ... Args >
+    inline std::pair<Node *, bool> insert_with_finger( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, Arena & arena,
+            finger<std::unique_ptr<Node, Deleter>> & f,
+            const Compare & comp = Compare(), Args && ... args )
+    {
+        if( f.depth == 0 )
+            f.push( &tree, nullptr, nullptr );
+        while( f.depth > 1 && !f.covers(key, comp) )
+            f.depth--;
+        if( f.descend(key, comp) )
+            return {f.slot[f.depth-1]->get(), false}; // Key is already here.
 
-        fix_avl(tree);
+        std::unique_ptr<Node, Deleter> & slot = *f.slot[f.depth-1];
+        slot = arena.make( key, std::forward<Args>(args)... );
+        update_height( slot );
+        Node * ret = slot.get();
+        order_stats::adjust_sizes( f.slot, f.depth - 1, +1 );
+
+        /* Rotations only happen where the retracing stopped;
+         * the part of the finger above it is still right.
+         */
+        int stop = retrace( f.slot, f.depth - 1 );
+        if( stop >= 0 ) {
+            f.depth = stop + 1;
+            f.descend( key, comp );
+        }
+        return {ret, true};
     }
 
     /* Removes the maximum value of the given tree.
      * The node that contains the maximum value is stored in 'ret'.
      * The height of the tree is reduced at most by one.
+     * Returns true if the height was reduced.
      */
-    inline void remove_max( std::unique_ptr<node> & tree, std::unique_ptr<node> & ret ) {
-        if( ! tree->rchild ) {
-            // This is the maximum.
-            ret = std::move(tree);
-            tree = std::move(ret->lchild);
-        }
-        else {
-            remove_max( tree->rchild, ret );
-            fix_avl(tree);
+    template< typename Node, typename Deleter >
+    inline bool remove_max( std::unique_ptr<Node, Deleter> & tree,
+            std::unique_ptr<Node, Deleter> & ret )
+    {
+        std::unique_ptr<Node, Deleter> * path[max_height];
+        int depth = 0;
+        std::unique_ptr<Node, Deleter> * slot = &tree;
+        while( (*slot)->rchild ) {
+            path[depth++] = slot;
+            slot = &(*slot)->rchild;
         }
+        // *slot is the maximum.
+        ret = std::move(*slot);
+        *slot = std::move(ret->lchild);
+        order_stats::adjust_sizes( path, depth, -1 );
+        return retrace( path, depth ) < 0;
     }
 
     /* Removes the given key from the tree.
      */
-    inline void remove( std::unique_ptr<node> & tree, int key ) {
-        if( !tree ) return;
-        if( key < tree->key )
-            remove( tree->lchild, key );
-        else if( tree->key < key )
-            remove( tree->rchild, key );
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    inline void remove( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, const Compare & comp = Compare() )
+    {
+        std::unique_ptr<Node, Deleter> * path[max_height];
+        int depth = 0;
+        std::unique_ptr<Node, Deleter> * slot = &tree;
+        while( *slot ) {
+            if( comp(key, (*slot)->key) ) {
+                path[depth++] = slot;
+                slot = &(*slot)->lchild;
+            }
+            else if( comp((*slot)->key, key) ) {
+                path[depth++] = slot;
+                slot = &(*slot)->rchild;
+            }
+            else
+                break; // Key is here.
+        }
+        if( !*slot ) return;
+        order_stats::adjust_sizes( path, depth, -1 );
+
+        std::unique_ptr<Node, Deleter> & victim = *slot;
+        if( ! victim->lchild )
+            victim = std::move(victim->rchild);
         else {
-            // Key is here.
-            if( ! tree->lchild ) {
-                tree = std::move(tree->rchild);
+            /* Replace the victim by the maximum of its left subtree.
+             * remove_max already rebalanced that subtree;
+             * if it did not shrink, neither did the victim's.
+             */
+            std::unique_ptr<Node, Deleter> tmp;
+            bool shrunk = remove_max( victim->lchild, tmp );
+            tmp->lchild = std::move(victim->lchild);
+            tmp->rchild = std::move(victim->rchild);
+            tmp->h = victim->h;
+            order_stats::update_size( tmp );
+            victim = std::move(tmp);
+            if( !shrunk )
                 return;
-            }
-            std::unique_ptr<node> tmp;
-            remove_max( tree->lchild, tmp );
-            tmp->lchild = std::move(tree->lchild);
-            tmp->rchild = std::move(tree->rchild);
-            tree = std::move(tmp);
+            path[depth++] = slot;
+        }
+        retrace( path, depth );
+    }
+
+    /* Joins the AVL trees 'left' and 'right' through the lone node 'mid',
+     * assuming that the keys of 'left' are smaller than mid's,
+     * and mid's smaller than those of 'right'; returns the result.
+     *
+     * The taller tree is descended along its inner spine
+     * until a subtree about as tall as the other tree,
+     * which becomes, with the other tree, a child of mid;
+     * fix_avl then repairs the way back up.
+     * Takes O(|height(left) - height(right)| + 1).
+     */
+    template< typename Node, typename Deleter >
+    std::unique_ptr<Node, Deleter> join( std::unique_ptr<Node, Deleter> left,
+            std::unique_ptr<Node, Deleter> mid, std::unique_ptr<Node, Deleter> right )
+    {
+        if( height(left) > height(right) + 1 ) {
+            left->rchild = join( std::move(left->rchild), std::move(mid), std::move(right) );
+            order_stats::update_size( left );
+            fix_avl( left );
+            return left;
+        }
+        if( height(right) > height(left) + 1 ) {
+            right->lchild = join( std::move(left), std::move(mid), std::move(right->lchild) );
+            order_stats::update_size( right );
+            fix_avl( right );
+            return right;
+        }
+        mid->lchild = std::move(left);
+        mid->rchild = std::move(right);
+        update_height( mid );
+        order_stats::update_size( mid );
+        return mid;
+    }
+
+    /* Same as above, without a middle node.
+     */
+    template< typename Node, typename Deleter >
+    std::unique_ptr<Node, Deleter> concat( std::unique_ptr<Node, Deleter> left,
+            std::unique_ptr<Node, Deleter> right )
+    {
+        if( !left )
+            return right;
+        std::unique_ptr<Node, Deleter> mid;
+        remove_max( left, mid );
+        return join( std::move(left), std::move(mid), std::move(right) );
+    }
+
+    /* Splits the given tree into the nodes with keys smaller than key,
+     * which go to 'left', and the remaining nodes, which go to 'right'.
+     * 'tree' is left empty; 'left' and 'right' are assumed to be empty.
+     *
+     * Each node on the search path is joined, with its subtree
+     * on the far side of the key, to the part of its other subtree
+     * on the same side. The join costs telescope along the path,
+     * so this takes O(log n).
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    void split( std::unique_ptr<Node, Deleter> & tree, const typename Node::key_type & key,
+            std::unique_ptr<Node, Deleter> & left, std::unique_ptr<Node, Deleter> & right,
+            const Compare & comp = Compare() )
+    {
+        if( !tree )
+            return;
+        std::unique_ptr<Node, Deleter> mid = std::move(tree);
+        std::unique_ptr<Node, Deleter> lchild = std::move(mid->lchild);
+        std::unique_ptr<Node, Deleter> rchild = std::move(mid->rchild);
+        std::unique_ptr<Node, Deleter> part;
+        if( comp(mid->key, key) ) {
+            split( rchild, key, part, right, comp );
+            left = join( std::move(lchild), std::move(mid), std::move(part) );
+        }
+        else {
+            split( lchild, key, left, part, comp );
+            right = join( std::move(part), std::move(mid), std::move(rchild) );
+        }
+    }
+
+    /* Removes the keys in [lo, hi) from the tree,
+     * by splitting off the range, dropping it, and joining the rest.
+     * Takes O(log n + k) for k removed keys.
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    void erase_range( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & lo, const typename Node::key_type & hi,
+            const Compare & comp = Compare() )
+    {
+        if( !comp(lo, hi) )
+            return;
+        std::unique_ptr<Node, Deleter> left, rest, range, right;
+        split( tree, lo, left, rest, comp );
+        split( rest, hi, range, right, comp );
+        range.reset();
+        tree = concat( std::move(left), std::move(right) );
+    }
+
+    /* Builds a perfectly balanced AVL tree with the n keys starting at 'first',
+     * which must be strictly ascending, and returns it.
+     * 'first' is advanced past the used keys.
+     * New nodes are obtained from the given arena.
+     *
+     * The keys are consumed in order, building each left subtree
+     * before its root, so this takes linear time and a single pass.
+     */
+    template< typename Iterator, typename Arena >
+    auto build_sorted( Iterator & first, std::size_t n, Arena & arena )
+        -> decltype( arena.make(0) )
+    {
+        if( n == 0 )
+            return nullptr;
+        auto left = build_sorted( first, n / 2, arena );
+        auto ptr = arena.make( *first );
+        ++first;
+        ptr->lchild = std::move(left);
+        ptr->rchild = build_sorted( first, n - n / 2 - 1, arena );
+        update_height( ptr );
+        order_stats::update_size( ptr );
+        return ptr;
+    }
+
+    /* Returns the node with the specified key, or null if there is none.
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    Node * find( const std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, const Compare & comp = Compare() )
+    {
+        Node * n = tree.get();
+        while( n ) {
+            if( comp(key, n->key) )
+                n = n->lchild.get();
+            else if( comp(n->key, key) )
+                n = n->rchild.get();
+            else
+                return n;
         }
-        fix_avl(tree);
+        return nullptr;
     }
 
     /* Decides whether the given tree has the specified key or not.
      */
-    bool contains( std::unique_ptr<node> & tree, int key ) {
-        if( ! tree ) return false;
-        if( key < tree->key )
-            return contains( tree->lchild, key );
-        if( tree->key < key )
-            return contains( tree->rchild, key );
-        return true;
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    bool contains( const std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, const Compare & comp = Compare() )
+    {
+        return find( tree, key, comp ) != nullptr;
     }
 
-    // std::set-like interface
+    /* std::set-like interface, or std::map-like if Value is not void.
+     * Keys are ordered by Compare.
+     * Allocator is one of the policies in node_allocator.hpp,
+     * and Statistics one of those in order_statistics.hpp.
+     */
+    template< typename Key = int, typename Value = void,
+        typename Compare = std::less<Key>, typename Allocator = malloc_allocator,
+        typename Statistics = no_order_statistics >
     class avl {
-        std::unique_ptr<node> root;
+        using node_type = basic_node<Key, Value, Allocator, Statistics>;
+        typename Allocator::template arena<node_type> arena;
+        typename node_type::pointer root;
+        finger<typename node_type::pointer> last; // See insert(hint, key).
+        Compare comp;
+
+        // Value-only members are templates enabled by this.
+        template< typename V >
+        using if_map = std::enable_if_t<!std::is_void<V>::value, V>;
+
+        // Likewise for the order-statistics members.
+        template< typename S, typename T >
+        using if_sized = std::enable_if_t<std::is_same<S, order_statistics>::value, T>;
+
     public:
+        using key_type = Key;
+        using mapped_type = Value;
+
+        // Position of a key in the tree; valid until the next erase.
+        using position = const node_type *;
+
+        /* In-order iterators over the nodes (it->key, and it->value in maps);
+         * see in_order.hpp. Any change to the tree invalidates them.
+         */
+        using iterator = in_order::iterator<node_type>;
+        using const_iterator = iterator;
+
+        avl() = default;
+        explicit avl( const Compare & comp ) : comp(comp) {}
+
+        // The finger refers to the old object's root, so it is not moved.
+        avl( avl && other ) :
+            arena( std::move(other.arena) ),
+            root( std::move(other.root) ),
+            comp( std::move(other.comp) )
+        {}
+
+        ~avl() {
+            arena.release( root );
+        }
+
         // Returns 1 if the key was found in the tree, 0 otherwise.
-        int count( int key ) {
-            return ::avl::contains(root, key)? 1 : 0;
+        int count( const Key & key ) const {
+            return ::avl::contains(root, key, comp)? 1 : 0;
+        }
+
+        /* Sets out[i] to count(keys[i]), for i in [0, n).
+         * The searches overlap their cache misses; see batch_lookup.hpp.
+         */
+        void count_batch( const Key * keys, std::size_t n, int * out ) const {
+            batch_lookup::count_batch( root, keys, n, out, comp );
         }
 
-        /* Inserts the key in the treap.
+        /* Inserts the key in the tree.
          * Nothing is done if the key is already there.
+         * In a map, the value is default-constructed.
          */
-        void insert( int key ) {
-            ::avl::insert( root, key );
+        void insert( const Key & key ) {
+            last.depth = 0;
+            ::avl::insert( root, key, arena, comp );
+        }
+
+        iterator begin() const {
+            return iterator::first( root.get() );
+        }
+
+        iterator end() const {
+            return iterator( root.get() );
         }
 
-        /* Removes the given key from the treap.
+        // Iterator to the first key not less than (lower) or greater than (upper) key.
+        iterator lower_bound( const Key & key ) const {
+            return iterator::bound( root.get(), key, comp, false );
+        }
+
+        iterator upper_bound( const Key & key ) const {
+            return iterator::bound( root.get(), key, comp, true );
+        }
+
+        /* Calls f(node) for every key in [lo, hi), in order,
+         * without the overhead of an iterator.
+         */
+        template< typename F >
+        void for_each_in_range( const Key & lo, const Key & hi, F && f ) const {
+            in_order::for_each_in_range( root, lo, hi, f, comp );
+        }
+
+        /* std::set-like hinted insertion.
+         * The search starts from an internal finger,
+         * left at the key of the previous hinted insertion,
+         * so appending ascending keys costs amortized O(1).
+         * The finger is always correct, whatever the key;
+         * so the hint (usually end()) is not inspected.
+         * Returns the position of the key.
+         */
+        position insert( const iterator &, const Key & key ) {
+            return ::avl::insert_with_finger( root, key, arena, last, comp ).first;
+        }
+
+        /* Map interface.
+         * emplace constructs the value from args if the key is not in the map.
+         * It returns the value with the key, and whether it was inserted.
+         */
+        template< typename ... Args, typename V = Value >
+        std::pair<if_map<V> *, bool> emplace( const Key & key, Args && ... args ) {
+            last.depth = 0;
+            auto ret = ::avl::insert( root, key, arena, comp, std::forward<Args>(args)... );
+            return {&ret.first->value, ret.second};
+        }
+
+        // Returns the value with the key, default-constructing it if needed.
+        template< typename V = Value >
+        if_map<V> & operator[]( const Key & key ) {
+            return *emplace( key ).first;
+        }
+
+        // Returns the value with the key, or null if there is none.
+        template< typename V = Value >
+        if_map<V> * find( const Key & key ) {
+            node_type * n = ::avl::find( root, key, comp );
+            return n ? &n->value : nullptr;
+        }
+
+        /* Order statistics, in O(log n).
+         * rank returns the number of keys smaller than key,
+         * select the position of the k-th smallest key (from 0), or null,
+         * and count_range the number of keys in [lo, hi).
+         */
+        template< typename S = Statistics >
+        if_sized<S, std::size_t> rank( const Key & key ) const {
+            return order_stats::rank( root, key, comp );
+        }
+
+        template< typename S = Statistics >
+        if_sized<S, position> select( std::size_t k ) const {
+            return order_stats::select( root, k );
+        }
+
+        template< typename S = Statistics >
+        if_sized<S, std::size_t> count_range( const Key & lo, const Key & hi ) const {
+            return comp(lo, hi) ? rank(hi) - rank(lo) : 0;
+        }
+
+        /* Replaces the contents of the tree with the keys in [first, last),
+         * which must be strictly ascending, in linear time.
+         */
+        template< typename ForwardIterator >
+        void assign_sorted( ForwardIterator first, ForwardIterator end ) {
+            last.depth = 0;
+            arena.release( root );
+            root = ::avl::build_sorted( first, std::distance(first, end), arena );
+        }
+
+        /* Removes the given key from the tree.
          * Nothing is done if the key is not present.
          */
-        void erase( int key ) {
-            ::avl::remove( root, key );
+        void erase( const Key & key ) {
+            last.depth = 0;
+            ::avl::remove( root, key, comp );
+        }
+
+        // Removes the keys in [lo, hi), in O(log n + k) for k keys.
+        void erase_range( const Key & lo, const Key & hi ) {
+            last.depth = 0;
+            ::avl::erase_range( root, lo, hi, comp );
+        }
+
+        /* Copies the keys into a static search index (see frozen.hpp),
+         * faster to search but immutable.
+         * Only for trees of int keys ordered by std::less.
+         */
+        frozen::eytzinger freeze() const {
+            static_assert( std::is_same<Key, int>::value &&
+                std::is_same<Compare, std::less<int>>::value,
+                "frozen::eytzinger only holds int keys in ascending order" );
+            std::vector<int> keys;
+            frozen::in_order_keys( root, keys );
+            return frozen::eytzinger( keys );
         }
     };
 }
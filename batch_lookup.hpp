@@ -0,0 +1,91 @@
+#ifndef BATCH_LOOKUP_HPP
+#define BATCH_LOOKUP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+
+/* Batched lookups by group prefetching.
+ *
+ * A single search is a chain of dependent cache misses:
+ * the next node is only known once the current one has arrived.
+ * Searches for different keys are independent, though;
+ * so the keys are taken group_size at a time,
+ * and the searches of a group advance one level per round,
+ * each prefetching its next node and then yielding to the others.
+ * By the time a search comes back to its node, the node is (hopefully) in cache,
+ * and up to group_size misses were in flight in the meantime.
+ */
+namespace batch_lookup {
+    constexpr std::size_t group_size = 16;
+
+    /* Sets out[i] to 1 if keys[i] is in the tree, to 0 otherwise, for i in [0, n).
+     *
+     * The tree is given by cursors, which are node pointers or indices
+     * whose value-initialized value, Cursor(), is the empty tree:
+     *  root            - the root cursor;
+     *  node_of(c)      - the address of the node at c, which has a key member;
+     *  child(c, right) - the cursor to the right or left child of c.
+     * Keys are ordered by comp.
+     */
+    template< typename Cursor, typename NodeOf, typename Child,
+        typename Key, typename Compare = std::less<> >
+    void count_batch( Cursor root, NodeOf node_of, Child child,
+            const Key * keys, std::size_t n, int * out, const Compare & comp = Compare() )
+    {
+        std::fill( out, out + n, 0 );
+        if( root == Cursor() )
+            return;
+
+        Cursor cursor[group_size];
+        unsigned char active[group_size]; // Lanes still searching.
+        for( std::size_t base = 0; base < n; base += group_size ) {
+            std::size_t lanes = std::min( group_size, n - base );
+            for( std::size_t i = 0; i < lanes; i++ ) {
+                cursor[i] = root;
+                active[i] = i;
+            }
+            while( lanes > 0 ) {
+                std::size_t still = 0;
+                for( std::size_t j = 0; j < lanes; j++ ) {
+                    std::size_t i = active[j];
+                    const auto * node = node_of( cursor[i] );
+                    const Key & key = keys[base + i];
+                    Cursor next;
+                    if( comp(key, node->key) )
+                        next = child( cursor[i], false );
+                    else if( comp(node->key, key) )
+                        next = child( cursor[i], true );
+                    else {
+                        out[base + i] = 1;
+                        continue;
+                    }
+                    if( next == Cursor() )
+                        continue;
+                    __builtin_prefetch( node_of(next) );
+                    cursor[i] = next;
+                    active[still++] = i;
+                }
+                lanes = still;
+            }
+        }
+    }
+
+    /* Same as above, for trees of nodes with key, lchild and rchild,
+     * owned through smart pointers.
+     */
+    template< typename Pointer, typename Key, typename Compare = std::less<> >
+    void count_batch( const Pointer & root, const Key * keys, std::size_t n, int * out,
+            const Compare & comp = Compare() )
+    {
+        using node = const typename Pointer::element_type;
+        count_batch( static_cast<node *>(root.get()),
+            []( node * c ){ return c; },
+            []( node * c, bool right ) -> node * {
+                return right ? c->rchild.get() : c->lchild.get();
+            },
+            keys, n, out, comp );
+    }
+}
+
+#endif // BATCH_LOOKUP_HPP
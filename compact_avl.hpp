@@ -0,0 +1,286 @@
+#ifndef COMPACT_AVL_HPP
+#define COMPACT_AVL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "batch_lookup.hpp"
+
+/* AVL tree stored in a contiguous vector.
+ *
+ * Children are 32-bit indices into the vector instead of pointers,
+ * and the height is replaced by the balance factor,
+ * packed into the two upper bits of the left child index.
+ * This makes a node 12 bytes long, against the 24 bytes of avl::node
+ * (plus the malloc overhead).
+ *
+ * Since references into the vector are invalidated by allocations,
+ * the algorithms here work on indices and keep an explicit path
+ * from the root instead of recursing.
+ */
+namespace compact_avl {
+    typedef std::uint32_t index;
+
+    // Index 0 is never a valid node; it plays the role of the null pointer.
+    constexpr index null = 0;
+
+    constexpr int index_bits = 30;
+    constexpr index index_mask = (index(1) << index_bits) - 1;
+
+    // Maximum height of an AVL tree with less than 2**30 nodes is 43.
+    constexpr int max_height = 64;
+
+    struct node {
+        int key;
+        index lchild_and_balance;
+        index rchild;
+    };
+
+    // std::set-like interface
+    class avl {
+        std::vector<node> nodes = std::vector<node>(1);
+        index root = null;
+        index free_list = null; // Linked through rchild.
+
+        index lchild( index n ) const {
+            return nodes[n].lchild_and_balance & index_mask;
+        }
+
+        index child( index n, int dir ) const {
+            return dir ? nodes[n].rchild : lchild(n);
+        }
+
+        void set_child( index n, int dir, index c ) {
+            if( dir )
+                nodes[n].rchild = c;
+            else
+                nodes[n].lchild_and_balance =
+                    (nodes[n].lchild_and_balance & ~index_mask) | c;
+        }
+
+        /* Balance factor: height of the right subtree minus height of the left one.
+         * Encoded as 0 for balanced, 1 for right-heavy and 2 for left-heavy.
+         */
+        int balance( index n ) const {
+            index code = nodes[n].lchild_and_balance >> index_bits;
+            return code == 2 ? -1 : int(code);
+        }
+
+        void set_balance( index n, int b ) {
+            index code = b < 0 ? 2 : index(b);
+            nodes[n].lchild_and_balance =
+                (nodes[n].lchild_and_balance & index_mask) | (code << index_bits);
+        }
+
+        index allocate( int key ) {
+            index n;
+            if( free_list != null ) {
+                n = free_list;
+                free_list = nodes[n].rchild;
+            }
+            else {
+                // The indices must fit below the balance bits.
+                if( nodes.size() > index_mask )
+                    throw std::length_error( "compact_avl::avl: too many nodes" );
+                n = nodes.size();
+                nodes.emplace_back();
+            }
+            nodes[n] = node{ key, null, null };
+            return n;
+        }
+
+        void deallocate( index n ) {
+            nodes[n].rchild = free_list;
+            free_list = n;
+        }
+
+        /* Rotates the subtree rooted at n towards 1-dir,
+         * so that its child in direction dir becomes the root.
+         * Balance factors are not touched.
+         */
+        index rotate( index n, int dir ) {
+            index c = child(n, dir);
+            set_child( n, dir, child(c, 1-dir) );
+            set_child( c, 1-dir, n );
+            return c;
+        }
+
+        /* Rebalances the subtree rooted at n, whose balance factor
+         * is two in the direction dir (sign = dir ? +1 : -1).
+         * Returns the new subtree root;
+         * 'shrunk' is set to whether the subtree height decreased
+         * in relation to the height of the unbalanced tree.
+         */
+        index rebalance( index n, int dir, bool & shrunk ) {
+            int sign = dir ? 1 : -1;
+            index c = child(n, dir);
+            int cb = balance(c);
+            if( cb == -sign ) {
+                // Double rotation.
+                index g = child(c, 1-dir);
+                int gb = balance(g);
+                set_child( n, dir, rotate(c, 1-dir) );
+                rotate( n, dir );
+                set_balance( n, gb == sign ? -sign : 0 );
+                set_balance( c, gb == -sign ? sign : 0 );
+                set_balance( g, 0 );
+                shrunk = true;
+                return g;
+            }
+            rotate( n, dir );
+            if( cb == 0 ) {
+                // Only happens on removals.
+                set_balance( n, sign );
+                set_balance( c, -sign );
+                shrunk = false;
+            }
+            else {
+                set_balance( n, 0 );
+                set_balance( c, 0 );
+                shrunk = true;
+            }
+            return c;
+        }
+
+        void relink( index * path, int * dirs, int depth, index subtree ) {
+            if( depth == 0 )
+                root = subtree;
+            else
+                set_child( path[depth-1], dirs[depth-1], subtree );
+        }
+
+    public:
+        /* Read-only access to the nodes, to check the shape of the tree:
+         * the root, and the node at the given index.
+         */
+        index root_index() const {
+            return root;
+        }
+
+        const node & at( index n ) const {
+            return nodes[n];
+        }
+
+        // Returns 1 if the key was found in the tree, 0 otherwise.
+        int count( int key ) const {
+            index n = root;
+            while( n != null ) {
+                if( key < nodes[n].key )
+                    n = lchild(n);
+                else if( nodes[n].key < key )
+                    n = nodes[n].rchild;
+                else
+                    return 1;
+            }
+            return 0;
+        }
+
+        /* Sets out[i] to count(keys[i]), for i in [0, n).
+         * The searches overlap their cache misses; see batch_lookup.hpp.
+         */
+        void count_batch( const int * keys, std::size_t n, int * out ) const {
+            batch_lookup::count_batch( root,
+                [this]( index c ){ return &nodes[c]; },
+                [this]( index c, bool right ){ return child(c, right); },
+                keys, n, out );
+        }
+
+        /* Inserts the key in the tree.
+         * Nothing is done if the key is already there.
+         */
+        void insert( int key ) {
+            index path[max_height];
+            int dirs[max_height];
+            int depth = 0;
+
+            for( index n = root; n != null; ) {
+                if( key == nodes[n].key )
+                    return;
+                path[depth] = n;
+                dirs[depth] = nodes[n].key < key;
+                n = child(n, dirs[depth]);
+                depth++;
+            }
+
+            index n = allocate(key);
+            relink( path, dirs, depth, n );
+
+            // Retrace; the subtree below path[depth] got taller.
+            while( depth-- > 0 ) {
+                index p = path[depth];
+                int b = balance(p) + (dirs[depth] ? 1 : -1);
+                if( b == 0 ) {
+                    set_balance( p, 0 );
+                    return;
+                }
+                if( b == 1 || b == -1 ) {
+                    set_balance( p, b );
+                    continue;
+                }
+                bool shrunk;
+                relink( path, dirs, depth, rebalance(p, dirs[depth], shrunk) );
+                return;
+            }
+        }
+
+        /* Removes the given key from the tree.
+         * Nothing is done if the key is not present.
+         */
+        void erase( int key ) {
+            index path[max_height];
+            int dirs[max_height];
+            int depth = 0;
+
+            index n = root;
+            while( n != null && nodes[n].key != key ) {
+                path[depth] = n;
+                dirs[depth] = nodes[n].key < key;
+                n = child(n, dirs[depth]);
+                depth++;
+            }
+            if( n == null )
+                return;
+
+            if( lchild(n) != null && nodes[n].rchild != null ) {
+                // Replace the key by its predecessor, and remove the predecessor.
+                index target = n;
+                path[depth] = n;
+                dirs[depth] = 0;
+                depth++;
+                n = lchild(n);
+                while( nodes[n].rchild != null ) {
+                    path[depth] = n;
+                    dirs[depth] = 1;
+                    depth++;
+                    n = nodes[n].rchild;
+                }
+                nodes[target].key = nodes[n].key;
+            }
+
+            relink( path, dirs, depth, lchild(n) != null ? lchild(n) : nodes[n].rchild );
+            deallocate( n );
+
+            // Retrace; the subtree below path[depth] got shorter.
+            while( depth-- > 0 ) {
+                index p = path[depth];
+                int b = balance(p) + (dirs[depth] ? -1 : 1);
+                if( b == 1 || b == -1 ) {
+                    set_balance( p, b );
+                    return;
+                }
+                if( b == 0 ) {
+                    set_balance( p, 0 );
+                    continue;
+                }
+                bool shrunk;
+                relink( path, dirs, depth, rebalance(p, b > 0, shrunk) );
+                if( !shrunk )
+                    return;
+            }
+        }
+    };
+}
+
+#endif // COMPACT_AVL_HPP
@@ -0,0 +1,164 @@
+#ifndef COMPACT_TREAP_HPP
+#define COMPACT_TREAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "batch_lookup.hpp"
+
+/* Treap stored in a contiguous vector.
+ *
+ * Children are 32-bit indices into the vector instead of pointers,
+ * making a node 16 bytes long, against the 24 bytes of treap::node
+ * (plus the malloc overhead).
+ *
+ * Since references into the vector are invalidated by allocations,
+ * insert keeps an explicit path of indices from the root,
+ * and erase (which never allocates) walks down through child links.
+ */
+namespace compact_treap {
+    typedef std::uint32_t index;
+
+    // Index 0 is never a valid node; it plays the role of the null pointer.
+    constexpr index null = 0;
+
+    struct node {
+        int key;
+        unsigned int priority;
+        index child[2]; // child[0] is the left child.
+    };
+
+    // std::set-like interface
+    template< typename RNG >
+    class treap {
+        std::vector<node> nodes = std::vector<node>(1);
+        index root = null;
+        index free_list = null; // Linked through child[1].
+        std::vector<index> path; // Kept here to reuse its memory between inserts.
+        RNG rng;
+
+        index allocate( int key, unsigned int priority ) {
+            index n;
+            if( free_list != null ) {
+                n = free_list;
+                free_list = nodes[n].child[1];
+            }
+            else {
+                if( nodes.size() > std::numeric_limits<index>::max() )
+                    throw std::length_error( "compact_treap::treap: too many nodes" );
+                n = nodes.size();
+                nodes.emplace_back();
+            }
+            nodes[n] = node{ key, priority, {null, null} };
+            return n;
+        }
+
+        void deallocate( index n ) {
+            nodes[n].child[1] = free_list;
+            free_list = n;
+        }
+
+        /* Rotates the subtree rooted at n towards 1-dir,
+         * so that its child in direction dir becomes the root.
+         */
+        index rotate( index n, int dir ) {
+            index c = nodes[n].child[dir];
+            nodes[n].child[dir] = nodes[c].child[1-dir];
+            nodes[c].child[1-dir] = n;
+            return c;
+        }
+
+    public:
+        treap( RNG rng ) : rng(rng) {}
+
+        /* Read-only access to the nodes, to check the shape of the treap:
+         * the root, and the node at the given index.
+         */
+        index root_index() const {
+            return root;
+        }
+
+        const node & at( index n ) const {
+            return nodes[n];
+        }
+
+        // Returns 1 if the key was found in the treap, 0 otherwise.
+        int count( int key ) const {
+            index n = root;
+            while( n != null ) {
+                if( key == nodes[n].key )
+                    return 1;
+                n = nodes[n].child[nodes[n].key < key];
+            }
+            return 0;
+        }
+
+        /* Sets out[i] to count(keys[i]), for i in [0, n).
+         * The searches overlap their cache misses; see batch_lookup.hpp.
+         */
+        void count_batch( const int * keys, std::size_t n, int * out ) const {
+            batch_lookup::count_batch( root,
+                [this]( index c ){ return &nodes[c]; },
+                [this]( index c, bool right ){ return nodes[c].child[right]; },
+                keys, n, out );
+        }
+
+        /* Inserts the key in the treap.
+         * Nothing is done if the key is already there.
+         */
+        void insert( int key ) {
+            path.clear();
+            for( index n = root; n != null; ) {
+                if( key == nodes[n].key )
+                    return;
+                path.push_back(n);
+                n = nodes[n].child[nodes[n].key < key];
+            }
+
+            unsigned int priority = rng();
+            index n = allocate( key, priority );
+
+            // Rotate the new node up while it beats its parent.
+            while( !path.empty() && nodes[path.back()].priority < priority ) {
+                index p = path.back();
+                int dir = nodes[p].key < key;
+                nodes[p].child[dir] = n;
+                rotate( p, dir );
+                path.pop_back();
+            }
+            if( path.empty() )
+                root = n;
+            else
+                nodes[path.back()].child[nodes[path.back()].key < key] = n;
+        }
+
+        /* Removes the given key from the treap.
+         * Nothing is done if the key is not present.
+         */
+        void erase( int key ) {
+            index * link = &root;
+            while( *link != null && nodes[*link].key != key )
+                link = &nodes[*link].child[nodes[*link].key < key];
+
+            index n = *link;
+            if( n == null )
+                return;
+
+            // Rotate n down until it has at most one child.
+            while( nodes[n].child[0] != null && nodes[n].child[1] != null ) {
+                int dir = nodes[nodes[n].child[0]].priority <
+                          nodes[nodes[n].child[1]].priority;
+                index c = rotate( n, dir );
+                *link = c;
+                link = &nodes[c].child[1-dir];
+            }
+            *link = nodes[n].child[ nodes[n].child[0] == null ];
+            deallocate( n );
+        }
+    };
+}
+
+#endif // COMPACT_TREAP_HPP
@@ -0,0 +1,221 @@
+#ifndef CONCURRENT_TREAP_HPP
+#define CONCURRENT_TREAP_HPP
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "epoch.hpp"
+
+/* Treap for read-mostly workloads shared by many threads.
+ *
+ * count takes no lock: it walks down child pointers loaded atomically,
+ * inside an epoch guard (see epoch.hpp), and finishes in O(height)
+ * whatever the other threads do, so it is wait-free.
+ *
+ * Writers take a mutex, and never change a node that readers may see,
+ * other than the one child pointer where the update is published.
+ * An update builds fresh copies of the nodes it would restructure
+ * (the split path below a new node, or the merged spines of a removed one;
+ * expected O(1) nodes in a treap), links them to the untouched subtrees,
+ * and publishes the result with a single release store.
+ * A reader thus sees either the old subtree or the new one, both complete.
+ * The replaced nodes are retired, and freed when no reader can hold them.
+ */
+namespace concurrent_treap {
+    template< typename Key >
+    struct node {
+        const Key key;
+        const unsigned int priority;
+        std::atomic<node *> lchild, rchild;
+
+        node( const Key & key, unsigned int priority, node * lchild, node * rchild ) :
+            key(key), priority(priority), lchild(lchild), rchild(rchild)
+        {}
+    };
+
+    // std::set-like interface; every member may be called from any thread.
+    template< typename Key, typename RNG, typename Compare = std::less<Key> >
+    class treap {
+        using node_type = node<Key>;
+
+        std::atomic<node_type *> root{nullptr};
+        Compare comp;
+        std::mutex writer; // Guards everything below, and the retiring.
+        RNG rng;
+        ebr::domain epochs;
+        std::vector<node_type *> replaced; // Scratch list of the nodes an update replaces.
+
+        // Unpublished copy of n, with the same children.
+        static node_type * copy( const node_type * n ) {
+            return new node_type( n->key, n->priority,
+                n->lchild.load(std::memory_order_relaxed),
+                n->rchild.load(std::memory_order_relaxed) );
+        }
+
+        /* Builds, in l and r, copies of the search path for key in the subtree n,
+         * split into the keys smaller than key and the others;
+         * the subtrees hanging off the path are shared.
+         * The nodes of the path are added to 'replaced'.
+         */
+        void split_copy( node_type * n, const Key & key, node_type *& l, node_type *& r ) {
+            std::atomic<node_type *> left{nullptr}, right{nullptr};
+            std::atomic<node_type *> * lhook = &left;
+            std::atomic<node_type *> * rhook = &right;
+            for( ; n; ) {
+                node_type * c = copy( n );
+                replaced.push_back( n );
+                if( comp(n->key, key) ) {
+                    lhook->store( c, std::memory_order_relaxed );
+                    lhook = &c->rchild;
+                    n = n->rchild.load(std::memory_order_relaxed);
+                }
+                else {
+                    rhook->store( c, std::memory_order_relaxed );
+                    rhook = &c->lchild;
+                    n = n->lchild.load(std::memory_order_relaxed);
+                }
+            }
+            lhook->store( nullptr, std::memory_order_relaxed );
+            rhook->store( nullptr, std::memory_order_relaxed );
+            l = left.load(std::memory_order_relaxed);
+            r = right.load(std::memory_order_relaxed);
+        }
+
+        /* Returns the merge of the subtrees a and b (keys of a smaller),
+         * copying the nodes of the zipped spines, which go to 'replaced'.
+         * As in treap::merge, the left side wins priority ties.
+         */
+        node_type * merge_copy( node_type * a, node_type * b ) {
+            std::atomic<node_type *> ret{nullptr};
+            std::atomic<node_type *> * hook = &ret;
+            while( a && b ) {
+                if( a->priority < b->priority ) {
+                    node_type * c = copy( b );
+                    replaced.push_back( b );
+                    hook->store( c, std::memory_order_relaxed );
+                    hook = &c->lchild;
+                    b = b->lchild.load(std::memory_order_relaxed);
+                }
+                else {
+                    node_type * c = copy( a );
+                    replaced.push_back( a );
+                    hook->store( c, std::memory_order_relaxed );
+                    hook = &c->rchild;
+                    a = a->rchild.load(std::memory_order_relaxed);
+                }
+            }
+            hook->store( a ? a : b, std::memory_order_relaxed );
+            return ret.load(std::memory_order_relaxed);
+        }
+
+        // Hands the replaced nodes, now unreachable for new readers, to the epochs.
+        void retire_replaced() {
+            for( node_type * n : replaced )
+                epochs.retire( n );
+            replaced.clear();
+        }
+
+        static void destroy( node_type * n ) {
+            if( !n )
+                return;
+            destroy( n->lchild.load(std::memory_order_relaxed) );
+            destroy( n->rchild.load(std::memory_order_relaxed) );
+            delete n;
+        }
+
+    public:
+        treap( RNG rng, const Compare & comp = Compare() ) : comp(comp), rng(rng) {}
+
+        treap( const treap & ) = delete;
+        treap & operator=( const treap & ) = delete;
+
+        // No other thread may be using the treap.
+        ~treap() {
+            destroy( root.load() );
+        }
+
+        // Returns 1 if the key was found in the treap, 0 otherwise. Wait-free.
+        int count( const Key & key ) {
+            ebr::guard g( epochs );
+            node_type * n = root.load(std::memory_order_acquire);
+            while( n ) {
+                if( comp(key, n->key) )
+                    n = n->lchild.load(std::memory_order_acquire);
+                else if( comp(n->key, key) )
+                    n = n->rchild.load(std::memory_order_acquire);
+                else
+                    return 1;
+            }
+            return 0;
+        }
+
+        /* Inserts the key in the treap.
+         * Nothing is done if the key is already there.
+         * The new node goes where split_insert would put it,
+         * above the copied halves of the subtree that was there.
+         */
+        void insert( const Key & key ) {
+            std::lock_guard<std::mutex> lock( writer );
+            unsigned int priority = rng();
+            std::atomic<node_type *> * slot = &root;
+            node_type * n;
+            while( (n = slot->load(std::memory_order_relaxed)) && !(n->priority < priority) ) {
+                if( comp(key, n->key) )
+                    slot = &n->lchild;
+                else if( comp(n->key, key) )
+                    slot = &n->rchild;
+                else
+                    return; // Key is already here.
+            }
+            // The key may still be further down; look for it before copying anything.
+            for( node_type * m = n; m; ) {
+                if( comp(key, m->key) )
+                    m = m->lchild.load(std::memory_order_relaxed);
+                else if( comp(m->key, key) )
+                    m = m->rchild.load(std::memory_order_relaxed);
+                else
+                    return;
+            }
+
+            node_type * l, * r;
+            split_copy( n, key, l, r );
+            slot->store( new node_type(key, priority, l, r), std::memory_order_release );
+            retire_replaced();
+        }
+
+        /* Removes the given key from the treap.
+         * Nothing is done if the key is not present.
+         */
+        void erase( const Key & key ) {
+            std::lock_guard<std::mutex> lock( writer );
+            std::atomic<node_type *> * slot = &root;
+            node_type * n;
+            while( (n = slot->load(std::memory_order_relaxed)) ) {
+                if( comp(key, n->key) )
+                    slot = &n->lchild;
+                else if( comp(n->key, key) )
+                    slot = &n->rchild;
+                else
+                    break;
+            }
+            if( !n )
+                return;
+
+            node_type * merged = merge_copy( n->lchild.load(std::memory_order_relaxed),
+                    n->rchild.load(std::memory_order_relaxed) );
+            replaced.push_back( n );
+            slot->store( merged, std::memory_order_release );
+            retire_replaced();
+        }
+
+        // Number of nodes waiting for the readers to let them go.
+        std::size_t pending_reclamation() {
+            std::lock_guard<std::mutex> lock( writer );
+            return epochs.pending();
+        }
+    };
+}
+
+#endif // CONCURRENT_TREAP_HPP
@@ -0,0 +1,155 @@
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/* Epoch-based reclamation, for structures read without locks.
+ *
+ * A reader announces the global epoch when it starts an operation
+ * (see guard), and withdraws when it ends.
+ * A writer that unlinks a node cannot free it at once,
+ * since a reader may still be looking at it; it retires the node instead,
+ * tagged with the current epoch.
+ * The epoch only advances once every active reader has announced it;
+ * so when it is two past a node's tag, every reader that could have
+ * seen the node has finished, and the node is freed.
+ *
+ * Readers pay one store and one full fence per operation;
+ * retire and collect must be called by one thread at a time
+ * (in practice, under the writers' lock).
+ */
+namespace ebr {
+    // Maximum number of threads alive at once using any domain.
+    constexpr std::size_t max_threads = 256;
+
+    /* Index of the calling thread in [0, max_threads),
+     * unique among the live threads and reused after a thread exits.
+     */
+    inline std::size_t thread_index() {
+        static std::atomic<bool> used[max_threads];
+        struct slot {
+            std::size_t index = 0;
+            slot() {
+                while( used[index].exchange(true) )
+                    if( ++index == max_threads )
+                        throw std::runtime_error( "ebr: too many threads" );
+            }
+            ~slot() {
+                used[index].store( false );
+            }
+        };
+        thread_local slot s;
+        return s.index;
+    }
+
+    class domain {
+        static constexpr std::uint64_t quiescent = std::numeric_limits<std::uint64_t>::max();
+
+        // One cache line per thread, so that readers do not share lines.
+        struct alignas(64) reader {
+            std::atomic<std::uint64_t> epoch{quiescent};
+        };
+
+        struct retired {
+            void * ptr;
+            void (* free)( void * );
+            std::uint64_t epoch;
+        };
+
+        std::atomic<std::uint64_t> global{0};
+        reader readers[max_threads];
+        std::vector<retired> limbo; // Ordered by epoch.
+        std::size_t since_collect = 0;
+
+        /* Advances the epoch if every active reader is in the current one.
+         * The fence pairs with the one in enter: either this sees the reader,
+         * or the reader sees every unlink done before this.
+         */
+        bool try_advance() {
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            std::uint64_t e = global.load();
+            for( const reader & r : readers ) {
+                std::uint64_t local = r.epoch.load();
+                if( local != quiescent && local != e )
+                    return false;
+            }
+            global.store( e + 1 );
+            return true;
+        }
+
+    public:
+        // Retired objects are collected this often.
+        static constexpr std::size_t collect_period = 64;
+
+        domain() = default;
+        domain( const domain & ) = delete;
+        domain & operator=( const domain & ) = delete;
+
+        // No reader may be left; everything retired is freed.
+        ~domain() {
+            for( const retired & r : limbo )
+                r.free( r.ptr );
+        }
+
+        // Returns the thread index, to be given back to exit.
+        std::size_t enter() {
+            std::size_t i = thread_index();
+            readers[i].epoch.store( global.load(), std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            return i;
+        }
+
+        void exit( std::size_t i ) {
+            readers[i].epoch.store( quiescent, std::memory_order_release );
+        }
+
+        /* Hands over an object already unlinked from the structure,
+         * to be deleted once no reader can reach it.
+         */
+        template< typename T >
+        void retire( T * ptr ) {
+            limbo.push_back( retired{ ptr, []( void * p ){ delete static_cast<T *>(p); },
+                    global.load() } );
+            if( ++since_collect >= collect_period ) {
+                since_collect = 0;
+                collect();
+            }
+        }
+
+        // Frees what is safe to free, advancing the epoch if possible.
+        void collect() {
+            try_advance();
+            std::uint64_t e = global.load();
+            std::size_t n = 0;
+            while( n < limbo.size() && limbo[n].epoch + 2 <= e ) {
+                limbo[n].free( limbo[n].ptr );
+                n++;
+            }
+            limbo.erase( limbo.begin(), limbo.begin() + n );
+        }
+
+        // Number of retired objects not freed yet.
+        std::size_t pending() const {
+            return limbo.size();
+        }
+    };
+
+    // Reader critical section: what it reads is not freed before it ends.
+    class guard {
+        domain & d;
+        std::size_t index;
+
+    public:
+        explicit guard( domain & d ) : d(d), index(d.enter()) {}
+        ~guard() { d.exit( index ); }
+        guard( const guard & ) = delete;
+        guard & operator=( const guard & ) = delete;
+    };
+}
+
+#endif // EPOCH_HPP
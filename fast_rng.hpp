@@ -0,0 +1,255 @@
+#ifndef FAST_RNG_HPP
+#define FAST_RNG_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* Fast random number generators, to draw treap priorities.
+ *
+ * Each one can be the RNG of treap::treap: it is built from a seed,
+ * and operator() returns the next number.
+ * They are also standard uniform random bit generators,
+ * so they work with the distributions of <random>.
+ *
+ * xorshift (xorshift.hpp) makes one number per call,
+ * and every call waits for the previous one to update the state.
+ * xorshift_lanes runs many independent xorshift generators side by side,
+ * in SIMD registers when the compiler targets AVX2 or SSE2
+ * (compile with -march=native to get AVX2), in a plain loop otherwise;
+ * buffered hands out its numbers one at a time.
+ */
+namespace fast_rng {
+    namespace detail {
+        // splitmix64, to spread a small seed over a large state.
+        inline std::uint64_t splitmix64( std::uint64_t & state ) {
+            std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return z ^ (z >> 31);
+        }
+
+        inline std::uint64_t rotl( std::uint64_t x, int k ) {
+            return (x << k) | (x >> (64 - k));
+        }
+    }
+
+    /* xoshiro256** of Blackman and Vigna, 64-bit output, period 2**256 - 1.
+     * https://prng.di.unimi.it/
+     */
+    class xoshiro256ss {
+        std::array<std::uint64_t, 4> s;
+
+    public:
+        using result_type = std::uint64_t;
+
+        explicit xoshiro256ss( std::uint64_t seed = 1 ) {
+            for( std::uint64_t & word : s )
+                word = detail::splitmix64( seed );
+        }
+
+        // The state, as given; it must not be all zeros.
+        explicit xoshiro256ss( const std::array<std::uint64_t, 4> & state ) : s(state) {}
+
+        std::uint64_t operator()() {
+            std::uint64_t result = detail::rotl( s[1] * 5, 7 ) * 9;
+            std::uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = detail::rotl( s[3], 45 );
+            return result;
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    };
+
+    /* PCG32 (pcg32_random_r of O'Neill): a 64-bit linear congruential state,
+     * with a random rotation of its high bits as 32-bit output.
+     * https://www.pcg-random.org/
+     */
+    class pcg32 {
+        std::uint64_t state = 0, increment;
+
+    public:
+        using result_type = std::uint32_t;
+
+        /* Generator of the given sequence, starting from the given seed,
+         * as pcg32_srandom_r.
+         */
+        explicit pcg32( std::uint64_t seed = 1, std::uint64_t sequence = 0xda3e39cb94b95bdb ) :
+            increment( (sequence << 1) | 1 )
+        {
+            (*this)();
+            state += seed;
+            (*this)();
+        }
+
+        std::uint32_t operator()() {
+            std::uint64_t old = state;
+            state = old * 6364136223846793005 + increment;
+            std::uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+            std::uint32_t rot = old >> 59;
+            return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    };
+
+    /* wyrand of Wang Yi: a Weyl sequence, mixed by a 64x64->128-bit multiplication.
+     * https://github.com/wangyi-fudan/wyhash
+     */
+    class wyrand {
+        std::uint64_t state;
+
+    public:
+        using result_type = std::uint64_t;
+
+        explicit wyrand( std::uint64_t seed = 1 ) : state(seed) {}
+
+        std::uint64_t operator()() {
+            state += 0xa0761d6478bd642f;
+            __uint128_t product = __uint128_t(state) * (state ^ 0xe7037ed1a0b428db);
+            return std::uint64_t(product) ^ std::uint64_t(product >> 64);
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    };
+
+    /* Lanes independent xorshift_t<a, b, c> generators, stepped together:
+     * step writes the next number of every lane, lane i to out[i].
+     * Each lane gives the same numbers as an xorshift_t with the same state.
+     * Lanes must be a multiple of 8.
+     */
+    template< std::size_t Lanes = 16, std::uint32_t a = 15, std::uint32_t b = 4,
+        std::uint32_t c = 21 >
+    class xorshift_lanes {
+        static_assert( Lanes % 8 == 0, "xorshift_lanes needs a multiple of 8 lanes" );
+
+        std::uint32_t x[Lanes], y[Lanes], z[Lanes], w[Lanes];
+
+    public:
+        static constexpr std::size_t lanes = Lanes;
+
+        // Every lane gets its own state, drawn from the seed.
+        explicit xorshift_lanes( std::uint64_t seed = 1 ) {
+            for( std::size_t i = 0; i < Lanes; i++ ) {
+                do {
+                    std::uint64_t r = detail::splitmix64( seed );
+                    x[i] = r;
+                    y[i] = r >> 32;
+                    r = detail::splitmix64( seed );
+                    z[i] = r;
+                    w[i] = r >> 32;
+                } while( (x[i] | y[i] | z[i] | w[i]) == 0 );
+            }
+        }
+
+        // Sets the state of a lane; it must not be all zeros.
+        void seed_lane( std::size_t i, std::uint32_t x, std::uint32_t y,
+                std::uint32_t z, std::uint32_t w )
+        {
+            this->x[i] = x;
+            this->y[i] = y;
+            this->z[i] = z;
+            this->w[i] = w;
+        }
+
+        void step( std::uint32_t * out ) {
+#if defined(__AVX2__)
+            for( std::size_t i = 0; i < Lanes; i += 8 ) {
+                auto load = []( const std::uint32_t * p ){
+                    return _mm256_loadu_si256( reinterpret_cast<const __m256i *>(p) );
+                };
+                auto store = []( std::uint32_t * p, __m256i v ){
+                    _mm256_storeu_si256( reinterpret_cast<__m256i *>(p), v );
+                };
+                __m256i vx = load( x + i ), vw = load( w + i );
+                __m256i t = _mm256_xor_si256( vx, _mm256_slli_epi32(vx, a) );
+                t = _mm256_xor_si256( t, _mm256_srli_epi32(t, b) );
+                __m256i next = _mm256_xor_si256( _mm256_xor_si256(vw, _mm256_srli_epi32(vw, c)), t );
+                store( x + i, load(y + i) );
+                store( y + i, load(z + i) );
+                store( z + i, vw );
+                store( w + i, next );
+                store( out + i, next );
+            }
+#elif defined(__SSE2__)
+            for( std::size_t i = 0; i < Lanes; i += 4 ) {
+                auto load = []( const std::uint32_t * p ){
+                    return _mm_loadu_si128( reinterpret_cast<const __m128i *>(p) );
+                };
+                auto store = []( std::uint32_t * p, __m128i v ){
+                    _mm_storeu_si128( reinterpret_cast<__m128i *>(p), v );
+                };
+                __m128i vx = load( x + i ), vw = load( w + i );
+                __m128i t = _mm_xor_si128( vx, _mm_slli_epi32(vx, a) );
+                t = _mm_xor_si128( t, _mm_srli_epi32(t, b) );
+                __m128i next = _mm_xor_si128( _mm_xor_si128(vw, _mm_srli_epi32(vw, c)), t );
+                store( x + i, load(y + i) );
+                store( y + i, load(z + i) );
+                store( z + i, vw );
+                store( w + i, next );
+                store( out + i, next );
+            }
+#else
+            for( std::size_t i = 0; i < Lanes; i++ ) {
+                std::uint32_t t = x[i] ^ (x[i] << a);
+                x[i] = y[i];
+                y[i] = z[i];
+                z[i] = w[i];
+                out[i] = w[i] = (w[i] ^ (w[i] >> c)) ^ (t ^ (t >> b));
+            }
+#endif
+        }
+    };
+
+    /* Hands out the numbers of a multi-lane Generator one at a time,
+     * stepping it Steps times whenever its buffer runs out.
+     * Generator needs a static 'lanes' and step(std::uint32_t * out).
+     */
+    template< typename Generator, std::size_t Steps = 4 >
+    class buffered {
+        static constexpr std::size_t size = Generator::lanes * Steps;
+
+        Generator generator;
+        std::uint32_t buffer[size];
+        std::size_t next = size;
+
+        void refill() {
+            for( std::size_t i = 0; i < Steps; i++ )
+                generator.step( buffer + i * Generator::lanes );
+            next = 0;
+        }
+
+    public:
+        using result_type = std::uint32_t;
+
+        explicit buffered( std::uint64_t seed = 1 ) : generator(seed) {}
+        explicit buffered( const Generator & generator ) : generator(generator) {}
+
+        std::uint32_t operator()() {
+            if( next == size )
+                refill();
+            return buffer[next++];
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    };
+
+    // 16 xorshift lanes, handed out one number at a time.
+    using simd_xorshift = buffered<xorshift_lanes<16>>;
+}
+
+#endif // FAST_RNG_HPP
@@ -0,0 +1,202 @@
+#ifndef FORK_JOIN_HPP
+#define FORK_JOIN_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Work-stealing fork-join thread pool.
+ *
+ * Parallel code calls fork_join::join(f, g) to express that f and g
+ * may run in parallel. Inside pool::run, join pushes g to the
+ * calling worker's deque, runs f, and then either runs g itself
+ * or, if g was stolen meanwhile, helps the other workers until g is done.
+ * Outside pool::run, join simply runs f and then g;
+ * so the same code runs sequentially when there is no pool around.
+ *
+ * Each worker owns a deque; the owner pushes and pops at the back,
+ * idle workers steal from the front, that is, the oldest (and largest) tasks.
+ * Tasks must not throw.
+ */
+namespace fork_join {
+    struct task {
+        std::atomic<bool> done{false};
+        virtual void execute() = 0;
+
+        void run() {
+            execute();
+            done.store( true, std::memory_order_release );
+        }
+
+    protected:
+        ~task() = default;
+    };
+
+    template< typename F >
+    struct function_task : task {
+        F & f;
+        function_task( F & f ) : f(f) {}
+        void execute() override { f(); }
+    };
+
+    class pool {
+        struct worker {
+            std::mutex mutex;
+            std::deque<task *> tasks;
+        };
+
+        std::vector<std::unique_ptr<worker>> workers;
+        std::vector<std::thread> threads;
+        std::atomic<bool> stop{false};
+        std::atomic<bool> running{false};
+        std::mutex idle_mutex;
+        std::condition_variable idle;
+
+        // Which pool the current thread is working for; zero-initialized.
+        struct context {
+            pool * owner;
+            unsigned index;
+        };
+        inline static thread_local context current;
+
+        void push( unsigned index, task * t ) {
+            std::lock_guard<std::mutex> lock( workers[index]->mutex );
+            workers[index]->tasks.push_back( t );
+        }
+
+        // Pops t from the back of the deque, if it is still there.
+        bool pop( unsigned index, task * t ) {
+            std::lock_guard<std::mutex> lock( workers[index]->mutex );
+            auto & tasks = workers[index]->tasks;
+            if( tasks.empty() || tasks.back() != t )
+                return false;
+            tasks.pop_back();
+            return true;
+        }
+
+        // Takes the oldest task of some other worker.
+        task * steal( unsigned thief ) {
+            for( unsigned i = 1; i < workers.size(); i++ ) {
+                worker & victim = *workers[(thief + i) % workers.size()];
+                std::lock_guard<std::mutex> lock( victim.mutex );
+                if( !victim.tasks.empty() ) {
+                    task * t = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    return t;
+                }
+            }
+            return nullptr;
+        }
+
+        void work( unsigned index ) {
+            current = context{ this, index };
+            while( !stop.load(std::memory_order_relaxed) ) {
+                if( !running.load(std::memory_order_acquire) ) {
+                    std::unique_lock<std::mutex> lock( idle_mutex );
+                    idle.wait( lock, [this]{ return stop || running; } );
+                    continue;
+                }
+                if( task * t = steal(index) )
+                    t->run();
+                else
+                    std::this_thread::yield();
+            }
+        }
+
+    public:
+        /* Creates a pool of 'size' workers.
+         * The thread calling run is one of them,
+         * so only size-1 threads are started.
+         */
+        explicit pool( unsigned size ) {
+            if( size == 0 )
+                size = 1;
+            for( unsigned i = 0; i < size; i++ )
+                workers.push_back( std::make_unique<worker>() );
+            for( unsigned i = 1; i < size; i++ )
+                threads.emplace_back( [this, i]{ work(i); } );
+        }
+
+        pool( const pool & ) = delete;
+        pool & operator=( const pool & ) = delete;
+
+        ~pool() {
+            {
+                std::lock_guard<std::mutex> lock( idle_mutex );
+                stop = true;
+            }
+            idle.notify_all();
+            for( auto & t : threads )
+                t.join();
+        }
+
+        unsigned size() const {
+            return workers.size();
+        }
+
+        // Index of the calling worker in its pool; 0 outside pool::run.
+        static unsigned current_index() {
+            return current.owner ? current.index : 0;
+        }
+
+        // Workers of the calling worker's pool; 1 outside pool::run.
+        static unsigned current_size() {
+            return current.owner ? current.owner->size() : 1;
+        }
+
+        /* Runs f in the calling thread, as the pool's first worker;
+         * every join done by f may be executed by the other workers.
+         * Returns after f and every task it forked are done.
+         * Only one thread may be inside run at a time.
+         */
+        template< typename F >
+        void run( F && f ) {
+            context saved = current;
+            current = context{ this, 0 };
+            {
+                std::lock_guard<std::mutex> lock( idle_mutex );
+                running = true;
+            }
+            idle.notify_all();
+            f();
+            running = false;
+            current = saved;
+        }
+
+        template< typename F, typename G >
+        friend void join( F && f, G && g );
+    };
+
+    /* Runs f and g, possibly in parallel, and returns when both are done.
+     */
+    template< typename F, typename G >
+    void join( F && f, G && g ) {
+        pool::context ctx = pool::current;
+        if( !ctx.owner ) {
+            f();
+            g();
+            return;
+        }
+
+        function_task<G> t( g );
+        ctx.owner->push( ctx.index, &t );
+        f();
+        if( ctx.owner->pop(ctx.index, &t) ) {
+            t.run();
+            return;
+        }
+        // g was stolen; help the others while waiting for it.
+        while( !t.done.load(std::memory_order_acquire) ) {
+            if( task * other = ctx.owner->steal(ctx.index) )
+                other->run();
+            else
+                std::this_thread::yield();
+        }
+    }
+}
+
+#endif // FORK_JOIN_HPP
@@ -0,0 +1,192 @@
+#ifndef FROZEN_HPP
+#define FROZEN_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "batch_lookup.hpp"
+#include "memory_usage.hpp"
+
+/* Static search index for the read-only phase of a workload.
+ *
+ * A tree is frozen by copying its keys, in order, into an array
+ * in Eytzinger (breadth-first) layout: the root at index 1,
+ * and the children of index k at 2k and 2k+1.
+ * A search is then a walk down the implicit tree,
+ * with no pointers to chase and no unpredictable branches;
+ * and since the 16 descendants of k four levels down
+ * are the 64-byte block starting at 16k,
+ * they can be prefetched four steps before they are needed.
+ */
+namespace frozen {
+    /* Appends the keys of the tree to 'keys', in order.
+     * Works with any node type having key, lchild and rchild.
+     */
+    template< typename Pointer >
+    void in_order_keys( const Pointer & root, std::vector<int> & keys ) {
+        std::vector<const typename Pointer::element_type *> stack;
+        const typename Pointer::element_type * n = root.get();
+        while( n || !stack.empty() ) {
+            for( ; n; n = n->lchild.get() )
+                stack.push_back( n );
+            n = stack.back();
+            stack.pop_back();
+            keys.push_back( n->key );
+            n = n->rchild.get();
+        }
+    }
+
+    class eytzinger {
+        static constexpr std::size_t block_size = 64;
+        static_assert( 16 * sizeof(int) == block_size, "a block must hold 16 keys" );
+
+        struct free_delete {
+            std::size_t bytes; // Reported to memory_usage.
+
+            void operator()( int * ptr ) const {
+                memory_usage::freed( bytes );
+                std::free( ptr );
+            }
+        };
+
+        std::size_t n = 0;
+        // Index 0 is unused; the array is aligned so that 16k starts a block.
+        std::unique_ptr<int[], free_delete> keys;
+
+        // Fills the subtree rooted at k with the next keys of first.
+        template< typename Iterator >
+        void fill( std::size_t k, Iterator & first ) {
+            if( k > n )
+                return;
+            fill( 2 * k, first );
+            keys[k] = *first;
+            ++first;
+            fill( 2 * k + 1, first );
+        }
+
+    public:
+        eytzinger() = default;
+
+        /* Builds the index with the n keys starting at first,
+         * which must be strictly ascending.
+         */
+        template< typename Iterator >
+        eytzinger( Iterator first, std::size_t n ) : n(n) {
+            std::size_t bytes = (n + 1) * sizeof(int);
+            bytes = (bytes + block_size - 1) / block_size * block_size;
+            keys = std::unique_ptr<int[], free_delete>(
+                static_cast<int *>(std::aligned_alloc( block_size, bytes )), free_delete{bytes} );
+            if( !keys )
+                throw std::bad_alloc();
+            memory_usage::allocated( bytes );
+            fill( 1, first );
+        }
+
+        explicit eytzinger( const std::vector<int> & sorted ) :
+            eytzinger( sorted.begin(), sorted.size() )
+        {}
+
+        std::size_t size() const {
+            return n;
+        }
+
+        // Returns 1 if the key is in the index, 0 otherwise.
+        int count( int key ) const {
+            std::size_t k = 1;
+            while( k <= n ) {
+                /* Computed as an integer: the block may lie past the end,
+                 * which is harmless for a prefetch.
+                 */
+                __builtin_prefetch( reinterpret_cast<const void *>(
+                    reinterpret_cast<std::uintptr_t>(keys.get()) + k * block_size) );
+                k = 2 * k + (keys[k] < key);
+            }
+            /* k went right at every key smaller than key, and left elsewhere;
+             * dropping the trailing right turns and the last left turn
+             * leaves the smallest key not less than key, or 0 if there is none.
+             */
+            k >>= __builtin_ctzll( ~k ) + 1;
+            return k != 0 && keys[k] == key;
+        }
+
+        /* Sets out[i] to count(query[i]), for i in [0, m).
+         * The searches of a group advance in lockstep (see batch_lookup.hpp),
+         * so the first levels, below the reach of the prefetch, overlap too.
+         */
+        void count_batch( const int * query, std::size_t m, int * out ) const {
+            constexpr std::size_t group_size = batch_lookup::group_size;
+            std::size_t k[group_size];
+            for( std::size_t base = 0; base < m; base += group_size ) {
+                std::size_t lanes = std::min( group_size, m - base );
+                for( std::size_t i = 0; i < lanes; i++ )
+                    k[i] = 1;
+                // Every lane is at the same depth; only the last level is ragged.
+                for( bool more = n > 0; more; ) {
+                    more = false;
+                    for( std::size_t i = 0; i < lanes; i++ ) {
+                        if( k[i] > n )
+                            continue;
+                        __builtin_prefetch( reinterpret_cast<const void *>(
+                            reinterpret_cast<std::uintptr_t>(keys.get()) + k[i] * block_size) );
+                        k[i] = 2 * k[i] + (keys[k[i]] < query[base + i]);
+                        more = true;
+                    }
+                }
+                for( std::size_t i = 0; i < lanes; i++ ) {
+                    std::size_t r = k[i] >> (__builtin_ctzll( ~k[i] ) + 1);
+                    out[base + i] = r != 0 && keys[r] == query[base + i];
+                }
+            }
+        }
+    };
+
+    /* Adapter running a tree through a read-mostly workload:
+     * updates go to the tree, and the first search after an update
+     * freezes the tree into an eytzinger index, which answers the searches
+     * until the next update drops it.
+     * Tree must have insert, erase and freeze.
+     */
+    template< typename Tree >
+    class freezing {
+        Tree tree;
+        eytzinger index;
+        bool frozen = false;
+
+    public:
+        explicit freezing( Tree && tree ) : tree( std::move(tree) ) {}
+
+        void insert( int key ) {
+            frozen = false;
+            tree.insert( key );
+        }
+
+        void erase( int key ) {
+            frozen = false;
+            tree.erase( key );
+        }
+
+        int count( int key ) {
+            if( !frozen ) {
+                index = tree.freeze();
+                frozen = true;
+            }
+            return index.count( key );
+        }
+
+        void count_batch( const int * keys, std::size_t n, int * out ) {
+            if( !frozen ) {
+                index = tree.freeze();
+                frozen = true;
+            }
+            index.count_batch( keys, n, out );
+        }
+    };
+}
+
+#endif // FROZEN_HPP
@@ -0,0 +1,216 @@
+#ifndef GENERATION_HPP
+#define GENERATION_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "fork_join.hpp"
+
+/* Tools to generate test cases in parallel, deterministically.
+ *
+ * A test case is cut into chunks of chunk_size operations,
+ * and each chunk draws its random numbers from its own generator,
+ * seeded from the seed of the test case and the index of the chunk;
+ * so the chunks can be generated in any order, by any number of threads,
+ * and the test case only depends on the seed.
+ * What the chunks share, such as the order of the insertions,
+ * comes from random permutations computed one position at a time.
+ */
+namespace generation {
+    constexpr std::size_t chunk_size = 1 << 16;
+
+    /* Random permutation of [0, n), computed one position at a time.
+     * A four-round Feistel network shuffles the smallest power of four
+     * not below n; the values out of range are shuffled again
+     * (cycle walking), less than four times on average.
+     * The rounds hash with two multiplications, keeping the high bits:
+     * lighter than a full mixer, and still without visible bias.
+     * Different streams give independent permutations for the same seed.
+     */
+    class random_permutation {
+        std::uint64_t n;
+        int half_bits = 1;
+        std::uint64_t mask;
+        std::array<std::uint64_t, 4> round_keys;
+
+        // Finalizer of splitmix64.
+        static std::uint64_t mix( std::uint64_t x ) {
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+            return x ^ (x >> 31);
+        }
+
+        std::uint64_t encrypt( std::uint64_t x ) const {
+            std::uint64_t left = x >> half_bits, right = x & mask;
+            for( std::uint64_t key : round_keys ) {
+                std::uint64_t hash = (right ^ key) * 0x9e3779b97f4a7c15;
+                hash = (hash ^ (hash >> 32)) * 0xbf58476d1ce4e5b9;
+                std::uint64_t next = left ^ (hash >> (64 - half_bits));
+                left = right;
+                right = next;
+            }
+            return (left << half_bits) | right;
+        }
+
+    public:
+        random_permutation( std::uint64_t n, std::uint32_t seed, std::uint32_t stream = 0 ) :
+            n(n)
+        {
+            while( (std::uint64_t(1) << (2 * half_bits)) < n )
+                half_bits++;
+            mask = (std::uint64_t(1) << half_bits) - 1;
+            std::uint64_t state = (std::uint64_t(seed) << 32) | stream;
+            for( std::uint64_t & key : round_keys )
+                key = mix( state += 0x9e3779b97f4a7c15 );
+        }
+
+        // Position i of the permutation; i must be in [0, n).
+        std::uint64_t operator()( std::uint64_t i ) const {
+            do
+                i = encrypt( i );
+            while( i >= n );
+            return i;
+        }
+    };
+
+    /* Zipf distribution over the ranks [0, n): rank k is drawn with a probability
+     * proportional to 1 / (k+1)**theta, so rank 0 is the most popular;
+     * theta = 0 is uniform, and theta near 1 is the usual skew of web traffic.
+     * Rejection-inversion sampling (Hormann and Derflinger, 1996):
+     * constant time per draw and constant setup, for any n and theta >= 0.
+     */
+    class zipf {
+        double theta;
+        std::uint64_t n;
+        double h_integral_x1, h_integral_n, s;
+
+        // log1p(x) / x, precise near 0.
+        static double helper1( double x ) {
+            return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0/3 - 0.25 * x));
+        }
+
+        // expm1(x) / x, precise near 0.
+        static double helper2( double x ) {
+            return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+        }
+
+        double h( double x ) const {
+            return std::exp( -theta * std::log(x) );
+        }
+
+        double h_integral( double x ) const {
+            double log_x = std::log( x );
+            return helper2( (1 - theta) * log_x ) * log_x;
+        }
+
+        double h_integral_inverse( double x ) const {
+            double t = std::max( x * (1 - theta), -1.0 );
+            return std::exp( helper1(t) * x );
+        }
+
+    public:
+        // n must be at least 1.
+        zipf( std::uint64_t n, double theta ) : theta(theta), n(n) {
+            h_integral_x1 = h_integral( 1.5 ) - 1;
+            h_integral_n = h_integral( n + 0.5 );
+            s = 2 - h_integral_inverse( h_integral(2.5) - h(2) );
+        }
+
+        template< typename RNG >
+        std::uint64_t operator()( RNG & rng ) const {
+            std::uniform_real_distribution<double> uniform;
+            while( true ) {
+                double u = h_integral_n + uniform(rng) * (h_integral_x1 - h_integral_n);
+                double x = h_integral_inverse( u );
+                double k = std::min( std::max(std::floor(x + 0.5), 1.0), (double) n );
+                if( k - x <= s || u >= h_integral(k + 0.5) - h(k) )
+                    return (std::uint64_t) k - 1;
+            }
+        }
+    };
+
+    // Generator of the random numbers of a chunk.
+    inline std::mt19937 chunk_rng( std::uint32_t seed, std::size_t chunk ) {
+        std::seed_seq seq{ seed, std::uint32_t(chunk), std::uint32_t(std::uint64_t(chunk) >> 32) };
+        return std::mt19937( seq );
+    }
+
+    namespace detail {
+        template< typename F >
+        void chunks( std::size_t lo, std::size_t hi, std::size_t n, F & f ) {
+            if( hi - lo == 1 ) {
+                f( lo, lo * chunk_size, std::min(n, (lo + 1) * chunk_size) );
+                return;
+            }
+            std::size_t mid = lo + (hi - lo) / 2;
+            fork_join::join( [&]{ chunks(lo, mid, n, f); }, [&]{ chunks(mid, hi, n, f); } );
+        }
+    }
+
+    /* Calls f(chunk, first, last) for every chunk [first, last) of [0, n),
+     * on a fork_join::pool of 'threads' workers.
+     * f must only touch the positions of its chunk.
+     */
+    template< typename F >
+    void for_each_chunk( std::size_t n, unsigned threads, F f ) {
+        std::size_t count = (n + chunk_size - 1) / chunk_size;
+        if( count == 0 )
+            return;
+        if( threads <= 1 || count == 1 ) {
+            detail::chunks( 0, count, n, f );
+            return;
+        }
+        fork_join::pool pool( std::min<std::size_t>(threads, count) );
+        pool.run( [&]{ detail::chunks(0, count, n, f); } );
+    }
+
+    /* Keys in the tree, to draw one of them uniformly in constant time.
+     * take moves the last key into the hole, so the keys are not in any order.
+     */
+    class live_keys {
+        std::vector<int> keys;
+
+    public:
+        void reserve( std::size_t n ) {
+            keys.reserve( n );
+        }
+
+        void push( int key ) {
+            keys.push_back( key );
+        }
+
+        std::size_t size() const {
+            return keys.size();
+        }
+
+        bool empty() const {
+            return keys.empty();
+        }
+
+        int operator[]( std::size_t i ) const {
+            return keys[i];
+        }
+
+        // Removes and returns the key at i.
+        int take( std::size_t i ) {
+            int key = keys[i];
+            keys[i] = keys.back();
+            keys.pop_back();
+            return key;
+        }
+
+        /* Index in [0, size()) from 32 random bits,
+         * with a multiplication instead of a division.
+         */
+        std::size_t index( std::uint32_t random ) const {
+            return (std::uint64_t(random) * keys.size()) >> 32;
+        }
+    };
+}
+
+#endif // GENERATION_HPP
@@ -0,0 +1,151 @@
+#ifndef IN_ORDER_HPP
+#define IN_ORDER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+/* In-order traversal of the trees of avl.hpp and treap.hpp,
+ * or of any tree of nodes with key, lchild and rchild.
+ *
+ * The nodes have no parent pointers;
+ * instead, an iterator keeps the path from the root to its node,
+ * like the fingers of the trees.
+ * So the nodes pay nothing for being iterable,
+ * and a full traversal costs O(n), but an iterator is as big as the path,
+ * and any change to the tree invalidates it.
+ */
+namespace in_order {
+    template< typename Node >
+    class iterator {
+        const Node * root = nullptr;
+        std::vector<const Node *> path; // From the root to the node; empty at the end.
+
+        void push_leftmost( const Node * n ) {
+            for( ; n; n = n->lchild.get() )
+                path.push_back( n );
+        }
+
+        void push_rightmost( const Node * n ) {
+            for( ; n; n = n->rchild.get() )
+                path.push_back( n );
+        }
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Node;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Node *;
+        using reference = const Node &;
+
+        iterator() = default;
+
+        // Past-the-end iterator of the tree rooted at root.
+        explicit iterator( const Node * root ) : root(root) {}
+
+        // Iterator to the smallest key of the tree rooted at root.
+        static iterator first( const Node * root ) {
+            iterator ret( root );
+            ret.push_leftmost( root );
+            return ret;
+        }
+
+        /* Iterator to the smallest key not less than key,
+         * or greater than key if 'strict'; past-the-end if there is none.
+         * The descent remembers where it last turned left,
+         * which is where the answer is.
+         */
+        template< typename Key, typename Compare >
+        static iterator bound( const Node * root, const Key & key,
+                const Compare & comp, bool strict )
+        {
+            iterator ret( root );
+            std::size_t keep = 0;
+            for( const Node * n = root; n; ) {
+                ret.path.push_back( n );
+                if( strict ? comp(key, n->key) : !comp(n->key, key) ) {
+                    keep = ret.path.size();
+                    n = n->lchild.get();
+                }
+                else
+                    n = n->rchild.get();
+            }
+            ret.path.resize( keep );
+            return ret;
+        }
+
+        // The node, or null at the end.
+        const Node * get() const {
+            return path.empty() ? nullptr : path.back();
+        }
+
+        const Node & operator*() const { return *path.back(); }
+        const Node * operator->() const { return path.back(); }
+
+        /* Amortized O(1): the path goes down the right subtree, if any,
+         * or else back up to the first ancestor on the left.
+         */
+        iterator & operator++() {
+            const Node * n = path.back();
+            if( n->rchild ) {
+                push_leftmost( n->rchild.get() );
+                return *this;
+            }
+            path.pop_back();
+            while( !path.empty() && path.back()->rchild.get() == n ) {
+                n = path.back();
+                path.pop_back();
+            }
+            return *this;
+        }
+
+        // Mirror of operator++; the end goes back to the largest key.
+        iterator & operator--() {
+            if( path.empty() ) {
+                push_rightmost( root );
+                return *this;
+            }
+            const Node * n = path.back();
+            if( n->lchild ) {
+                push_rightmost( n->lchild.get() );
+                return *this;
+            }
+            path.pop_back();
+            while( !path.empty() && path.back()->lchild.get() == n ) {
+                n = path.back();
+                path.pop_back();
+            }
+            return *this;
+        }
+
+        iterator operator++(int) { iterator ret = *this; ++*this; return ret; }
+        iterator operator--(int) { iterator ret = *this; --*this; return ret; }
+
+        bool operator==( const iterator & other ) const { return get() == other.get(); }
+        bool operator!=( const iterator & other ) const { return get() != other.get(); }
+    };
+
+    /* Calls f(node) for every node of the tree with a key in [lo, hi), in order.
+     * Only the subtrees that may hold such keys are entered,
+     * so this costs O(height + k) for k keys in the range.
+     */
+    template< typename Pointer, typename Key, typename F, typename Compare = std::less<> >
+    void for_each_in_range( const Pointer & tree, const Key & lo, const Key & hi,
+            F && f, const Compare & comp = Compare() )
+    {
+        const auto * n = tree.get();
+        if( !n )
+            return;
+        bool above_lo = !comp(n->key, lo);
+        bool below_hi = comp(n->key, hi);
+        if( above_lo )
+            for_each_in_range( n->lchild, lo, hi, f, comp );
+        if( above_lo && below_hi )
+            f( *n );
+        if( below_hi )
+            for_each_in_range( n->rchild, lo, hi, f, comp );
+    }
+}
+
+#endif // IN_ORDER_HPP
@@ -1,23 +1,161 @@
 namespace command_line {
     const char help_message[] =
 " <data structure> <test case> [options]\n"
+" <data structure> --load <file> | --import <file> [options]\n"
+" <test case> --save <file> [options]\n"
 "Runs a speed test for the given data structure using the selected test case.\n"
 "<data structure> must be one of\n"
 "    avl - AVL self-balancing tree\n"
+"    avl-compact - AVL tree with 32-bit child indices into a node vector\n"
 "    rb - std::set red-black self-balancing tree\n"
 "    treap, treap-mersenne - Treap using Mersenne Twister as RNG\n"
 "    treap-xorshift - Treap using xorshift as RNG\n"
+"    treap-xoshiro, treap-pcg, treap-wyrand - Treap using xoshiro256**,\n"
+"        PCG32 or wyrand as RNG\n"
+"    treap-simd - Treap using 16 xorshift generators stepped together\n"
+"        in SIMD registers (AVX2 with -march=native, SSE2 otherwise),\n"
+"        their numbers buffered; see also rng_benchmark.\n"
+"        These four work wherever treap-xorshift does.\n"
+"    treap-compact - Treap with 32-bit child indices into a node vector,\n"
+"        using xorshift as RNG\n"
+"    treap-concurrent - Treap with lock-free searches and epoch-based\n"
+"        reclamation, using xorshift as RNG; writers serialize on a mutex\n"
+"    treap-persistent - Persistent (path-copying) treap using xorshift as RNG,\n"
+"        snapshotted every --snapshot-every operations; compared against\n"
+"        treap-xorshift, showing the time and the memory of both.\n"
+"    skiplist - Lock-free skip list, with node heights drawn from\n"
+"        per-thread xorshift generators. Its removed nodes are only freed\n"
+"        with it, so its memory grows with every erase; no --memory.\n"
+"    frozen-avl, frozen-treap - avl and treap-xorshift, frozen into a static\n"
+"        Eytzinger-layout index at the first search; the freezing time\n"
+"        is included. Only for test cases which build the tree and then\n"
+"        only search it: not mixed-workload, sliding-window, nor traces\n"
+"        and --workload specs updating it after a search.\n"
 "\n"
 "<test case> must be one of\n"
 "    insert-then-search\n"
 "    ascending-insert-then-search\n"
+"    bulk-load-then-search - ascending-insert-then-search, but the tree is\n"
+"        built at once from the sorted keys (assign_sorted, when available)\n"
 "    insert-then-remove-then-search\n"
 "    mixed-workload\n"
+"    rank-queries - --total-insertions insertions, then as many rank queries\n"
+"        (number of smaller keys) as searches in insert-then-search.\n"
+"        Only for avl, treap-mersenne and treap-xorshift;\n"
+"        implies --order-statistics.\n"
+"    scan-workload - --total-insertions insertions, then --scans range scans\n"
+"        of --scan-length consecutive keys each. Shows the scan bandwidth.\n"
+"        Only for avl, rb, treap-mersenne and treap-xorshift.\n"
+"    set-ops - treap union, intersection and difference with a sorted batch,\n"
+"        against per-key insert/count/erase loops, with 1 to --threads threads.\n"
+"        Only for treap-mersenne and treap-xorshift.\n"
+"    zipf-search - --total-insertions insertions, then about\n"
+"        --search-successes searches by Zipf popularity (--zipf-theta),\n"
+"        mixed with about --search-failures searches for absent keys.\n"
+"    hot-set-search - zipf-search, but the successful searches look for\n"
+"        the --hot-fraction of hot keys with probability --hot-probability,\n"
+"        and for the cold keys otherwise.\n"
+"    sliding-window - --window insertions, then up to --total-insertions:\n"
+"        an insertion, the removal of the oldest key, and searches among\n"
+"        the keys in the tree, the newest being the most popular\n"
+"        (Zipf --zipf-theta); as many searches in all as\n"
+"        --search-successes and --search-failures together.\n"
 "\n"
 "Options:\n"
+"--workload <file>\n"
+"    Generate the test case described in the file; <test case> is then\n"
+"    not needed. The file lists phases of operations, with their mix\n"
+"    and how their keys are chosen; see workload.hpp. For instance:\n"
+"        keys 1000000\n"
+"        phase 1000000\n"
+"        insert 1 fresh\n"
+"        phase 5000000\n"
+"        search 90 zipf 0.99\n"
+"        search 5 miss\n"
+"        insert 2.5 fresh\n"
+"        erase 2.5 oldest\n"
+"    --total-insertions is the default number of keys.\n"
+"\n"
 "--show\n"
 "    Show the resulting test case instead of running it.\n"
 "\n"
+"--save <file>\n"
+"    Write the test case to the file, in a compact binary format,\n"
+"    instead of running it.\n"
+"\n"
+"--load <file>\n"
+"    Run the test case saved in the file, mapped in memory as it is,\n"
+"    instead of generating one; <test case> is then not needed.\n"
+"\n"
+"--import <file>\n"
+"    Run the test case read from a text trace, - being the standard input,\n"
+"    instead of generating one; <test case> is then not needed.\n"
+"    One operation per line: insert/put/set/add, erase/delete/del/remove,\n"
+"    count/get/find/lookup/read, load, rank or scan, and a key (and for\n"
+"    scan, the end of the range); a key alone is a count.\n"
+"    The output of --show is such a trace.\n"
+"    With --save, converts the trace to the binary format.\n"
+"\n"
+"--stream\n"
+"    Generate the test case during the runs, in chunks, on a background\n"
+"    thread, instead of up front: the memory used does not depend on the\n"
+"    number of operations, for soak tests of billions of operations.\n"
+"    The operations follow the same distributions as without --stream,\n"
+"    but they are not the same. Not for bulk-load-then-search, set-ops,\n"
+"    zipf-search, hot-set-search, sliding-window and --workload,\n"
+"    nor with the options showing more than the time of each run.\n"
+"\n"
+"--chunk-size <size>\n"
+"    Number of operations generated at once with --stream.\n"
+"    Defaults to 65536.\n"
+"\n"
+"--hinted\n"
+"    Insert every key with the end() hint, as in set.insert(set.end(), key).\n"
+"    avl and the treaps then start searching from the previous inserted key,\n"
+"    instead of from the root. avl-compact and treap-compact ignore it.\n"
+"\n"
+"--batch-lookups\n"
+"    Run the test case twice per run: with every count operation on its own,\n"
+"    and with each run of consecutive count operations through count_batch,\n"
+"    which interleaves the searches to overlap their cache misses.\n"
+"    Shows both times, and the lookup throughput of both.\n"
+"    rb has no count_batch; it counts one key at a time in both.\n"
+"\n"
+"--latencies\n"
+"    Time every operation on its own, and show, for each run and each\n"
+"    type of operation, the mean and the 50th, 99th and 99.9th percentiles\n"
+"    of the latencies, and the maximum. Uses the time-stamp counter on x86,\n"
+"    calibrated against steady_clock, less the cost of reading it.\n"
+"    A run of bulk loads counts as a single operation.\n"
+"    Not with --batch-lookups.\n"
+"\n"
+"--perf-counters\n"
+"    Count cycles, instructions, L1D, LLC and dTLB misses and branch\n"
+"    misses in each run, with perf_event_open, and show them per operation:\n"
+"    from the construction of the tree to the last operation, and for the\n"
+"    destruction of the tree. Falls back to the timing alone\n"
+"    if the kernel does not permit perf events.\n"
+"\n"
+"--memory\n"
+"    Count the heap memory of each run: every allocation through operator new,\n"
+"    and the slabs of --allocator pool. Shows the time per operation,\n"
+"    the peak of the live bytes, the peak bytes per key (at the largest\n"
+"    size of the tree), and the number of allocations.\n"
+"\n"
+"--order-statistics\n"
+"    Keep the size of every subtree of avl and treap-mersenne/treap-xorshift,\n"
+"    which answers rank and select queries in O(log n),\n"
+"    at the cost of a bigger node and of keeping the sizes current.\n"
+"\n"
+"--snapshot-every <N>\n"
+"    Operations between two snapshots of treap-persistent; 0 disables them.\n"
+"    Default: 1 000\n"
+"\n"
+"--snapshots-kept <N>\n"
+"    Number of the latest snapshots of treap-persistent held alive,\n"
+"    as by readers still using them.\n"
+"    Default: 4\n"
+"\n"
 "--runs <N>\n"
 "    Number of times the test case must be run.\n"
 "    Default: 10\n"
@@ -27,9 +165,33 @@ namespace command_line {
 "    Default: 0\n"
 "\n"
 "--treap-seed <N>\n"
-"    Choose the seed used by the treap RNG.\n"
+"    Choose the seed used by the treap RNG, and by the skiplist ones.\n"
 "    Default: 1\n"
 "\n"
+"--allocator <malloc|pool>\n"
+"    Node allocator used by avl and the treaps.\n"
+"    malloc allocates each node with operator new;\n"
+"    pool carves the nodes out of per-tree slabs,\n"
+"    recycles erased nodes and frees the whole tree at once.\n"
+"    Default: malloc\n"
+"\n"
+"--key-type <int|uint64>\n"
+"    Key type of avl and treap-mersenne/treap-xorshift.\n"
+"    Default: int\n"
+"\n"
+"--payload <0|64>\n"
+"    Bytes of value carried by each key of avl and treap-mersenne/treap-xorshift.\n"
+"    With 64, they are maps from the key to a 64-byte record.\n"
+"    Default: 0\n"
+"\n"
+"--treap-engine <rotation|split-merge>\n"
+"    Algorithms used by treap-mersenne and treap-xorshift.\n"
+"    rotation inserts at a leaf and rotates the node up,\n"
+"    and rotates erased nodes down to a leaf;\n"
+"    split-merge splits the subtree where the new node belongs,\n"
+"    and merges the children of erased nodes.\n"
+"    Default: rotation\n"
+"\n"
 "--total-insertions <N>\n"
 "    Total number of insertions that will be done in the tree.\n"
 "    Default: 1 000 000\n"
@@ -50,26 +212,179 @@ namespace command_line {
 "    Total number of keys that will be removed from the tree.\n"
 "    Default: 500 000\n"
 "\n"
+"--scans <N>\n"
+"    Number of range scans of scan-workload.\n"
+"    Default: 10 000\n"
+"\n"
+"--scan-length <N>\n"
+"    Number of keys visited by each range scan of scan-workload.\n"
+"    Default: 1 000\n"
+"\n"
+"--zipf-theta <T>\n"
+"    Skew of zipf-search and sliding-window; 0 is uniform.\n"
+"    Default: 0.99\n"
+"\n"
+"--hot-fraction <F>\n"
+"    Fraction of the keys which are hot in hot-set-search.\n"
+"    Default: 0.1\n"
+"\n"
+"--hot-probability <P>\n"
+"    Probability that a successful search of hot-set-search\n"
+"    looks for a hot key.\n"
+"    Default: 0.9\n"
+"\n"
+"--window <N>\n"
+"    Number of keys in the tree in sliding-window.\n"
+"    Default: 100 000\n"
+"\n"
+"--batch-size <N>\n"
+"    Number of keys in the batch of the set-ops test case.\n"
+"    The tree has --total-insertions keys.\n"
+"    Default: 250 000\n"
+"\n"
+"--threads <N>\n"
+"    Maximum number of threads used by set-ops and --read-ratio.\n"
+"    Default: number of hardware threads\n"
+"\n"
+"--generation-threads <N>\n"
+"    Number of threads generating the test case; the test case\n"
+"    does not depend on it, only on the seed.\n"
+"    Default: number of hardware threads\n"
+"\n"
+"--read-ratio <R>\n"
+"    Instead of the test case, run the concurrent driver:\n"
+"    the tree is filled with --total-insertions keys, and then shared by\n"
+"    1, 2, 4, ... threads, up to --threads, each doing --concurrent-ops\n"
+"    operations: counts with probability R, inserts and erases otherwise.\n"
+"    Shows the throughput for each number of threads.\n"
+"    Only for treap-concurrent and skiplist, and for avl, rb and treap-xorshift,\n"
+"    which are wrapped in a mutex.\n"
+"\n"
+"--replicas <N>\n"
+"    Run N independent copies of the tree and of the test case at once,\n"
+"    on N threads pinned to distinct hardware threads, after a single copy.\n"
+"    Shows the throughput of each replica, their aggregate throughput,\n"
+"    and their efficiency: the aggregate over N times the single copy's\n"
+"    (1.00 means no contention for the allocator and the memory bandwidth).\n"
+"\n"
+"--shards <N>\n"
+"    Run the test case on N trees, each owning a range of the keys\n"
+"    and updated by its own thread; the operations are routed to them\n"
+"    in batches, and the ranges follow the load when it is skewed.\n"
+"    Shows the throughput, and how evenly the load was spread.\n"
+"    Only for avl, treap-mersenne and treap-xorshift, and for the test cases\n"
+"    made of insertions, removals and searches.\n"
+"\n"
+"--concurrent-ops <N>\n"
+"    Number of operations of each thread with --read-ratio.\n"
+"    Default: 1 000 000\n"
+"\n"
 "--help\n"
 "    Display this text and exit.\n"
 ;
 } // namespace command_line
 
+#include <chrono>
 #include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <optional>
 #include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "cmdline/args.hpp"
 
 #include "avl.hpp"
+#include "compact_avl.hpp"
+#include "compact_treap.hpp"
+#include "concurrent_treap.hpp"
+#include "fast_rng.hpp"
+#include "frozen.hpp"
+#include "memory_usage.hpp"
+#include "node_allocator.hpp"
+#include "persistent_treap.hpp"
+#include "skiplist.hpp"
 #include "speed_test.hpp"
+#include "streaming.hpp"
+#include "test_case_file.hpp"
 #include "treap.hpp"
+#include "workload.hpp"
 #include "xorshift.hpp"
 
+#ifdef __GLIBC__
+/* The global allocation functions report to memory_usage (see --memory)
+ * the heap taken by every block: its size, as malloc_usable_size tells,
+ * and the word of the malloc header in front of it.
+ * malloc_usable_size is only called while memory_usage is counting,
+ * so the runs without --memory only pay a relaxed load.
+ * The sized deletes are not needed, and not every caller uses them.
+ * Only replaced where malloc_usable_size exists.
+ */
+std::size_t heap_bytes( void * p ) {
+    return malloc_usable_size( p ) + sizeof(std::size_t);
+}
+
+void * operator new( std::size_t size ) {
+    void * p = std::malloc( size ? size : 1 );
+    if( !p )
+        throw std::bad_alloc();
+    if( memory_usage::counting() )
+        memory_usage::allocated( heap_bytes(p) );
+    return p;
+}
+
+void * operator new[]( std::size_t size ) {
+    return operator new( size );
+}
+
+void operator delete( void * p ) noexcept {
+    if( !p )
+        return;
+    if( memory_usage::counting() )
+        memory_usage::freed( heap_bytes(p) );
+    std::free( p );
+}
+
+void operator delete[]( void * p ) noexcept {
+    operator delete( p );
+}
+
+void operator delete( void * p, std::size_t ) noexcept {
+    operator delete( p );
+}
+
+void operator delete[]( void * p, std::size_t ) noexcept {
+    operator delete( p );
+}
+#endif
+
 namespace command_line {
-    int (* run_test_case)( const test_case & );
+    int (* run_test_case)( test_view );
     test_case (* make_test_case)();
+    // Generator of the test case, for --stream.
+    std::unique_ptr<streaming::generator> (* make_stream)() = nullptr;
+    bool stream = false;
+    int chunk_size = 1 << 16;
+    // Only available for treaps; threads == 0 runs the per-key loops.
+    set_ops_times (* run_set_ops)( const set_ops_case &, unsigned threads ) = nullptr;
+    // Runs the concurrent driver; only for the structures that can be shared.
+    int (* run_concurrent)( const std::vector<test_case> &, unsigned threads ) = nullptr;
+    // Runs the test case on a sharded tree; only for avl and the treaps.
+    int (* run_sharded)( test_view, std::size_t shards, sharding_stats * ) = nullptr;
+    int shards = 0; // Zero when sharding was not asked for.
+    unsigned replicas = 0; // Likewise for replicas.
+    double read_ratio = -1; // Negative when the driver was not asked for.
+    int concurrent_ops = 1'000'000;
+    bool set_ops = false;
     int runs = 10;
     unsigned seed = 0;
     unsigned treap_seed = 1; // xorshift's seed must not be zero.
@@ -78,46 +393,299 @@ namespace command_line {
     int search_successes = 800'000;
     int search_failures = 400'000;
     int removals = 500'000;
+    int batch_size = 250'000;
+    int scans = 10'000;
+    int snapshot_every = 1'000;
+    int snapshots_kept = 4;
+    bool persistent = false;
+    int scan_length = 1'000;
+    double zipf_theta = 0.99;
+    double hot_fraction = 0.1;
+    double hot_probability = 0.9;
+    int window = 100'000;
+    std::string workload_path;
+    unsigned threads = std::max( 1u, std::thread::hardware_concurrency() );
+    unsigned generation_threads = threads;
     bool show = false;
+    std::string save_path, load_path, import_path;
+    bool order_stats = false;
+    bool rank_queries = false;
+    bool has_rank = false; // Whether the data structure supports rank queries.
+    bool scan_workload = false;
+    bool has_range_scan = false; // Likewise for range scans.
+    bool keeps_removed = false; // Whether erased keys are only freed with the data structure.
+    bool freezes = false; // Whether the data structure is rebuilt at the first search after an update.
+    run_options options;
+    bool batch_lookups = false;
+    bool latencies = false;
+    bool perf_counters = false;
+    bool memory = false;
+    std::string allocator = "malloc";
+    std::string treap_engine = "rotation";
+    std::string key_type = "int";
+    int payload_bytes = 0;
+
+    /* Calls f with a default-constructed object
+     * of the allocator policy chosen in the command line.
+     */
+    template< typename F >
+    auto with_allocator( F f ) {
+        if( allocator == "pool" )
+            return f( pool_allocator{} );
+        return f( malloc_allocator{} );
+    }
+
+    /* Calls f with a default-constructed object
+     * of the order-statistics policy chosen in the command line.
+     */
+    template< typename F >
+    auto with_statistics( F f ) {
+        if( order_stats )
+            return f( order_statistics{} );
+        return f( no_order_statistics{} );
+    }
+
+    /* Calls f with a default-constructed node_variant (see speed_test.hpp)
+     * with the key type and payload chosen in the command line.
+     */
+    template< typename F >
+    auto with_node_variant( F f ) {
+        if( key_type == "uint64" ) {
+            if( payload_bytes > 0 )
+                return f( node_variant<std::uint64_t, payload>{} );
+            return f( node_variant<std::uint64_t, void>{} );
+        }
+        if( payload_bytes > 0 )
+            return f( node_variant<int, payload>{} );
+        return f( node_variant<int, void>{} );
+    }
+
+    /* Calls f with a functor that builds a treap using the given RNG,
+     * keys and values of the given node_variant,
+     * and the allocator, engine and order statistics chosen in the command line.
+     */
+    template< typename RNG, typename Variant, typename F >
+    auto with_treap_maker( F f ) {
+        using key = typename Variant::key_type;
+        using value = typename Variant::mapped_type;
+        return with_allocator( [&]( auto alloc ){
+            return with_statistics( [&]( auto stats ){
+                auto with_engine = [&]( auto engine ){
+                    return f( [](){
+                        return treap::treap<key, value, RNG, std::less<key>,
+                            decltype(alloc), decltype(engine), decltype(stats)>{
+                                RNG{treap_seed} };
+                    });
+                };
+                if( treap_engine == "split-merge" )
+                    return with_engine( treap::split_merge_engine{} );
+                return with_engine( treap::rotation_engine{} );
+            });
+        });
+    }
+
+    /* Runs the concurrent driver with the trees made by 'maker',
+     * wrapped in a mutex.
+     */
+    template< typename TreeMaker >
+    int run_locked( TreeMaker maker, const std::vector<test_case> & lists, unsigned threads ) {
+        return ::run_concurrent( [&](){ return locked<decltype(maker())>( maker() ); },
+                total_insertions, lists, threads );
+    }
+
+    concurrent_treap::treap<int, xorshift> make_concurrent_treap() {
+        return concurrent_treap::treap<int, xorshift>{ xorshift{treap_seed} };
+    }
+
+    skiplist::skiplist<int, xorshift> make_skiplist() {
+        return skiplist::skiplist<int, xorshift>{ treap_seed };
+    }
+
+    template< typename RNG >
+    int run_treap( test_view c ) {
+        return with_node_variant( [&]( auto variant ){
+            return with_treap_maker<RNG, decltype(variant)>( [&]( auto maker ){
+                return ::run_test_case( maker, c, options );
+            });
+        });
+    }
+
+    template< typename RNG >
+    int run_sharded_treap( test_view c, std::size_t shards, sharding_stats * stats ) {
+        return with_treap_maker<RNG, node_variant<int, void>>( [&]( auto maker ){
+            return ::run_sharded( maker, c, shards, stats );
+        });
+    }
+
+    template< typename RNG >
+    set_ops_times run_treap_set_ops( const set_ops_case & c, unsigned threads ) {
+        return with_node_variant( [&]( auto variant ){
+            return with_treap_maker<RNG, decltype(variant)>( [&]( auto maker ){
+                return threads == 0 ? ::run_set_ops_baseline( maker, c )
+                                    : ::run_set_ops( maker, c, threads );
+            });
+        });
+    }
+
+    // Runs the test cases on treaps drawing their priorities from RNG.
+    template< typename RNG >
+    void use_treap() {
+        run_test_case = run_treap<RNG>;
+        run_set_ops = run_treap_set_ops<RNG>;
+        run_sharded = run_sharded_treap<RNG>;
+        run_concurrent = []( const std::vector<test_case> & lists, unsigned threads ){
+            return run_locked( [](){
+                return treap::treap<int, void, RNG>{ RNG{treap_seed} };
+            }, lists, threads );
+        };
+        has_rank = true;
+        has_range_scan = true;
+    }
 
     void parse( cmdline::args && args ) {
         while( args.size() > 0 ) {
             std::string arg = args.next();
             if( arg == "avl" ) {
-                run_test_case = []( const test_case & c ){
-                    return ::run_test_case([](){ return avl::avl(); }, c );
+                run_test_case = []( test_view c ){
+                    return with_allocator( [&]( auto alloc ){
+                        return with_statistics( [&]( auto stats ){
+                            return with_node_variant( [&]( auto variant ){
+                                using key = typename decltype(variant)::key_type;
+                                using value = typename decltype(variant)::mapped_type;
+                                return ::run_test_case( [](){
+                                    return avl::avl<key, value, std::less<key>,
+                                        decltype(alloc), decltype(stats)>();
+                                }, c, options );
+                            });
+                        });
+                    });
+                };
+                run_concurrent = []( const std::vector<test_case> & lists, unsigned threads ){
+                    return run_locked( [](){ return avl::avl<>(); }, lists, threads );
+                };
+                run_sharded = []( test_view c, std::size_t shards, sharding_stats * stats ){
+                    return with_allocator( [&]( auto alloc ){
+                        return ::run_sharded( [](){
+                            return avl::avl<int, void, std::less<int>, decltype(alloc)>();
+                        }, c, shards, stats );
+                    });
+                };
+                has_rank = true;
+                has_range_scan = true;
+                continue;
+            }
+            if( arg == "avl-compact" ) {
+                run_test_case = []( test_view c ){
+                    return ::run_test_case([](){ return compact_avl::avl(); }, c, options );
                 };
                 continue;
             }
             if( arg == "rb" ) {
-                run_test_case = []( const test_case & c ){
-                    return ::run_test_case([](){ return std::set<int>(); }, c );
+                run_test_case = []( test_view c ){
+                    return ::run_test_case([](){ return std::set<int>(); }, c, options );
                 };
+                run_concurrent = []( const std::vector<test_case> & lists, unsigned threads ){
+                    return run_locked( [](){ return std::set<int>(); }, lists, threads );
+                };
+                has_range_scan = true;
                 continue;
             }
             if( arg == "treap" || arg == "treap-mersenne" ) {
-                run_test_case = []( const test_case & c ){
-                    auto maker = [](){
-                        return treap::treap<std::mt19937>{std::mt19937{treap_seed}};
-                    };
-                    return ::run_test_case( maker, c );
-                };
+                run_test_case = run_treap<std::mt19937>;
+                run_set_ops = run_treap_set_ops<std::mt19937>;
+                run_sharded = run_sharded_treap<std::mt19937>;
+                has_rank = true;
+                has_range_scan = true;
                 continue;
             }
             if( arg == "treap-xorshift" ) {
-                run_test_case = []( const test_case & c ){
+                use_treap<xorshift>();
+                continue;
+            }
+            if( arg == "treap-xoshiro" ) {
+                use_treap<fast_rng::xoshiro256ss>();
+                continue;
+            }
+            if( arg == "treap-pcg" ) {
+                use_treap<fast_rng::pcg32>();
+                continue;
+            }
+            if( arg == "treap-wyrand" ) {
+                use_treap<fast_rng::wyrand>();
+                continue;
+            }
+            if( arg == "treap-simd" ) {
+                use_treap<fast_rng::simd_xorshift>();
+                continue;
+            }
+            if( arg == "treap-compact" ) {
+                run_test_case = []( test_view c ){
                     auto maker = [](){
-                        return treap::treap<xorshift>{xorshift{treap_seed}};
+                        return compact_treap::treap<xorshift>{xorshift{treap_seed}};
                     };
-                    return ::run_test_case( maker, c );
+                    return ::run_test_case( maker, c, options );
                 };
                 continue;
             }
 
+            if( arg == "treap-concurrent" ) {
+                run_test_case = []( test_view c ){
+                    return ::run_test_case( make_concurrent_treap, c, options );
+                };
+                run_concurrent = []( const std::vector<test_case> & lists, unsigned threads ){
+                    return ::run_concurrent( make_concurrent_treap, total_insertions,
+                            lists, threads );
+                };
+                continue;
+            }
+            if( arg == "skiplist" ) {
+                run_test_case = []( test_view c ){
+                    return ::run_test_case( make_skiplist, c, options );
+                };
+                run_concurrent = []( const std::vector<test_case> & lists, unsigned threads ){
+                    return ::run_concurrent( make_skiplist, total_insertions, lists, threads );
+                };
+                keeps_removed = true;
+                continue;
+            }
+            if( arg == "treap-persistent" ) {
+                persistent = true;
+                continue;
+            }
+
+            if( arg == "frozen-avl" ) {
+                run_test_case = []( test_view c ){
+                    return with_allocator( [&]( auto alloc ){
+                        return ::run_test_case( [](){
+                            return frozen::freezing( avl::avl<int, void,
+                                    std::less<int>, decltype(alloc)>() );
+                        }, c, options );
+                    });
+                };
+                freezes = true;
+                continue;
+            }
+            if( arg == "frozen-treap" ) {
+                run_test_case = []( test_view c ){
+                    return with_treap_maker<xorshift, node_variant<int, void>>(
+                            [&]( auto maker ){
+                        return ::run_test_case( [maker](){
+                            return frozen::freezing( maker() );
+                        }, c, options );
+                    });
+                };
+                freezes = true;
+                continue;
+            }
+
             if( arg == "insert-then-search" ) {
                 make_test_case = [](){
                     return insert_then_search( total_insertions, search_successes,
-                                                search_failures, seed );
+                                                search_failures, seed, generation_threads );
+                };
+                make_stream = []() -> std::unique_ptr<streaming::generator> {
+                    return std::make_unique<streaming::insert_then_search>(
+                            total_insertions, search_successes, search_failures, seed );
                 };
                 continue;
             }
@@ -125,29 +693,201 @@ namespace command_line {
                 make_test_case = [](){
                     return ascending_insert_then_search(
                             total_insertions, search_successes,
-                            search_failures, seed );
+                            search_failures, seed, generation_threads );
+                };
+                make_stream = []() -> std::unique_ptr<streaming::generator> {
+                    return std::make_unique<streaming::insert_then_search>(
+                            total_insertions, search_successes, search_failures, seed, true );
+                };
+                continue;
+            }
+            if( arg == "bulk-load-then-search" ) {
+                make_test_case = [](){
+                    return bulk_load_then_search(
+                            total_insertions, search_successes,
+                            search_failures, seed, generation_threads );
                 };
                 continue;
             }
             if( arg == "insert-then-remove-then-search" ) {
                 make_test_case = [](){
-                    return insert_then_remove_then_search( total_insertions,
-                            removals, search_successes, search_failures, seed );
+                    return insert_then_remove_then_search( total_insertions, removals,
+                            search_successes, search_failures, seed, generation_threads );
                 };
+                make_stream = []() -> std::unique_ptr<streaming::generator> {
+                    return std::make_unique<streaming::insert_then_remove_then_search>(
+                            total_insertions, removals, search_successes, search_failures, seed );
+                };
+                continue;
+            }
+            if( arg == "set-ops" ) {
+                set_ops = true;
                 continue;
             }
             if( arg == "mixed-workload" ) {
                 make_test_case = [](){
-                    return mixed_workload( initial_insertions, total_insertions,
-                            removals, search_successes, search_failures, seed );
+                    return mixed_workload( initial_insertions, total_insertions, removals,
+                            search_successes, search_failures, seed, generation_threads );
+                };
+                make_stream = []() -> std::unique_ptr<streaming::generator> {
+                    return std::make_unique<streaming::mixed_workload>( initial_insertions,
+                            total_insertions, removals, search_successes, search_failures, seed );
                 };
                 continue;
             }
 
+            if( arg == "rank-queries" ) {
+                make_test_case = [](){
+                    return ::rank_queries( total_insertions,
+                            search_successes + search_failures, seed, generation_threads );
+                };
+                make_stream = []() -> std::unique_ptr<streaming::generator> {
+                    return std::make_unique<streaming::rank_queries>( total_insertions,
+                            search_successes + search_failures, seed );
+                };
+                rank_queries = true;
+                order_stats = true;
+                continue;
+            }
+
+            if( arg == "scan-workload" ) {
+                make_test_case = [](){
+                    return ::scan_workload( total_insertions, scans, scan_length, seed,
+                            generation_threads );
+                };
+                make_stream = []() -> std::unique_ptr<streaming::generator> {
+                    return std::make_unique<streaming::scan_workload>(
+                            total_insertions, scans, scan_length, seed );
+                };
+                scan_workload = true;
+                continue;
+            }
+
             if( arg == "--show" ) {
                 show = true;
                 continue;
             }
+            if( arg == "zipf-search" ) {
+                make_test_case = [](){
+                    return workload::generate( workload::zipf_search( total_insertions,
+                            search_successes, search_failures, zipf_theta ),
+                            seed, generation_threads );
+                };
+                continue;
+            }
+            if( arg == "hot-set-search" ) {
+                make_test_case = [](){
+                    return workload::generate( workload::hot_set_search( total_insertions,
+                            search_successes, search_failures, hot_fraction, hot_probability ),
+                            seed, generation_threads );
+                };
+                continue;
+            }
+            if( arg == "sliding-window" ) {
+                make_test_case = [](){
+                    int steps = std::max( total_insertions - window, 1 );
+                    int lookups = ((long long) search_successes + search_failures) / steps;
+                    return workload::generate( workload::sliding_window( total_insertions,
+                            window, lookups, zipf_theta ), seed, generation_threads );
+                };
+                continue;
+            }
+            if( arg == "--workload" ) {
+                args >> workload_path;
+                make_test_case = [](){
+                    std::ifstream in( workload_path );
+                    if( !in )
+                        throw std::runtime_error( "cannot open " + workload_path );
+                    try {
+                        return workload::generate( workload::parse(in, total_insertions),
+                                seed, generation_threads );
+                    }
+                    catch( const std::runtime_error & e ) {
+                        throw std::runtime_error( workload_path + ", " + e.what() );
+                    }
+                };
+                continue;
+            }
+            if( arg == "--zipf-theta" ) {
+                args >> zipf_theta;
+                if( zipf_theta < 0 ) {
+                    std::cerr << args.program_name() << ": The Zipf theta must not be negative\n";
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--hot-fraction" ) {
+                args >> hot_fraction;
+                if( hot_fraction <= 0 || hot_fraction > 1 ) {
+                    std::cerr << args.program_name() << ": The hot fraction must be in (0, 1]\n";
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--hot-probability" ) {
+                args >> hot_probability;
+                if( hot_probability < 0 || hot_probability > 1 ) {
+                    std::cerr << args.program_name() << ": The hot probability must be in [0, 1]\n";
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--window" ) {
+                args.range(1) >> window;
+                continue;
+            }
+            if( arg == "--stream" ) {
+                stream = true;
+                continue;
+            }
+            if( arg == "--chunk-size" ) {
+                args.range(1) >> chunk_size;
+                continue;
+            }
+            if( arg == "--save" ) {
+                args >> save_path;
+                continue;
+            }
+            if( arg == "--load" ) {
+                args >> load_path;
+                continue;
+            }
+            if( arg == "--import" ) {
+                args >> import_path;
+                continue;
+            }
+            if( arg == "--hinted" ) {
+                options.hinted_inserts = true;
+                continue;
+            }
+            if( arg == "--batch-lookups" ) {
+                batch_lookups = true;
+                continue;
+            }
+            if( arg == "--latencies" ) {
+                latencies = true;
+                continue;
+            }
+            if( arg == "--memory" ) {
+                memory = true;
+                continue;
+            }
+            if( arg == "--perf-counters" ) {
+                perf_counters = true;
+                continue;
+            }
+            if( arg == "--order-statistics" ) {
+                order_stats = true;
+                continue;
+            }
+            if( arg == "--snapshot-every" ) {
+                args.range(0) >> snapshot_every;
+                continue;
+            }
+            if( arg == "--snapshots-kept" ) {
+                args.range(0) >> snapshots_kept;
+                continue;
+            }
             if( arg == "--runs" ) {
                 args.range(1) >> runs;
                 continue;
@@ -160,6 +900,41 @@ namespace command_line {
                 args >> treap_seed;
                 continue;
             }
+            if( arg == "--allocator" ) {
+                args >> allocator;
+                if( allocator != "malloc" && allocator != "pool" ) {
+                    std::cerr << args.program_name() << ": Unknown allocator "
+                        << allocator << '\n';
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--treap-engine" ) {
+                args >> treap_engine;
+                if( treap_engine != "rotation" && treap_engine != "split-merge" ) {
+                    std::cerr << args.program_name() << ": Unknown treap engine "
+                        << treap_engine << '\n';
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--key-type" ) {
+                args >> key_type;
+                if( key_type != "int" && key_type != "uint64" ) {
+                    std::cerr << args.program_name() << ": Unknown key type "
+                        << key_type << '\n';
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--payload" ) {
+                args >> payload_bytes;
+                if( payload_bytes != 0 && payload_bytes != 64 ) {
+                    std::cerr << args.program_name() << ": Payload must be 0 or 64 bytes\n";
+                    std::exit(1);
+                }
+                continue;
+            }
             if( arg == "--total-insertions" ) {
                 args.range(1) >> total_insertions;
                 continue;
@@ -180,6 +955,51 @@ namespace command_line {
                 args.range(0) >> removals;
                 continue;
             }
+            if( arg == "--scans" ) {
+                args.range(0) >> scans;
+                continue;
+            }
+            if( arg == "--scan-length" ) {
+                args.range(1) >> scan_length;
+                if( scan_length > operation::max_width / 2 ) {
+                    std::cerr << args.program_name() << ": The scan length must be at most "
+                        << operation::max_width / 2 << '\n';
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--batch-size" ) {
+                args.range(0) >> batch_size;
+                continue;
+            }
+            if( arg == "--threads" ) {
+                args.range(1) >> threads;
+                continue;
+            }
+            if( arg == "--generation-threads" ) {
+                args.range(1) >> generation_threads;
+                continue;
+            }
+            if( arg == "--read-ratio" ) {
+                args >> read_ratio;
+                if( read_ratio < 0 || read_ratio > 1 ) {
+                    std::cerr << args.program_name() << ": The read ratio must be in [0, 1]\n";
+                    std::exit(1);
+                }
+                continue;
+            }
+            if( arg == "--replicas" ) {
+                args.range(1) >> replicas;
+                continue;
+            }
+            if( arg == "--shards" ) {
+                args.range(1) >> shards;
+                continue;
+            }
+            if( arg == "--concurrent-ops" ) {
+                args.range(1) >> concurrent_ops;
+                continue;
+            }
             if( arg == "--help" ) {
                 std::cout << args.program_name() << help_message;
                 std::exit(0);
@@ -191,12 +1011,478 @@ namespace command_line {
     }
 }
 
+/* Runs the set-ops test case:
+ * first the per-key loops, then the set operations
+ * with 1, 2, 4, ... threads, up to --threads.
+ */
+int run_set_ops() {
+    if( !command_line::run_set_ops ) {
+        std::cerr << "set-ops is only available for treap-mersenne and treap-xorshift\n";
+        return 1;
+    }
+    set_ops_case c = make_set_ops_case( command_line::total_insertions,
+            command_line::batch_size, command_line::seed );
+    std::cout << "Test case prepared.\n";
+
+    auto print = []( const set_ops_times & t, const set_ops_times & baseline ) {
+        auto speedup = []( int ms, int baseline_ms ) {
+            return (double) baseline_ms / std::max( ms, 1 );
+        };
+        std::cout << std::fixed << std::setprecision(2)
+            << " - Union: " << t.union_ms << "ms ("
+            << speedup(t.union_ms, baseline.union_ms) << "x)"
+            << " Intersection: " << t.intersection_ms << "ms ("
+            << speedup(t.intersection_ms, baseline.intersection_ms) << "x)"
+            << " Difference: " << t.difference_ms << "ms ("
+            << speedup(t.difference_ms, baseline.difference_ms) << "x)\n";
+    };
+
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        set_ops_times baseline = command_line::run_set_ops( c, 0 );
+        std::cout << "Run:" << std::setw(3) << i << " - Per-key loops";
+        print( baseline, baseline );
+        for( unsigned t = 1; ; t = std::min(2 * t, command_line::threads) ) {
+            std::cout << "Run:" << std::setw(3) << i << " - Threads:" << std::setw(3) << t;
+            print( command_line::run_set_ops( c, t ), baseline );
+            if( t == command_line::threads )
+                break;
+        }
+    }
+    return 0;
+}
+
+/* Runs the test case with scalar and with batched counts,
+ * showing the time of both and their lookup throughput.
+ */
+int run_batch_lookups( test_view c ) {
+    auto throughput = []( const lookup_stats & s ) {
+        double us = std::chrono::duration<double, std::micro>( s.time ).count();
+        return s.lookups / std::max( us, 1.0 ); // Millions per second.
+    };
+    run_options & options = command_line::options;
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        lookup_stats scalar, batched;
+        options.batched_counts = false;
+        options.stats = &scalar;
+        int scalar_ms = command_line::run_test_case(c);
+        options.batched_counts = true;
+        options.stats = &batched;
+        int batched_ms = command_line::run_test_case(c);
+        options.stats = nullptr;
+
+        std::cout << std::fixed << std::setprecision(2)
+            << "Run:" << std::setw(3) << i
+            << " - Scalar: " << scalar_ms << "ms, "
+            << throughput(scalar) << "M lookups/s"
+            << " - Batched: " << batched_ms << "ms, "
+            << throughput(batched) << "M lookups/s\n";
+    }
+    return 0;
+}
+
+/* Runs the concurrent driver with 1, 2, 4, ... threads, up to --threads,
+ * showing the throughput of each and its speedup over a single thread.
+ */
+int run_concurrent() {
+    if( !command_line::run_concurrent ) {
+        std::cerr << "--read-ratio is only available for treap-concurrent, skiplist, avl, rb and treap-xorshift\n";
+        return 1;
+    }
+    auto lists = concurrent_workload( command_line::total_insertions,
+            command_line::concurrent_ops, command_line::read_ratio,
+            command_line::threads, command_line::seed, command_line::generation_threads );
+    std::cout << "Test case prepared.\n";
+
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        double single = 0;
+        for( unsigned t = 1; ; t = std::min(2 * t, command_line::threads) ) {
+            int ms = command_line::run_concurrent( lists, t );
+            double throughput = (double) t * command_line::concurrent_ops / std::max( ms, 1 ) / 1000;
+            if( t == 1 )
+                single = throughput;
+            std::cout << std::fixed << std::setprecision(2)
+                << "Run:" << std::setw(3) << i << " - Threads:" << std::setw(3) << t
+                << " - Time: " << ms << "ms, " << throughput << "M ops/s ("
+                << throughput / single << "x)\n";
+            if( t == command_line::threads )
+                break;
+        }
+    }
+    return 0;
+}
+
+/* Runs the test case timing every operation,
+ * and shows the distribution of the latencies of each operation type.
+ */
+int run_latencies( test_view c ) {
+    const char * names[operation_types] = {
+        "Insert", "Erase", "Count", "Load", "Rank", "Scan"
+    };
+    auto show = []( std::uint64_t ns ) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2);
+        if( ns < 1000 )
+            out << ns << "ns";
+        else if( ns < 1000'000 )
+            out << ns / 1e3 << "us";
+        else
+            out << ns / 1e6 << "ms";
+        return out.str();
+    };
+
+    latency_stats stats;
+    command_line::options.latencies = &stats;
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        for( latency::histogram & h : stats.by_type )
+            h.clear();
+        std::cout << "Run:" << std::setw(3) << i << " - Time: "
+            << command_line::run_test_case(c) << "ms\n";
+        for( int t = 0; t < operation_types; t++ ) {
+            const latency::histogram & h = stats.by_type[t];
+            if( h.count() == 0 )
+                continue;
+            std::cout << "    " << std::left << std::setw(6) << names[t] << std::right
+                << " - " << h.count() << " ops"
+                << " - Mean: " << show( h.mean() )
+                << " - p50: " << show( h.percentile(50) )
+                << " - p99: " << show( h.percentile(99) )
+                << " - p99.9: " << show( h.percentile(99.9) )
+                << " - Max: " << show( h.max() ) << '\n';
+        }
+    }
+    command_line::options.latencies = nullptr;
+    return 0;
+}
+
+/* Runs the test case counting the heap memory,
+ * and shows the time per operation and the memory per key of each run.
+ */
+int run_memory( test_view c ) {
+    double keys = std::max<std::size_t>( peak_keys(c), 1 );
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        memory_usage::start();
+        int ms = command_line::run_test_case(c);
+        memory_usage::usage u = memory_usage::stop();
+        std::cout << std::fixed << std::setprecision(2)
+            << "Run:" << std::setw(3) << i << " - Time: " << ms << "ms, "
+            << ms * 1e6 / std::max<std::size_t>( c.size(), 1 ) << "ns/op"
+            << " - Peak: " << u.peak_bytes / (1024.0 * 1024) << "MiB, "
+            << u.peak_bytes / keys << " bytes/key"
+            << " - Allocations: " << u.allocations << '\n';
+    }
+    return 0;
+}
+
+/* Runs the test case counting hardware events,
+ * and shows them per operation for each run;
+ * or just the times, if the events cannot be counted.
+ */
+int run_perf_counters( test_view c ) {
+    perf_stats stats;
+    if( !stats.group.available() )
+        std::cout << "Hardware counters unavailable ("
+            << stats.group.why_unavailable() << "); timing only.\n";
+    else
+        command_line::options.counters = &stats;
+
+    auto show = [&]( const char * phase, const perf::readings & r ) {
+        std::cout << "    " << phase << " - Per operation:";
+        for( int e = 0; e < perf::event_count; e++ ) {
+            std::cout << (e == 0 ? " " : ", ");
+            if( stats.group.available(e) )
+                std::cout << r[e] / c.size();
+            else
+                std::cout << "n/a";
+            std::cout << ' ' << perf::event_name(e);
+        }
+        if( stats.group.available(perf::instructions) && r[perf::cycles] > 0 )
+            std::cout << " - IPC: " << r[perf::instructions] / r[perf::cycles];
+        std::cout << '\n';
+    };
+
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        std::cout << "Run:" << std::setw(3) << i << " - Time: "
+            << command_line::run_test_case(c) << "ms\n";
+        if( !command_line::options.counters )
+            continue;
+        std::cout << std::fixed << std::setprecision(2);
+        show( "Operations", stats.operations );
+        show( "Teardown  ", stats.teardown );
+    }
+    command_line::options.counters = nullptr;
+    return 0;
+}
+
+/* Runs the test case alone, and then with --replicas copies at once;
+ * shows the throughput of each replica, the aggregate throughput,
+ * and how it compares to the single copy's times the number of replicas.
+ */
+int run_replicas( test_view c ) {
+    unsigned n = command_line::replicas;
+    auto throughput = [&]( int ms ){
+        return (double) c.size() / std::max( ms, 1 ) / 1000; // Millions per second.
+    };
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        double single = throughput( command_line::run_test_case(c) );
+        replica_times t = ::run_replicas( command_line::run_test_case, c, n );
+        double aggregate = 0;
+        std::cout << std::fixed << std::setprecision(2)
+            << "Run:" << std::setw(3) << i << " - Single: " << single << "M ops/s"
+            << " - Replicas:";
+        for( int ms : t.ms ) {
+            std::cout << ' ' << throughput(ms);
+            aggregate += throughput(ms);
+        }
+        std::cout << "M ops/s - Aggregate: " << aggregate << "M ops/s"
+            << " - Efficiency: " << aggregate / (n * single)
+            << " - Wall: " << t.wall_ms << "ms\n";
+    }
+    return 0;
+}
+
+/* Runs the test case on a sharded tree,
+ * showing the throughput of each run, and the spread of its load:
+ * the busiest shard against the mean, in operations and in busy time.
+ * The load of each shard in the last run is shown at the end.
+ */
+int run_sharded( test_view c ) {
+    if( !command_line::run_sharded ) {
+        std::cerr << "--shards is only available for avl, treap-mersenne and treap-xorshift\n";
+        return 1;
+    }
+    if( command_line::rank_queries || command_line::scan_workload ) {
+        std::cerr << "--shards only runs insertions, removals and searches\n";
+        return 1;
+    }
+
+    sharding_stats stats;
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        int ms = command_line::run_sharded( c, command_line::shards, &stats );
+        long long max_ops = 0, total_ops = 0;
+        double max_busy = 0, total_busy = 0;
+        for( const auto & load : stats.loads ) {
+            double busy = std::chrono::duration<double>( load.busy ).count();
+            max_ops = std::max( max_ops, load.ops );
+            total_ops += load.ops;
+            max_busy = std::max( max_busy, busy );
+            total_busy += busy;
+        }
+        double shards = stats.loads.size();
+        std::cout << std::fixed << std::setprecision(2)
+            << "Run:" << std::setw(3) << i << " - Time: " << ms << "ms, "
+            << (double) c.size() / std::max( ms, 1 ) / 1000 << "M ops/s"
+            << " - Busiest shard: " << max_ops * shards / std::max( total_ops, 1LL )
+            << "x the mean operations, " << max_busy * shards / std::max( total_busy, 1e-9 )
+            << "x the mean busy time"
+            << " - Rebalances: " << stats.rebalances
+            << ", " << stats.moved_keys << " keys moved\n";
+    }
+    for( std::size_t s = 0; s < stats.loads.size(); s++ )
+        std::cout << "Shard:" << std::setw(3) << s << " - "
+            << stats.loads[s].ops << " operations, "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                    stats.loads[s].busy ).count() << "ms busy\n";
+    return 0;
+}
+
+/* Runs the test case with the mutable treap-xorshift
+ * and with treap-persistent, taking snapshots as asked,
+ * and shows the time of both;
+ * then shows the memory held by both at the end of the test case.
+ */
+int run_persistent( test_view c ) {
+    using command_line::snapshot_every;
+    using command_line::snapshots_kept;
+    using persistent = persistent_treap::treap<int, xorshift>;
+    auto maker = []( persistent_treap::snapshot_stats * stats ){
+        return [stats](){
+            return persistent_treap::snapshotting<persistent>(
+                    persistent{xorshift{command_line::treap_seed}},
+                    snapshot_every, snapshots_kept, stats );
+        };
+    };
+    auto run_mutable = [&](){
+        return command_line::with_treap_maker<xorshift, node_variant<int, void>>(
+                [&]( auto m ){ return ::run_test_case( m, c, command_line::options ); });
+    };
+
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        int mutable_ms = run_mutable();
+        int persistent_ms = ::run_test_case( maker(nullptr), c, command_line::options );
+        std::cout << std::fixed << std::setprecision(2)
+            << "Run:" << std::setw(3) << i
+            << " - Mutable: " << mutable_ms << "ms"
+            << " - Persistent: " << persistent_ms << "ms ("
+            << (double) persistent_ms / std::max( mutable_ms, 1 ) << "x)\n";
+    }
+
+    persistent_treap::snapshot_stats stats;
+    ::run_test_case( maker(&stats), c, command_line::options );
+    double mib = 1024 * 1024;
+    double mutable_bytes = stats.keys * sizeof(treap::node);
+    std::cout << std::fixed << std::setprecision(2)
+        << "Memory at the end: " << stats.keys << " keys"
+        << " - Mutable: " << mutable_bytes / mib << "MiB"
+        << " - Persistent: " << stats.node_bytes / mib << "MiB ("
+        << stats.node_bytes / std::max( mutable_bytes, 1.0 ) << "x), "
+        << stats.nodes << " nodes in the tree and the last "
+        << std::min<std::size_t>( stats.snapshots, snapshots_kept )
+        << " of " << stats.snapshots << " snapshots\n";
+    return 0;
+}
+
+/* Runs the test case, showing the time of each run
+ * and the bandwidth of its range scans.
+ */
+int run_scan_workload( test_view c ) {
+    run_options & options = command_line::options;
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        scan_stats stats;
+        options.scans = &stats;
+        int ms = command_line::run_test_case(c);
+        options.scans = nullptr;
+
+        double us = std::chrono::duration<double, std::micro>( stats.time ).count();
+        std::cout << std::fixed << std::setprecision(2)
+            << "Run:" << std::setw(3) << i << " - Time: " << ms << "ms"
+            << " - Scans: " << stats.keys / std::max( us, 1.0 ) << "M keys/s\n";
+    }
+    return 0;
+}
+
+/* Refuses the rank queries and the range scans of the test case
+ * if the data structure cannot run them.
+ */
+bool check_operations() {
+    if( command_line::rank_queries && !command_line::has_rank ) {
+        std::cerr << "Rank queries are only available for avl, treap-mersenne and treap-xorshift\n";
+        return false;
+    }
+    if( command_line::scan_workload && !command_line::has_range_scan ) {
+        std::cerr << "Range scans are only available for avl, rb, treap-mersenne and treap-xorshift\n";
+        return false;
+    }
+    return true;
+}
+
+/* Runs the test case generated during the runs, see --stream,
+ * showing how long the runs waited for the generator.
+ */
+int run_stream() {
+    if( !command_line::make_stream ) {
+        std::cerr << "--stream is not available for this test case\n";
+        return 1;
+    }
+    if( !command_line::run_test_case ) {
+        std::cerr << "No data structure given\n";
+        return 1;
+    }
+    if( command_line::freezes ) {
+        std::cerr << "--stream is not available for frozen-avl and frozen-treap,"
+            " whose test case is checked before it is run\n";
+        return 1;
+    }
+    if( command_line::show || !command_line::save_path.empty()
+            || !command_line::load_path.empty() || !command_line::import_path.empty()
+            || command_line::persistent || command_line::shards > 0
+            || command_line::replicas > 0 || command_line::perf_counters
+            || command_line::memory || command_line::latencies
+            || command_line::batch_lookups ) {
+        std::cerr << "--stream only shows the time of each run,"
+            " and cannot be used with the other options doing so\n";
+        return 1;
+    }
+    std::cout << "Test case streamed in chunks of "
+        << command_line::chunk_size << " operations.\n";
+
+    for( int i = 1; i <= command_line::runs; i++ ) {
+        auto generator = command_line::make_stream();
+        streaming::double_buffer buffer( *generator, command_line::chunk_size );
+        command_line::options.stream = &buffer;
+        int ms = command_line::run_test_case( test_view() );
+        command_line::options.stream = nullptr;
+
+        auto stalled = std::chrono::duration_cast<std::chrono::milliseconds>( buffer.stalled() );
+        std::cout << "Run:" << std::setw(3) << i << " - Time: " << ms << "ms"
+            << " - Operations: " << buffer.operations()
+            << " - Stalled: " << stalled.count() << "ms\n";
+    }
+    return 0;
+}
+
 int main( int argc, char ** argv ) {
     command_line::parse( cmdline::args(argc, argv) );
-    test_case c = command_line::make_test_case();
+    if( command_line::keeps_removed ) {
+        if( command_line::memory ) {
+            std::cerr << "--memory is not available for skiplist,"
+                " which frees its removed nodes only when it is destroyed\n";
+            return 1;
+        }
+        if( !command_line::show )
+            std::cout << "skiplist frees its removed nodes only when it is destroyed:"
+                " its memory grows with every erase.\n";
+    }
+    if( command_line::set_ops )
+        return run_set_ops();
+    if( command_line::read_ratio >= 0 )
+        return run_concurrent();
+
+    if( !check_operations() )
+        return 1;
+
+    if( command_line::stream )
+        return run_stream();
+
+    /* The test case is generated, imported from a text trace,
+     * or mapped from a saved file and run from there.
+     */
+    test_case generated;
+    std::optional<test_case_file::mapped> file;
+    test_view c;
+    try {
+        if( !command_line::load_path.empty() ) {
+            file.emplace( command_line::load_path );
+            c = file->view();
+        }
+        else if( !command_line::import_path.empty() ) {
+            std::ifstream in;
+            if( command_line::import_path != "-" ) {
+                in.open( command_line::import_path );
+                if( !in )
+                    throw std::runtime_error( "cannot open " + command_line::import_path );
+            }
+            generated = test_case_file::import_text(
+                    command_line::import_path == "-" ? std::cin : in );
+            c = generated;
+        }
+        else if( command_line::make_test_case ) {
+            generated = command_line::make_test_case();
+            c = generated;
+        }
+        else {
+            std::cerr << "No test case given\n";
+            return 1;
+        }
+
+        if( !command_line::save_path.empty() ) {
+            test_case_file::save( command_line::save_path, c );
+            std::cout << "Saved " << c.size() << " operations to "
+                << command_line::save_path << '\n';
+            return 0;
+        }
+    }
+    catch( const std::runtime_error & e ) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    // treap-persistent runs its own trees.
+    if( !command_line::run_test_case && !command_line::show && !command_line::persistent ) {
+        std::cerr << "No data structure given\n";
+        return 1;
+    }
 
     if( command_line::show ) {
-        for( operation & op : c ) {
+        for( const operation & op : c ) {
             switch( op.type ) {
                 case operation_type::insert:
                     std::cout << "Insert " << op.key << '\n';
@@ -207,12 +1493,66 @@ int main( int argc, char ** argv ) {
                 case operation_type::count:
                     std::cout << "Count  " << op.key << '\n';
                     break;
+                case operation_type::bulk_load:
+                    std::cout << "Load   " << op.key << '\n';
+                    break;
+                case operation_type::rank:
+                    std::cout << "Rank   " << op.key << '\n';
+                    break;
+                case operation_type::range_scan:
+                    std::cout << "Scan   " << op.key << ' ' << op.hi() << '\n';
+                    break;
             }
         }
         return 0;
     }
 
+    /* The operations of a trace, or of a --workload spec, are only known
+     * once it is read; the other trees would count its rank queries
+     * and range scans as 0.
+     */
+    if( file || !command_line::import_path.empty() || !command_line::workload_path.empty() ) {
+        if( contains(c, operation_type::rank) ) {
+            command_line::rank_queries = true;
+            command_line::order_stats = true;
+        }
+        if( contains(c, operation_type::range_scan) )
+            command_line::scan_workload = true;
+        if( !check_operations() )
+            return 1;
+    }
+
+    /* The frozen trees are rebuilt in O(n) at the first search after
+     * every update, which takes quadratic time if they are interleaved.
+     */
+    if( command_line::freezes && updates_after_searches(c) ) {
+        std::cerr << "frozen-avl and frozen-treap are only available for test cases"
+            " which build the tree and then only search it\n";
+        return 1;
+    }
+
     std::cout << "Test case prepared.\n";
+    if( command_line::persistent )
+        return run_persistent( c );
+    if( command_line::shards > 0 )
+        return run_sharded( c );
+    if( command_line::replicas > 0 )
+        return run_replicas( c );
+    if( command_line::perf_counters )
+        return run_perf_counters( c );
+    if( command_line::memory )
+        return run_memory( c );
+    if( command_line::latencies ) {
+        if( command_line::batch_lookups ) {
+            std::cerr << "--latencies and --batch-lookups cannot be used together\n";
+            return 1;
+        }
+        return run_latencies( c );
+    }
+    if( command_line::batch_lookups )
+        return run_batch_lookups( c );
+    if( command_line::scan_workload )
+        return run_scan_workload( c );
     for( int i = 1; i <= command_line::runs; i++ ) {
         std::cout << "Run:" << std::setw(3) << i << " - Time: "
             << command_line::run_test_case(c) << "ms\n";
@@ -0,0 +1,77 @@
+#ifndef MEMORY_USAGE_HPP
+#define MEMORY_USAGE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+/* Heap accounting: live bytes, peak live bytes and number of allocations
+ * between start and stop.
+ *
+ * Whatever allocates memory reports it with allocated and freed:
+ * main.cpp replaces the global operator new and delete to do so,
+ * and the allocators that bypass them (as slab_pool, which calls
+ * std::aligned_alloc) report their blocks themselves.
+ * Outside start and stop, the reports cost a single relaxed load;
+ * callers that must work out the size of a block check counting first.
+ *
+ * Blocks allocated before start and freed before stop lower the live bytes,
+ * so these are relative to the start.
+ */
+namespace memory_usage {
+    struct usage {
+        long long live_bytes = 0;
+        long long peak_bytes = 0;
+        long long allocations = 0;
+    };
+
+    namespace detail {
+        inline std::atomic<bool> enabled{false};
+        inline std::atomic<long long> live{0};
+        inline std::atomic<long long> peak{0};
+        inline std::atomic<long long> allocations{0};
+    }
+
+    // Whether the reports are counted, that is, between start and stop.
+    inline bool counting() {
+        return detail::enabled.load( std::memory_order_relaxed );
+    }
+
+    inline void allocated( std::size_t bytes ) {
+        using namespace detail;
+        if( !enabled.load(std::memory_order_relaxed) )
+            return;
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+        long long now = live.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+        long long old = peak.load( std::memory_order_relaxed );
+        while( now > old && !peak.compare_exchange_weak(old, now, std::memory_order_relaxed) )
+            ;
+    }
+
+    inline void freed( std::size_t bytes ) {
+        using namespace detail;
+        if( enabled.load(std::memory_order_relaxed) )
+            live.fetch_sub( bytes, std::memory_order_relaxed );
+    }
+
+    // Zeroes the counters and starts counting.
+    inline void start() {
+        using namespace detail;
+        live = 0;
+        peak = 0;
+        allocations = 0;
+        enabled = true;
+    }
+
+    // Stops counting, and returns what was counted since start.
+    inline usage stop() {
+        using namespace detail;
+        enabled = false;
+        usage ret;
+        ret.live_bytes = live;
+        ret.peak_bytes = peak;
+        ret.allocations = allocations;
+        return ret;
+    }
+}
+
+#endif // MEMORY_USAGE_HPP
@@ -0,0 +1,307 @@
+#ifndef NODE_ALLOCATOR_HPP
+#define NODE_ALLOCATOR_HPP
+
+/* Allocator policies for the tree nodes.
+ *
+ * The trees own their nodes through std::unique_ptr,
+ * and a policy decides which deleter these unique_ptrs use
+ * and where the nodes come from. A policy P must provide
+ *
+ *  P::deleter<Node> - a stateless deleter, so the unique_ptrs stay one word long;
+ *  P::arena<Node>   - a per-tree object with the member functions
+ *      make(args...)  - constructs a node and returns it in a unique_ptr;
+ *      release(root)  - destroys the whole tree rooted at root;
+ *      adopt(other)   - takes over the nodes of another arena,
+ *                       so that they can be moved into this arena's trees;
+ *      begin_parallel_frees(), end_parallel_frees()
+ *                     - bracket code that may destroy nodes from several
+ *                       fork_join workers at once, as the set operations.
+ *
+ * malloc_allocator uses plain new/delete, which is what the trees always did.
+ * pool_allocator carves nodes out of big slabs owned by the tree,
+ * recycles erased nodes through a free list,
+ * and tears the whole tree down by freeing the slabs,
+ * without visiting a single node.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fork_join.hpp"
+#include "memory_usage.hpp"
+
+template< typename Node >
+class malloc_arena {
+public:
+    template< typename ... Args >
+    std::unique_ptr<Node> make( Args && ... args ) {
+        return std::make_unique<Node>( std::forward<Args>(args)... );
+    }
+
+    // Destroys every node, one by one.
+    void release( std::unique_ptr<Node> & root ) {
+        root.reset();
+    }
+
+    // Nothing to do; every node belongs to the global heap.
+    void adopt( malloc_arena & ) {}
+
+    // Nothing to do; the global heap takes frees from any thread.
+    void begin_parallel_frees() {}
+    void end_parallel_frees() {}
+};
+
+struct malloc_allocator {
+    template< typename Node >
+    using deleter = std::default_delete<Node>;
+
+    template< typename Node >
+    using arena = malloc_arena<Node>;
+};
+
+
+template< typename Node >
+struct pool_delete;
+
+/* Whether a tree of Node may be dropped without running the node destructors;
+ * nodes tell so with a static constexpr bool trivially_releasable member.
+ * Nodes without it are always destroyed.
+ */
+template< typename Node, typename = void >
+struct is_trivially_releasable : std::false_type {};
+
+template< typename Node >
+struct is_trivially_releasable<Node, std::enable_if_t<Node::trivially_releasable>> :
+    std::true_type
+{};
+
+/* Slab allocator for objects of type Node.
+ *
+ * Memory is requested in slabs of slab_size bytes, aligned to slab_size.
+ * Each slab begins with a header pointing back to the pool state,
+ * so that the (stateless) pool_delete can find the free list of a node
+ * by masking the node's address.
+ *
+ * Between begin_parallel_frees and end_parallel_frees,
+ * nodes may be given back from several fork_join workers at once:
+ * each worker puts them on a list of its own,
+ * and end_parallel_frees splices these lists into the free list.
+ * Otherwise the free list is a plain stack, and nothing may run concurrently.
+ * Allocations must never run concurrently with anything else.
+ */
+template< typename Node >
+class slab_pool {
+public:
+    using pointer = std::unique_ptr<Node, pool_delete<Node>>;
+    static constexpr std::size_t slab_size = std::size_t(1) << 16;
+
+private:
+    struct free_slot {
+        free_slot * next;
+    };
+
+    struct state;
+
+    struct slab_header {
+        state * owner;
+        slab_header * next;
+    };
+
+    // A cache line each, so that the workers do not share them.
+    struct alignas(64) worker_list {
+        free_slot * head = nullptr;
+    };
+
+    struct state {
+        slab_header * slabs = nullptr;
+        free_slot * free_list = nullptr;
+        char * bump = nullptr;
+        char * bump_end = nullptr;
+        bool parallel_frees = false;
+        std::vector<worker_list> worker_lists;
+    };
+
+    // Pushes the list starting at 'first' onto the free list.
+    static void splice( state & to, free_slot * first ) {
+        if( !first )
+            return;
+        free_slot * last = first;
+        while( last->next )
+            last = last->next;
+        last->next = to.free_list;
+        to.free_list = first;
+    }
+
+    static constexpr std::size_t round_up( std::size_t n, std::size_t alignment ) {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr std::size_t slot_alignment =
+        alignof(Node) > alignof(free_slot) ? alignof(Node) : alignof(free_slot);
+    static constexpr std::size_t slot_size = round_up(
+            sizeof(Node) > sizeof(free_slot) ? sizeof(Node) : sizeof(free_slot),
+            slot_alignment );
+    static constexpr std::size_t first_slot = round_up( sizeof(slab_header), slot_alignment );
+
+    static_assert( first_slot + slot_size <= slab_size, "Node too big for the slab" );
+
+    /* The state lives in the heap so that moving the pool
+     * does not invalidate the back pointers stored in the slabs.
+     */
+    std::unique_ptr<state> s = std::make_unique<state>();
+
+    void new_slab() {
+        void * memory = std::aligned_alloc( slab_size, slab_size );
+        if( !memory )
+            throw std::bad_alloc();
+        memory_usage::allocated( slab_size );
+        auto header = static_cast<slab_header *>(memory);
+        header->owner = s.get();
+        header->next = s->slabs;
+        s->slabs = header;
+        s->bump = static_cast<char *>(memory) + first_slot;
+        s->bump_end = static_cast<char *>(memory) + slab_size;
+    }
+
+public:
+    slab_pool() = default;
+    slab_pool( slab_pool && ) = default;
+    slab_pool & operator=( slab_pool && other ) {
+        release_all();
+        s = std::move(other.s);
+        return *this;
+    }
+
+    /* The nodes still alive are not destroyed;
+     * their memory is simply given back to the system.
+     */
+    ~slab_pool() {
+        release_all();
+    }
+
+    // Returns uninitialized memory for one node.
+    void * allocate() {
+        if( free_slot * slot = s->free_list ) {
+            s->free_list = slot->next;
+            return slot;
+        }
+        if( s->bump + slot_size > s->bump_end )
+            new_slab();
+        void * ret = s->bump;
+        s->bump += slot_size;
+        return ret;
+    }
+
+    /* Gives the memory of an already destroyed node back to its pool.
+     * The pool is found through the header of the slab containing ptr.
+     */
+    static void deallocate( void * ptr ) {
+        auto address = reinterpret_cast<std::uintptr_t>(ptr);
+        auto header = reinterpret_cast<slab_header *>(address & ~(slab_size - 1));
+        auto slot = static_cast<free_slot *>(ptr);
+        state & owner = *header->owner;
+        free_slot * & list = owner.parallel_frees
+            ? owner.worker_lists[fork_join::pool::current_index()].head
+            : owner.free_list;
+        slot->next = list;
+        list = slot;
+    }
+
+    /* Lets the workers of the calling thread's fork_join pool
+     * give nodes back at once, until end_parallel_frees.
+     */
+    void begin_parallel_frees() {
+        s->worker_lists.assign( fork_join::pool::current_size(), worker_list{} );
+        s->parallel_frees = true;
+    }
+
+    // Moves the nodes freed by the workers to the free list.
+    void end_parallel_frees() {
+        s->parallel_frees = false;
+        for( worker_list & w : s->worker_lists )
+            splice( *s, w.head );
+        s->worker_lists.clear();
+    }
+
+    // Frees every slab at once. Every node in this pool becomes invalid.
+    void release_all() {
+        if( !s ) return;
+        while( s->slabs ) {
+            slab_header * next = s->slabs->next;
+            std::free( s->slabs );
+            memory_usage::freed( slab_size );
+            s->slabs = next;
+        }
+        s->free_list = nullptr;
+        s->bump = s->bump_end = nullptr;
+    }
+
+    /* Takes over every slab of 'other', which is left empty,
+     * so that nodes can be moved from other's trees to ours.
+     */
+    void adopt( slab_pool & other ) {
+        if( !other.s || other.s == s )
+            return;
+        while( slab_header * slab = other.s->slabs ) {
+            other.s->slabs = slab->next;
+            slab->owner = s.get();
+            slab->next = s->slabs;
+            s->slabs = slab;
+        }
+        splice( *s, other.s->free_list );
+        other.s->free_list = nullptr;
+        /* The unused tail of other's current slab is lost;
+         * it is at most one slab.
+         */
+        other.s->bump = other.s->bump_end = nullptr;
+    }
+
+    template< typename ... Args >
+    pointer make( Args && ... args ) {
+        void * memory = allocate();
+        try {
+            return pointer( new (memory) Node( std::forward<Args>(args)... ) );
+        }
+        catch( ... ) {
+            deallocate( memory );
+            throw;
+        }
+    }
+
+    /* Drops the whole tree rooted at root.
+     * If the nodes hold nothing that needs destruction
+     * besides the unique_ptrs to other nodes of this pool,
+     * (see is_trivially_releasable), the nodes are not even visited.
+     */
+    void release( pointer & root ) {
+        if( is_trivially_releasable<Node>::value )
+            root.release();
+        else
+            root.reset();
+        release_all();
+    }
+};
+
+template< typename Node >
+struct pool_delete {
+    void operator()( Node * ptr ) const {
+        ptr->~Node();
+        slab_pool<Node>::deallocate( ptr );
+    }
+};
+
+struct pool_allocator {
+    template< typename Node >
+    using deleter = pool_delete<Node>;
+
+    template< typename Node >
+    using arena = slab_pool<Node>;
+};
+
+#endif // NODE_ALLOCATOR_HPP
@@ -0,0 +1,50 @@
+#ifndef NODE_DATA_HPP
+#define NODE_DATA_HPP
+
+#include <type_traits>
+#include <utility>
+
+/* What a tree node holds besides its links and balancing information:
+ * the key and, for maps, the value.
+ * The tree nodes derive from node_data<Key, Value>.
+ *
+ * Set nodes (Value = void) hold only the key,
+ * so a set of int has exactly the nodes it had before the trees were generic.
+ * Values are constructed in place and never copied nor moved by the trees,
+ * so they may be move-only, or even immovable.
+ */
+template< typename Key, typename Value >
+struct node_data {
+    using key_type = Key;
+    using mapped_type = Value;
+
+    /* Whether the whole tree may be dropped without running
+     * any destructor other than the child pointers' (see slab_pool::release).
+     */
+    static constexpr bool trivially_releasable =
+        std::is_trivially_destructible<Key>::value &&
+        std::is_trivially_destructible<Value>::value;
+
+    Key key;
+    Value value;
+
+    template< typename ... Args >
+    explicit node_data( const Key & key, Args && ... args ) :
+        key(key), value( std::forward<Args>(args)... )
+    {}
+};
+
+template< typename Key >
+struct node_data<Key, void> {
+    using key_type = Key;
+    using mapped_type = void;
+
+    static constexpr bool trivially_releasable =
+        std::is_trivially_destructible<Key>::value;
+
+    Key key;
+
+    explicit node_data( const Key & key ) : key(key) {}
+};
+
+#endif // NODE_DATA_HPP
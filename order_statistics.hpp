@@ -0,0 +1,148 @@
+#ifndef ORDER_STATISTICS_HPP
+#define ORDER_STATISTICS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+/* Order-statistics policies for the trees of avl.hpp and treap.hpp.
+ *
+ * With order_statistics, every node also stores the size of its subtree,
+ * which answers "how many keys are below x" (rank)
+ * and "which is the k-th smallest key" (select) in O(log n).
+ * The sizes are kept current by every algorithm that reshapes the tree;
+ * they all call update_size after changing the children of a node.
+ * With no_order_statistics, the nodes have no size field,
+ * and update_size and its relatives compile to nothing.
+ *
+ * The tree nodes derive from subtree_size<Policy>.
+ */
+struct no_order_statistics {};
+struct order_statistics {};
+
+template< typename Policy >
+struct subtree_size;
+
+template<>
+struct subtree_size<no_order_statistics> {
+    static constexpr bool sized = false;
+};
+
+template<>
+struct subtree_size<order_statistics> {
+    static constexpr bool sized = true;
+    std::uint32_t size = 1; // Trees with order statistics hold less than 2**32 keys.
+};
+
+namespace order_stats {
+    // Whether the nodes pointed to by Pointer (smart or raw) have a size.
+    template< typename Pointer >
+    constexpr bool is_sized =
+        std::remove_reference_t<decltype(*std::declval<Pointer &>())>::sized;
+
+    // Number of nodes in the tree rooted at ptr; only for sized nodes.
+    template< typename Pointer >
+    std::size_t size( const Pointer & ptr ) {
+        return ptr ? ptr->size : 0;
+    }
+
+    /* Recomputes the size of *ptr from the sizes of its children.
+     * ptr is assumed to be non-null.
+     */
+    template< typename Pointer >
+    void update_size( const Pointer & ptr ) {
+        if constexpr( is_sized<Pointer> )
+            ptr->size = 1 + size(ptr->lchild) + size(ptr->rchild);
+    }
+
+    // Sets the size of *ptr, which is assumed to be non-null.
+    template< typename Pointer >
+    void set_size( const Pointer & ptr, std::size_t n ) {
+        if constexpr( is_sized<Pointer> )
+            ptr->size = n;
+    }
+
+    /* Adds delta to the sizes of *path[0], ..., *path[depth-1],
+     * the subtrees that just gained or lost a key below them.
+     */
+    template< typename Pointer >
+    void adjust_sizes( Pointer * const * path, int depth, int delta ) {
+        if constexpr( is_sized<Pointer> )
+            for( int i = 0; i < depth; i++ )
+                (*path[i])->size += delta;
+    }
+
+    /* Adds delta to the sizes of the subtrees on the path from the root
+     * to the node with the given key, which must be in the tree,
+     * excluding that node.
+     */
+    template< typename Pointer, typename Key, typename Compare >
+    void adjust_sizes_above( Pointer & tree, const Key & key, const Compare & comp, int delta ) {
+        if constexpr( is_sized<Pointer> ) {
+            auto n = tree.get();
+            while( comp(key, n->key) || comp(n->key, key) ) {
+                n->size += delta;
+                n = comp(key, n->key) ? n->lchild.get() : n->rchild.get();
+            }
+        }
+    }
+
+    /* Recomputes the sizes along the right spine of tree (the left one if !right),
+     * assuming the other children of the spine are right.
+     * Bottom-up, each size is the sum of 1 + size(other child) below it;
+     * so a first pass gets the total, and a second hands it out top-down.
+     */
+    template< typename Pointer >
+    void update_spine( const Pointer & tree, bool right ) {
+        if constexpr( is_sized<Pointer> ) {
+            auto next = [right]( auto n ){ return right ? n->rchild.get() : n->lchild.get(); };
+            auto other = [right]( auto n ){ return size(right ? n->lchild : n->rchild); };
+            std::size_t total = 0;
+            for( auto n = tree.get(); n; n = next(n) )
+                total += 1 + other(n);
+            for( auto n = tree.get(); n; n = next(n) ) {
+                n->size = total;
+                total -= 1 + other(n);
+            }
+        }
+    }
+
+    /* Returns the number of keys smaller than key.
+     */
+    template< typename Pointer, typename Key, typename Compare = std::less<> >
+    std::size_t rank( const Pointer & tree, const Key & key, const Compare & comp = Compare() ) {
+        std::size_t ret = 0;
+        for( auto n = tree.get(); n; ) {
+            if( comp(n->key, key) ) {
+                ret += size(n->lchild) + 1;
+                n = n->rchild.get();
+            }
+            else
+                n = n->lchild.get();
+        }
+        return ret;
+    }
+
+    /* Returns the node with the k-th smallest key (counting from 0),
+     * or null if the tree has at most k keys.
+     */
+    template< typename Pointer >
+    typename Pointer::element_type * select( const Pointer & tree, std::size_t k ) {
+        for( auto n = tree.get(); n; ) {
+            std::size_t left = size(n->lchild);
+            if( k < left )
+                n = n->lchild.get();
+            else if( k == left )
+                return n;
+            else {
+                k -= left + 1;
+                n = n->rchild.get();
+            }
+        }
+        return nullptr;
+    }
+}
+
+#endif // ORDER_STATISTICS_HPP
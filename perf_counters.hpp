@@ -0,0 +1,191 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Hardware performance counters of the calling thread, through perf_event_open.
+ *
+ * The events are opened as one group, so that they are counted
+ * over exactly the same instructions. The kernel may not permit them
+ * (see /proc/sys/kernel/perf_event_paranoid), or the machine may lack some;
+ * the missing events are then reported as not available, and everything else
+ * works as if they were zero, so that callers simply fall back to timing.
+ */
+namespace perf {
+    enum event {
+        cycles,
+        instructions,
+        l1d_misses,
+        llc_misses,
+        dtlb_misses,
+        branch_misses,
+    };
+
+    constexpr int event_count = branch_misses + 1;
+
+    inline const char * event_name( int e ) {
+        static const char * const names[event_count] = {
+            "cycles", "instructions", "L1D misses", "LLC misses", "dTLB misses", "branch misses"
+        };
+        return names[e];
+    }
+
+    // Values of the events, scaled up if the kernel had to multiplex them.
+    struct readings {
+        std::array<double, event_count> values{};
+
+        readings operator-( const readings & other ) const {
+            readings ret;
+            for( int e = 0; e < event_count; e++ )
+                ret.values[e] = values[e] - other.values[e];
+            return ret;
+        }
+
+        double operator[]( int e ) const {
+            return values[e];
+        }
+    };
+
+    class counter_group {
+        std::array<int, event_count> fds;
+        std::string error; // Why the group could not be opened, if it could not.
+
+#ifdef __linux__
+        static perf_event_attr attributes( int e ) {
+            auto cache = []( std::uint64_t id ) {
+                return id | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            };
+            perf_event_attr attr;
+            std::memset( &attr, 0, sizeof(attr) );
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            switch( e ) {
+                case cycles:
+                    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                    break;
+                case instructions:
+                    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                    break;
+                case l1d_misses:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = cache( PERF_COUNT_HW_CACHE_L1D );
+                    break;
+                case llc_misses:
+                    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                    break;
+                case dtlb_misses:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = cache( PERF_COUNT_HW_CACHE_DTLB );
+                    break;
+                case branch_misses:
+                    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                    break;
+            }
+            attr.disabled = e == cycles; // The leader starts the whole group.
+            attr.exclude_kernel = 1;     // Usually required, and not what we measure.
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return attr;
+        }
+#endif
+
+    public:
+        // Opens the group for the calling thread, stopped.
+        counter_group() {
+            fds.fill( -1 );
+#ifdef __linux__
+            for( int e = 0; e < event_count; e++ ) {
+                perf_event_attr attr = attributes( e );
+                int leader = e == cycles ? -1 : fds[cycles];
+                fds[e] = syscall( SYS_perf_event_open, &attr, 0, -1, leader, 0 );
+                if( fds[e] < 0 && e == cycles ) {
+                    error = std::strerror( errno );
+                    return; // Without a leader, there is no group.
+                }
+            }
+#else
+            error = "perf events are only available on Linux";
+#endif
+        }
+
+        ~counter_group() {
+#ifdef __linux__
+            for( int fd : fds )
+                if( fd >= 0 )
+                    close( fd );
+#endif
+        }
+
+        counter_group( const counter_group & ) = delete;
+        counter_group & operator=( const counter_group & ) = delete;
+
+        // Whether any event is counted.
+        bool available() const {
+            return fds[cycles] >= 0;
+        }
+
+        bool available( int e ) const {
+            return fds[e] >= 0;
+        }
+
+        const std::string & why_unavailable() const {
+            return error;
+        }
+
+        // Zeroes the counters and starts counting.
+        void start() {
+#ifdef __linux__
+            if( !available() )
+                return;
+            ioctl( fds[cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+            ioctl( fds[cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+#endif
+        }
+
+        void stop() {
+#ifdef __linux__
+            if( available() )
+                ioctl( fds[cycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+#endif
+        }
+
+        // Values since start; zero for the events not available.
+        readings read() const {
+            readings ret;
+#ifdef __linux__
+            if( !available() )
+                return ret;
+            struct {
+                std::uint64_t nr, time_enabled, time_running;
+                std::uint64_t values[event_count];
+            } data;
+            if( ::read( fds[cycles], &data, sizeof(data) ) <= 0 )
+                return ret;
+            double scale = data.time_running > 0 ?
+                (double) data.time_enabled / data.time_running : 0;
+
+            // The values come in the order the events were opened, without the missing ones.
+            std::uint64_t i = 0;
+            for( int e = 0; e < event_count && i < data.nr; e++ )
+                if( available(e) )
+                    ret.values[e] = data.values[i++] * scale;
+#endif
+            return ret;
+        }
+    };
+}
+
+#endif // PERF_COUNTERS_HPP
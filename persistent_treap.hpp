@@ -0,0 +1,361 @@
+#ifndef PERSISTENT_TREAP_HPP
+#define PERSISTENT_TREAP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "in_order.hpp"
+
+/* Persistent treap: nodes never change once built,
+ * and are shared between the versions of the tree.
+ *
+ * An update copies only the path from the root down to the place it changes,
+ * expected O(log n) nodes, and shares everything else with the old version.
+ * So a snapshot is just a counted reference to a root, taken in O(1),
+ * and stays valid and unchanged whatever the writer does afterwards.
+ *
+ * Nodes are reference-counted intrusively, with atomic counts,
+ * so snapshots may be read and dropped by other threads;
+ * a node is freed when the last version holding it goes away.
+ * The writer itself must be a single thread.
+ */
+namespace persistent_treap {
+    template< typename Key >
+    struct node;
+
+    // Counted reference to an immutable node.
+    template< typename Key >
+    class node_ptr {
+        const node<Key> * p = nullptr;
+
+    public:
+        node_ptr() = default;
+        node_ptr( std::nullptr_t ) {}
+
+        // Takes over a newly built node, whose count is already 1.
+        explicit node_ptr( const node<Key> * n ) : p(n) {}
+
+        node_ptr( const node_ptr & other ) : p(other.p) {
+            if( p )
+                p->refs.fetch_add( 1, std::memory_order_relaxed );
+        }
+
+        node_ptr( node_ptr && other ) : p(other.p) {
+            other.p = nullptr;
+        }
+
+        node_ptr & operator=( node_ptr other ) {
+            std::swap( p, other.p );
+            return *this;
+        }
+
+        /* The release/acquire pair makes every use of the node
+         * by the other owners happen before its deletion.
+         */
+        ~node_ptr() {
+            if( p && p->refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+                delete p;
+        }
+
+        const node<Key> * get() const { return p; }
+        const node<Key> * operator->() const { return p; }
+        const node<Key> & operator*() const { return *p; }
+        explicit operator bool() const { return p != nullptr; }
+    };
+
+    template< typename Key >
+    struct node {
+        using key_type = Key;
+
+        Key key;
+        unsigned int priority;
+        mutable std::atomic<unsigned int> refs{1};
+        node_ptr<Key> lchild, rchild;
+
+        node( const Key & key, unsigned int priority, node_ptr<Key> lchild, node_ptr<Key> rchild ) :
+            key(key), priority(priority), lchild(std::move(lchild)), rchild(std::move(rchild))
+        {}
+    };
+
+    template< typename Key >
+    node_ptr<Key> make( const Key & key, unsigned int priority,
+            node_ptr<Key> lchild, node_ptr<Key> rchild )
+    {
+        return node_ptr<Key>( new node<Key>( key, priority, std::move(lchild), std::move(rchild) ) );
+    }
+
+    /* Returns the node with the given key, or null if there is none.
+     */
+    template< typename Key, typename Compare = std::less<> >
+    const node<Key> * find( const node_ptr<Key> & tree, const Key & key,
+            const Compare & comp = Compare() )
+    {
+        const node<Key> * n = tree.get();
+        while( n ) {
+            if( comp(key, n->key) )
+                n = n->lchild.get();
+            else if( comp(n->key, key) )
+                n = n->rchild.get();
+            else
+                return n;
+        }
+        return nullptr;
+    }
+
+    /* Returns the keys of the tree smaller than key, and the remaining ones,
+     * as two new versions; the nodes on the search path are copied.
+     */
+    template< typename Key, typename Compare = std::less<> >
+    std::pair<node_ptr<Key>, node_ptr<Key>> split( const node_ptr<Key> & tree,
+            const Key & key, const Compare & comp = Compare() )
+    {
+        if( !tree )
+            return {nullptr, nullptr};
+        if( comp(tree->key, key) ) {
+            auto halves = split( tree->rchild, key, comp );
+            return {make( tree->key, tree->priority, tree->lchild, std::move(halves.first) ),
+                    std::move(halves.second)};
+        }
+        auto halves = split( tree->lchild, key, comp );
+        return {std::move(halves.first),
+                make( tree->key, tree->priority, std::move(halves.second), tree->rchild )};
+    }
+
+    /* Returns the union of 'left' and 'right' as a new version,
+     * assuming every key in 'left' is smaller than every key in 'right'.
+     * As in treap::merge, the left side wins priority ties.
+     */
+    template< typename Key >
+    node_ptr<Key> merge( const node_ptr<Key> & left, const node_ptr<Key> & right ) {
+        if( !left )
+            return right;
+        if( !right )
+            return left;
+        if( left->priority < right->priority )
+            return make( right->key, right->priority, merge( left, right->lchild ), right->rchild );
+        return make( left->key, left->priority, left->lchild, merge( left->rchild, right ) );
+    }
+
+    /* Returns a new version with the key inserted, with the given priority.
+     * The key is assumed not to be in the tree.
+     * The path is copied down to where the new node belongs,
+     * and the subtree found there is split between its children;
+     * the result has the same shape as treap::insert would give.
+     */
+    template< typename Key, typename Compare = std::less<> >
+    node_ptr<Key> insert( const node_ptr<Key> & tree, const Key & key,
+            unsigned int priority, const Compare & comp = Compare() )
+    {
+        if( !tree || tree->priority < priority ) {
+            auto halves = split( tree, key, comp );
+            return make( key, priority, std::move(halves.first), std::move(halves.second) );
+        }
+        if( comp(key, tree->key) )
+            return make( tree->key, tree->priority,
+                    insert( tree->lchild, key, priority, comp ), tree->rchild );
+        return make( tree->key, tree->priority,
+                tree->lchild, insert( tree->rchild, key, priority, comp ) );
+    }
+
+    /* Returns a new version without the key,
+     * which is assumed to be in the tree.
+     */
+    template< typename Key, typename Compare = std::less<> >
+    node_ptr<Key> erase( const node_ptr<Key> & tree, const Key & key,
+            const Compare & comp = Compare() )
+    {
+        if( comp(key, tree->key) )
+            return make( tree->key, tree->priority, erase( tree->lchild, key, comp ), tree->rchild );
+        if( comp(tree->key, key) )
+            return make( tree->key, tree->priority, tree->lchild, erase( tree->rchild, key, comp ) );
+        return merge( tree->lchild, tree->rchild );
+    }
+
+    /* Read-only version of a treap, as it was when taken.
+     * Snapshots are cheap to copy, and may be used and dropped
+     * in any thread, concurrently with the writer.
+     */
+    template< typename Key, typename Compare = std::less<Key> >
+    class snapshot {
+        node_ptr<Key> root;
+        Compare comp;
+
+    public:
+        using iterator = in_order::iterator<node<Key>>;
+
+        snapshot() = default;
+        snapshot( node_ptr<Key> root, const Compare & comp ) :
+            root(std::move(root)), comp(comp)
+        {}
+
+        int count( const Key & key ) const {
+            return find( root, key, comp ) ? 1 : 0;
+        }
+
+        iterator begin() const {
+            return iterator::first( root.get() );
+        }
+
+        iterator end() const {
+            return iterator( root.get() );
+        }
+
+        // Calls f(node) for every key in [lo, hi), in order.
+        template< typename F >
+        void for_each_in_range( const Key & lo, const Key & hi, F && f ) const {
+            in_order::for_each_in_range( root, lo, hi, f, comp );
+        }
+
+        const node<Key> * get() const {
+            return root.get();
+        }
+    };
+
+    /* std::set-like interface, with snapshots.
+     * Keys are ordered by Compare, and priorities are drawn from RNG.
+     */
+    template< typename Key, typename RNG, typename Compare = std::less<Key> >
+    class treap {
+        node_ptr<Key> root;
+        RNG rng;
+        Compare comp;
+        std::size_t n = 0;
+
+    public:
+        using key_type = Key;
+        using snapshot_type = ::persistent_treap::snapshot<Key, Compare>;
+
+        treap( RNG rng, const Compare & comp = Compare() ) : rng(rng), comp(comp) {}
+
+        // Returns 1 if the key was found in the treap, 0 otherwise.
+        int count( const Key & key ) const {
+            return find( root, key, comp ) ? 1 : 0;
+        }
+
+        std::size_t size() const {
+            return n;
+        }
+
+        /* Inserts the key in the treap.
+         * Nothing is done (nor copied) if the key is already there.
+         */
+        void insert( const Key & key ) {
+            if( find( root, key, comp ) )
+                return;
+            root = ::persistent_treap::insert( root, key, rng(), comp );
+            n++;
+        }
+
+        /* Removes the given key from the treap.
+         * Nothing is done if the key is not present.
+         */
+        void erase( const Key & key ) {
+            if( !find( root, key, comp ) )
+                return;
+            root = ::persistent_treap::erase( root, key, comp );
+            n--;
+        }
+
+        // The current version, in O(1).
+        snapshot_type snapshot() const {
+            return snapshot_type( root, comp );
+        }
+    };
+
+    /* Number of distinct nodes in the given versions,
+     * which is the memory they hold together.
+     */
+    template< typename Key >
+    std::size_t count_nodes( const std::vector<const node<Key> *> & roots ) {
+        std::unordered_set<const node<Key> *> seen;
+        std::vector<const node<Key> *> stack( roots.begin(), roots.end() );
+        while( !stack.empty() ) {
+            const node<Key> * n = stack.back();
+            stack.pop_back();
+            if( !n || !seen.insert(n).second )
+                continue; // Shared subtrees are only walked once.
+            stack.push_back( n->lchild.get() );
+            stack.push_back( n->rchild.get() );
+        }
+        return seen.size();
+    }
+
+    // Memory held by a snapshotting treap when it was destroyed.
+    struct snapshot_stats {
+        std::size_t snapshots = 0; // Taken during the whole run.
+        std::size_t keys = 0;      // In the current version.
+        std::size_t nodes = 0;     // In the current version and the kept snapshots.
+        std::size_t node_bytes = 0;
+    };
+
+    /* Adapter running a persistent treap as if background readers were present:
+     * a snapshot is taken every 'period' operations (never, if it is 0),
+     * and the last 'kept' snapshots are held alive.
+     * If 'stats' is not null, the memory held at the end is stored there,
+     * on destruction.
+     */
+    template< typename Tree >
+    class snapshotting {
+        Tree tree;
+        int period;
+        std::size_t kept;
+        int countdown;
+        std::deque<typename Tree::snapshot_type> snapshots;
+        std::size_t taken = 0;
+        snapshot_stats * stats;
+
+        void tick() {
+            if( period <= 0 || --countdown > 0 )
+                return;
+            countdown = period;
+            snapshots.push_back( tree.snapshot() );
+            if( snapshots.size() > kept )
+                snapshots.pop_front();
+            taken++;
+        }
+
+    public:
+        snapshotting( Tree && tree, int period, std::size_t kept, snapshot_stats * stats = nullptr ) :
+            tree(std::move(tree)), period(period), kept(kept), countdown(period), stats(stats)
+        {}
+
+        ~snapshotting() {
+            if( !stats )
+                return;
+            using node_type = std::remove_const_t<std::remove_pointer_t<
+                decltype(tree.snapshot().get())>>;
+            std::vector<const node_type *> roots;
+            auto current = tree.snapshot();
+            roots.push_back( current.get() );
+            for( const auto & s : snapshots )
+                roots.push_back( s.get() );
+            stats->snapshots = taken;
+            stats->keys = tree.size();
+            stats->nodes = count_nodes( roots );
+            stats->node_bytes = stats->nodes * sizeof(node_type);
+        }
+
+        void insert( const typename Tree::key_type & key ) {
+            tree.insert( key );
+            tick();
+        }
+
+        void erase( const typename Tree::key_type & key ) {
+            tree.erase( key );
+            tick();
+        }
+
+        int count( const typename Tree::key_type & key ) {
+            tick();
+            return tree.count( key );
+        }
+    };
+}
+
+#endif // PERSISTENT_TREAP_HPP
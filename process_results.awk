@@ -1,30 +1,63 @@
-#!/usr/bin/gawk -f
+#!/usr/bin/awk -f
+# Reads the output of run_tests.sh and prints, for each configuration,
+# a table row with the mean time of every tree, without the best and worst runs.
+# With --memory, the ns/op are averaged instead of the times,
+# and followed by the bytes/key of the last run.
+# Plain POSIX awk: it runs on gawk, mawk and busybox awk alike.
 BEGIN {
-    count = 0
+    header = 1
+    row = ""
 }
 
-/Test/ {
-    delete values;
-    value_index = 0
+# The first line of a block is "<tree> <configuration>".
+header {
+    header = 0
+    config = $0
+    sub(/^[^ ]* */, "", config)
+    if( row != "" && config != row ) {
+        print ""
+        open = 0
+    }
+    row = config
+    n = 0
+    bytes = ""
+    next
 }
 
 /^$/ {
-    n = asort(values)
+    header = 1
+    if( n == 0 )
+        next
+    # Insertion sort; there are only a few runs.
+    for( i = 2; i <= n; i++ ) {
+        v = values[i]
+        for( j = i - 1; j >= 1 && values[j] > v; j-- )
+            values[j+1] = values[j]
+        values[j+1] = v
+    }
     sum = 0
     for( i = 2; i <= n-1; i++ )
         sum += values[i]
 
-    printf " & %.1f", sum/(n-2)
-    count++
+    printf " & %.1f", (n > 2 ? sum/(n-2) : values[1])
+    if( bytes != "" )
+        printf " & %.1f", bytes
+    open = 1
+}
 
-    if( count == 4 ) {
-        print ""
-        count = 0
-    }
+/^Run/ {
+    if( match($0, /[0-9.]+ns\/op/) )
+        val = substr($0, RSTART, RLENGTH - 5)
+    else if( match($0, /Time: [0-9]+ms/) )
+        val = substr($0, RSTART + 6, RLENGTH - 8)
+    else
+        next
+    values[++n] = val + 0
+    if( match($0, /[0-9.]+ bytes\/key/) )
+        bytes = substr($0, RSTART, RLENGTH - 10)
 }
 
-/Run/ {
-    val = gensub(/.*: (.*)ms/,"\\1", "g")
-    values[value_index] = val
-    value_index++
+END {
+    if( open )
+        print ""
 }
@@ -0,0 +1,100 @@
+namespace command_line {
+    const char help_message[] =
+" [options]\n"
+"Measures how fast each random number generator usable by the treaps\n"
+"draws its numbers, one number per call, as the treaps draw their priorities.\n"
+"Shows the best time of the runs, per number, and the numbers per second.\n"
+"\n"
+"Options:\n"
+"--numbers <N>\n"
+"    Numbers drawn by each run.\n"
+"    Default: 100000000\n"
+"\n"
+"--runs <N>\n"
+"    Runs of each generator.\n"
+"    Default: 5\n"
+"\n"
+"--seed <N>\n"
+"    Seed of every generator.\n"
+"    Default: 1\n"
+"\n"
+"--help\n"
+"    Display this help and quit.\n"
+;
+} // namespace command_line
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "cmdline/args.hpp"
+
+#include "fast_rng.hpp"
+#include "xorshift.hpp"
+
+namespace command_line {
+    long long numbers = 100'000'000;
+    int runs = 5;
+    unsigned seed = 1; // xorshift's seed must not be zero.
+
+    void parse( cmdline::args && args ) {
+        while( args.size() > 0 ) {
+            std::string arg = args.next();
+            if( arg == "--numbers" ) {
+                args.range(1) >> numbers;
+                continue;
+            }
+            if( arg == "--runs" ) {
+                args.range(1) >> runs;
+                continue;
+            }
+            if( arg == "--seed" ) {
+                args.range(1) >> seed;
+                continue;
+            }
+            if( arg == "--help" ) {
+                std::cout << args.program_name() << help_message;
+                std::exit(0);
+            }
+
+            std::cerr << args.program_name() << ": Unknown option " << arg << '\n';
+            std::exit(1);
+        }
+    }
+} // namespace command_line
+
+/* Times the draws of 'numbers' numbers from RNG{seed}, as unsigned int
+ * like the treap priorities, and prints the best of the runs.
+ * The numbers are summed, so that the draws are not optimized away.
+ */
+template< typename RNG >
+void benchmark( const char * name ) {
+    using namespace command_line;
+    double best = 0;
+    unsigned int sum = 0;
+    for( int run = 0; run < runs; run++ ) {
+        RNG rng{ seed };
+        auto begin = std::chrono::steady_clock::now();
+        for( long long i = 0; i < numbers; i++ )
+            sum += static_cast<unsigned int>( rng() );
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - begin;
+        if( run == 0 || time.count() < best )
+            best = time.count();
+    }
+    std::printf( "%-16s %8.3f ns/number %10.1f M numbers/s  (sum %08x)\n",
+            name, best * 1e9 / numbers, numbers / best * 1e-6, sum );
+}
+
+int main( int argc, char ** argv ) {
+    command_line::parse( cmdline::args(argc, argv) );
+    benchmark<std::mt19937>( "mt19937" );
+    benchmark<xorshift>( "xorshift" );
+    benchmark<fast_rng::xoshiro256ss>( "xoshiro256**" );
+    benchmark<fast_rng::pcg32>( "pcg32" );
+    benchmark<fast_rng::wyrand>( "wyrand" );
+    benchmark<fast_rng::simd_xorshift>( "simd-xorshift" );
+    return 0;
+}
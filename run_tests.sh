@@ -20,10 +20,11 @@ configurations=(
     "mixed-workload"
 )
 
+# Extra arguments, as --memory, are passed to every run.
 for config in "${configurations[@]}"; do
     for tree in $trees; do
         echo $tree $config
-        ./main $tree $config --runs 12
+        ./main $tree $config --runs 12 "$@"
         echo
     done
 done
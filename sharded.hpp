@@ -0,0 +1,299 @@
+#ifndef SHARDED_HPP
+#define SHARDED_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Range-partitioned tree: the key space is split into shards,
+ * each one a separate tree owned by a worker thread.
+ *
+ * The caller routes every operation by key to the shard owning it,
+ * in batches, through one single-producer single-consumer queue per shard;
+ * a tree is only ever touched by its worker, so it needs no locks,
+ * and stays in the cache of the core running that worker.
+ * Operations on the same key go through the same queue,
+ * so they are applied in the order they were submitted.
+ *
+ * The shard boundaries start evenly spread over a given key range.
+ * When the operations are skewed towards some shards,
+ * the boundaries are moved to the quantiles of the recently routed keys,
+ * and the keys changing shard are moved between the trees.
+ */
+namespace sharded {
+    // Bounded lock-free queue between one producer and one consumer thread.
+    template< typename T >
+    class spsc_queue {
+        std::vector<T> slots;
+        std::size_t mask;
+        alignas(64) std::atomic<std::size_t> head{0}; // Next slot to pop.
+        alignas(64) std::atomic<std::size_t> tail{0}; // Next slot to push.
+
+    public:
+        // capacity must be a power of two.
+        explicit spsc_queue( std::size_t capacity ) : slots(capacity), mask(capacity - 1) {}
+
+        // Returns false if the queue is full.
+        bool try_push( T && value ) {
+            std::size_t t = tail.load(std::memory_order_relaxed);
+            if( t - head.load(std::memory_order_acquire) == slots.size() )
+                return false;
+            slots[t & mask] = std::move(value);
+            tail.store( t + 1, std::memory_order_release );
+            return true;
+        }
+
+        // Returns false if the queue is empty.
+        bool try_pop( T & value ) {
+            std::size_t h = head.load(std::memory_order_relaxed);
+            if( h == tail.load(std::memory_order_acquire) )
+                return false;
+            value = std::move( slots[h & mask] );
+            head.store( h + 1, std::memory_order_release );
+            return true;
+        }
+    };
+
+    enum class op_kind {
+        insert,
+        erase,
+        count,
+    };
+
+    template< typename Key >
+    struct request {
+        op_kind kind;
+        Key key;
+    };
+
+    // Work done by a shard.
+    struct shard_load {
+        long long ops = 0;
+        std::chrono::steady_clock::duration busy{}; // Time spent applying the operations.
+    };
+
+    struct options {
+        std::size_t batch_size = 256;      // Requests per batch sent to a shard.
+        std::size_t queue_batches = 64;    // Capacity of each queue; a power of two.
+        long long rebalance_period = 1 << 16; // Routed operations between two checks.
+        double max_imbalance = 1.5;        // Busiest shard over the mean, before rebalancing.
+        std::size_t sample_every = 16;     // One routed key in this many is kept as a sample.
+    };
+
+    /* Tree is avl::avl or treap::treap, as a set:
+     * it needs insert, erase, count, begin, end and lower_bound,
+     * and its keys must be ordered by operator<.
+     */
+    template< typename Tree >
+    class sharded {
+    public:
+        using key_type = typename Tree::key_type;
+
+    private:
+        using batch = std::vector<request<key_type>>;
+
+        struct shard {
+            Tree tree;
+            spsc_queue<batch> queue;
+            batch pending;           // Not sent yet; only used by the caller.
+            long long submitted = 0; // Batches sent; only used by the caller.
+            long long routed = 0;    // Operations since the last check; likewise.
+            alignas(64) std::atomic<long long> completed{0};
+            std::atomic<long long> found{0};
+            shard_load load;         // Written by the worker, read after a drain.
+            std::thread worker;
+
+            shard( Tree && tree, std::size_t capacity ) :
+                tree(std::move(tree)), queue(capacity)
+            {}
+        };
+
+        std::vector<std::unique_ptr<shard>> shards;
+        std::vector<key_type> bounds; // Shard i holds the keys in [bounds[i-1], bounds[i]).
+        std::vector<key_type> sample; // Keys routed since the last check.
+        std::atomic<bool> stopping{false};
+        options opts;
+        long long until_check;
+        std::size_t until_sample;
+        int rebalances = 0;
+        long long moved = 0;
+
+        void work( shard & s ) {
+            batch b;
+            while( true ) {
+                if( !s.queue.try_pop(b) ) {
+                    if( stopping.load(std::memory_order_acquire) && !s.queue.try_pop(b) )
+                        return;
+                    std::this_thread::yield();
+                    continue;
+                }
+                auto begin = std::chrono::steady_clock::now();
+                long long found = 0;
+                for( const request<key_type> & r : b ) {
+                    switch( r.kind ) {
+                        case op_kind::insert:
+                            s.tree.insert( r.key );
+                            break;
+                        case op_kind::erase:
+                            s.tree.erase( r.key );
+                            break;
+                        case op_kind::count:
+                            found += s.tree.count( r.key );
+                            break;
+                    }
+                }
+                s.load.ops += b.size();
+                s.load.busy += std::chrono::steady_clock::now() - begin;
+                s.found.fetch_add( found, std::memory_order_relaxed );
+                s.completed.fetch_add( 1, std::memory_order_release );
+            }
+        }
+
+        std::size_t owner( const key_type & key ) const {
+            return std::upper_bound( bounds.begin(), bounds.end(), key ) - bounds.begin();
+        }
+
+        void send( shard & s ) {
+            batch b;
+            b.reserve( opts.batch_size );
+            std::swap( b, s.pending );
+            while( !s.queue.try_push(std::move(b)) )
+                std::this_thread::yield(); // The worker is behind.
+            s.submitted++;
+        }
+
+        /* Rebalances if the busiest shard got more than max_imbalance times
+         * its share of the operations routed since the last check.
+         */
+        void check_balance() {
+            until_check = opts.rebalance_period;
+            long long busiest = 0;
+            for( const auto & s : shards ) {
+                busiest = std::max( busiest, s->routed );
+                s->routed = 0;
+            }
+            double mean = (double) opts.rebalance_period / shards.size();
+            if( busiest > opts.max_imbalance * mean && sample.size() >= shards.size() )
+                rebalance();
+            sample.clear();
+        }
+
+        /* Moves the boundaries to the quantiles of the sample,
+         * and moves the keys changing shard, while the workers are idle.
+         */
+        void rebalance() {
+            drain();
+            std::sort( sample.begin(), sample.end() );
+            bounds.clear();
+            for( std::size_t i = 1; i < shards.size(); i++ )
+                bounds.push_back( sample[i * sample.size() / shards.size()] );
+
+            std::vector<std::pair<key_type, std::size_t>> moves; // Key and new shard.
+            for( std::size_t i = 0; i < shards.size(); i++ ) {
+                Tree & tree = shards[i]->tree;
+                std::size_t first = moves.size();
+                if( i > 0 )
+                    for( auto it = tree.begin(); it != tree.end() && it->key < bounds[i-1]; ++it )
+                        moves.emplace_back( it->key, owner(it->key) );
+                if( i + 1 < shards.size() )
+                    for( auto it = tree.lower_bound(bounds[i]); it != tree.end(); ++it )
+                        moves.emplace_back( it->key, owner(it->key) );
+                for( std::size_t m = first; m < moves.size(); m++ )
+                    tree.erase( moves[m].first );
+            }
+            for( const auto & m : moves )
+                shards[m.second]->tree.insert( m.first );
+            moved += moves.size();
+            rebalances++;
+        }
+
+    public:
+        /* Builds 'count' shards with trees made by 'maker',
+         * splitting [lo, hi] into ranges of the same width.
+         * The width is computed in long long, as hi - lo may overflow key_type.
+         */
+        template< typename TreeMaker >
+        sharded( TreeMaker maker, std::size_t count, key_type lo, key_type hi,
+                const options & opts = options() ) :
+            opts(opts), until_check(opts.rebalance_period), until_sample(opts.sample_every)
+        {
+            for( std::size_t i = 1; i < count; i++ )
+                bounds.push_back( key_type( lo + ((long long) hi - lo) / (long long) count
+                        * (long long) i ) );
+            for( std::size_t i = 0; i < count; i++ )
+                shards.push_back( std::make_unique<shard>( maker(), opts.queue_batches ) );
+            for( auto & s : shards )
+                s->worker = std::thread( [this, p = s.get()]{ work(*p); } );
+        }
+
+        sharded( const sharded & ) = delete;
+        sharded & operator=( const sharded & ) = delete;
+
+        // Finishes the submitted operations.
+        ~sharded() {
+            for( auto & s : shards )
+                if( !s->pending.empty() )
+                    send( *s );
+            stopping.store( true, std::memory_order_release );
+            for( auto & s : shards )
+                s->worker.join();
+        }
+
+        /* Routes the operation to its shard; it is applied later, in order.
+         * Must always be called from the same thread.
+         */
+        void submit( op_kind kind, const key_type & key ) {
+            shard & s = *shards[owner(key)];
+            s.pending.push_back( request<key_type>{kind, key} );
+            if( s.pending.size() >= opts.batch_size )
+                send( s );
+            s.routed++;
+            if( --until_sample == 0 ) {
+                until_sample = opts.sample_every;
+                sample.push_back( key );
+            }
+            if( --until_check == 0 )
+                check_balance();
+        }
+
+        /* Sends the partial batches, and waits until every shard has applied
+         * the operations submitted so far.
+         * Returns the number of successful counts up to now.
+         */
+        long long drain() {
+            for( auto & s : shards )
+                if( !s->pending.empty() )
+                    send( *s );
+            long long found = 0;
+            for( auto & s : shards ) {
+                while( s->completed.load(std::memory_order_acquire) < s->submitted )
+                    std::this_thread::yield();
+                found += s->found.load(std::memory_order_relaxed);
+            }
+            return found;
+        }
+
+        // Load of each shard; only meaningful after drain.
+        std::vector<shard_load> loads() const {
+            std::vector<shard_load> ret;
+            for( const auto & s : shards )
+                ret.push_back( s->load );
+            return ret;
+        }
+
+        int rebalance_count() const {
+            return rebalances;
+        }
+
+        long long moved_keys() const {
+            return moved;
+        }
+    };
+}
+
+#endif // SHARDED_HPP
@@ -0,0 +1,286 @@
+#ifndef SKIPLIST_HPP
+#define SKIPLIST_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+
+#include "epoch.hpp"
+#include "fast_rng.hpp"
+
+/* Lock-free skip list, after Herlihy and Shavit's LockFreeSkipList
+ * (itself a simplification of Fraser's).
+ *
+ * Each node is linked at levels 0 to height-1; level 0 holds every key,
+ * and each level above holds about half the keys of the one below.
+ * A link is a pointer whose lowest bit marks the node owning it as removed.
+ * erase marks the links of the node from the top down,
+ * and the mark of level 0 decides which thread removed the key;
+ * the marked nodes are unlinked later, by whatever thread walks past them.
+ * insert links a new node at level 0 first, which makes the key present,
+ * and then at the levels above. Every step is a single compare-and-swap,
+ * so no thread ever waits for another; count does not even write.
+ *
+ * Removed nodes cannot be freed at once, as other threads may be walking
+ * through them, nor retired to an ebr::domain, since in this algorithm
+ * an insert may still link a new node in front of one already unlinked.
+ * They are kept on a lock-free list, and freed with the skip list:
+ * its memory grows with every erase, whatever the number of keys left.
+ */
+namespace skiplist {
+    // Enough levels for 2**32 keys.
+    constexpr int max_level = 32;
+
+    using link = std::atomic<std::uintptr_t>;
+
+    template< typename Key >
+    struct alignas(link) node {
+        const Key key;
+        const int height;
+        node * next_removed = nullptr; // In the list of the removed nodes.
+
+        // The 'height' links follow the node in the same allocation.
+        link * links() {
+            return reinterpret_cast<link *>( this + 1 );
+        }
+
+        static node * make( const Key & key, int height ) {
+            void * memory = ::operator new( sizeof(node) + height * sizeof(link) );
+            node * n = new (memory) node{ key, height };
+            for( int i = 0; i < height; i++ )
+                new (n->links() + i) link( 0 );
+            return n;
+        }
+
+        static void destroy( node * n ) {
+            n->~node();
+            ::operator delete( n );
+        }
+    };
+
+    template< typename Key >
+    node<Key> * pointer( std::uintptr_t l ) {
+        return reinterpret_cast<node<Key> *>( l & ~std::uintptr_t(1) );
+    }
+
+    inline bool marked( std::uintptr_t l ) {
+        return l & 1;
+    }
+
+    template< typename Key >
+    std::uintptr_t unmarked( node<Key> * n ) {
+        return reinterpret_cast<std::uintptr_t>( n );
+    }
+
+    /* std::set-like interface; every member may be called from any thread.
+     * The heights of the nodes are drawn from one RNG per thread
+     * (see ebr::thread_index), seeded with successive nonzero outputs
+     * of splitmix64 from the seed: a generator like xorshift, seeded with 0,
+     * would only give nodes of the greatest height.
+     */
+    template< typename Key, typename RNG, typename Compare = std::less<Key> >
+    class skiplist {
+        using node_type = node<Key>;
+
+        // One cache line per thread, so that inserts do not share lines.
+        struct alignas(64) level_source {
+            RNG rng;
+        };
+
+        link head[max_level];
+        std::atomic<int> height{1}; // No node is linked above this level.
+        std::atomic<node_type *> removed{nullptr};
+        Compare comp;
+        level_source sources[ebr::max_threads];
+
+        /* Heights are geometric with ratio 1/2:
+         * one plus the number of trailing zeros of a random number.
+         */
+        int random_height() {
+            std::uint32_t r = sources[ebr::thread_index()].rng();
+            return 1 + __builtin_ctz( r | 1u << (max_level - 1) );
+        }
+
+        void raise_height( int h ) {
+            int current = height.load();
+            while( current < h && !height.compare_exchange_weak(current, h) )
+                ;
+        }
+
+        /* Fills preds and succs, for each level below 'levels',
+         * with the links of the last node smaller than key (or the head)
+         * and the first node not smaller than key.
+         * The marked nodes met on the way are unlinked.
+         * Returns whether succs[0] holds the key.
+         */
+        bool find( const Key & key, int levels, link ** preds, node_type ** succs ) {
+        retry:
+            link * pred = head;
+            for( int level = levels - 1; level >= 0; level-- ) {
+                node_type * curr = pointer<Key>( pred[level].load() );
+                while( curr ) {
+                    std::uintptr_t next = curr->links()[level].load();
+                    node_type * succ = pointer<Key>( next );
+                    if( marked(next) ) {
+                        std::uintptr_t expected = unmarked( curr );
+                        if( !pred[level].compare_exchange_strong(expected, unmarked(succ)) )
+                            goto retry; // pred changed or was removed itself.
+                        curr = succ;
+                    }
+                    else if( comp(curr->key, key) ) {
+                        pred = curr->links();
+                        curr = succ;
+                    }
+                    else
+                        break;
+                }
+                preds[level] = pred;
+                succs[level] = curr;
+            }
+            return succs[0] && !comp(key, succs[0]->key);
+        }
+
+        void push_removed( node_type * n ) {
+            n->next_removed = removed.load();
+            while( !removed.compare_exchange_weak(n->next_removed, n) )
+                ;
+        }
+
+    public:
+        skiplist( std::uint32_t seed, const Compare & comp = Compare() ) : comp(comp) {
+            for( link & l : head )
+                l.store( 0, std::memory_order_relaxed );
+            std::uint64_t state = seed;
+            for( std::size_t i = 0; i < ebr::max_threads; i++ ) {
+                std::uint32_t s;
+                do
+                    s = static_cast<std::uint32_t>( fast_rng::detail::splitmix64(state) );
+                while( s == 0 );
+                sources[i].rng = RNG( s );
+            }
+        }
+
+        skiplist( const skiplist & ) = delete;
+        skiplist & operator=( const skiplist & ) = delete;
+
+        /* No other thread may be using the skip list.
+         * The nodes still at level 0 are the present keys,
+         * and the removed ones which were not unlinked yet.
+         */
+        ~skiplist() {
+            for( node_type * n = pointer<Key>( head[0].load() ); n; ) {
+                std::uintptr_t next = n->links()[0].load();
+                if( !marked(next) )
+                    node_type::destroy( n );
+                n = pointer<Key>( next );
+            }
+            for( node_type * n = removed.load(); n; ) {
+                node_type * next = n->next_removed;
+                node_type::destroy( n );
+                n = next;
+            }
+        }
+
+        // Number of levels in use: about log2 of the number of keys.
+        int levels() const {
+            return height.load();
+        }
+
+        // Returns 1 if the key was found in the skip list, 0 otherwise.
+        int count( const Key & key ) {
+            link * pred = head;
+            node_type * curr = nullptr;
+            for( int level = height.load() - 1; level >= 0; level-- ) {
+                curr = pointer<Key>( pred[level].load() );
+                while( curr ) {
+                    std::uintptr_t next = curr->links()[level].load();
+                    if( marked(next) )
+                        curr = pointer<Key>( next ); // Skip the removed node.
+                    else if( comp(curr->key, key) ) {
+                        pred = curr->links();
+                        curr = pointer<Key>( next );
+                    }
+                    else
+                        break;
+                }
+            }
+            return curr && !comp(key, curr->key) ? 1 : 0;
+        }
+
+        /* Inserts the key in the skip list.
+         * Nothing is done if the key is already there.
+         */
+        void insert( const Key & key ) {
+            link * preds[max_level];
+            node_type * succs[max_level];
+            int h = random_height();
+            raise_height( h );
+            int levels = height.load();
+            node_type * n = nullptr;
+            while( true ) {
+                if( find(key, levels, preds, succs) ) {
+                    if( n )
+                        node_type::destroy( n ); // Never published.
+                    return;
+                }
+                if( !n )
+                    n = node_type::make( key, h );
+                for( int i = 0; i < h; i++ )
+                    n->links()[i].store( unmarked(succs[i]), std::memory_order_relaxed );
+                std::uintptr_t expected = unmarked( succs[0] );
+                if( preds[0][0].compare_exchange_strong(expected, unmarked(n)) )
+                    break; // The key is now present.
+            }
+
+            for( int level = 1; level < h; level++ ) {
+                while( true ) {
+                    /* Point the new node to the current successor,
+                     * unless it was removed meanwhile.
+                     */
+                    std::uintptr_t next = n->links()[level].load();
+                    if( marked(next) )
+                        return;
+                    if( pointer<Key>( next ) != succs[level] &&
+                            !n->links()[level].compare_exchange_strong(
+                                next, unmarked(succs[level])) )
+                        return; // Only a removal changes it.
+                    std::uintptr_t expected = unmarked( succs[level] );
+                    if( preds[level][level].compare_exchange_strong(expected, unmarked(n)) )
+                        break;
+                    find( key, levels, preds, succs );
+                }
+            }
+        }
+
+        /* Removes the given key from the skip list.
+         * Nothing is done if the key is not present.
+         */
+        void erase( const Key & key ) {
+            link * preds[max_level];
+            node_type * succs[max_level];
+            int levels = height.load();
+            if( !find(key, levels, preds, succs) )
+                return;
+            node_type * victim = succs[0];
+            for( int level = victim->height - 1; level > 0; level-- ) {
+                std::uintptr_t next = victim->links()[level].load();
+                while( !marked(next) &&
+                        !victim->links()[level].compare_exchange_weak(next, next | 1) )
+                    ;
+            }
+            std::uintptr_t next = victim->links()[0].load();
+            while( !marked(next) ) {
+                if( victim->links()[0].compare_exchange_weak(next, next | 1) ) {
+                    find( key, levels, preds, succs ); // Unlinks it.
+                    push_removed( victim );
+                    return;
+                }
+            }
+            // Another thread removed the key first.
+        }
+    };
+}
+
+#endif // SKIPLIST_HPP
@@ -3,22 +3,250 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <iterator>
+#include <mutex>
 #include <random>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
-enum operation_type {
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "fork_join.hpp"
+#include "generation.hpp"
+#include "latency.hpp"
+#include "perf_counters.hpp"
+#include "sharded.hpp"
+
+enum operation_type : std::uint8_t {
     insert,
     erase,
     count,
+    bulk_load,
+    rank,
+    range_scan,
 };
 
+/* An operation takes 8 bytes, as test cases hold hundreds of millions of them.
+ * A range_scan visits the keys in [key, hi()); the width of the range,
+ * hi() - key, is packed next to the type, and is 0 for the other operations.
+ */
 struct operation {
-    operation_type type;
+    static constexpr int max_width = (1 << 24) - 1;
+
+    operation_type type : 8;
+    unsigned width : 24;
     int key;
+
+    operation() = default;
+    operation( operation_type type, int key ) : type(type), width(0), key(key) {}
+
+    // Scan of the keys in [lo, hi); hi - lo must be in [0, max_width].
+    operation( operation_type type, int lo, int hi ) :
+        type(type), width(unsigned(hi - lo)), key(lo)
+    {}
+
+    int hi() const {
+        return key + int(width);
+    }
 };
 
+static_assert( sizeof(operation) == 8, "operation must stay 8 bytes long" );
+
 typedef std::vector<operation> test_case;
 
+/* Read-only view of the operations of a test case,
+ * held in a test_case or in a mapped file (see test_case_file.hpp).
+ * It is what the tests run; it is cheap to copy.
+ */
+class test_view {
+    const operation * first = nullptr;
+    std::size_t n = 0;
+
+public:
+    test_view() = default;
+    test_view( const test_case & c ) : first(c.data()), n(c.size()) {}
+    test_view( const operation * first, std::size_t n ) : first(first), n(n) {}
+
+    const operation * data() const { return first; }
+    const operation * begin() const { return first; }
+    const operation * end() const { return first + n; }
+    std::size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const operation & operator[]( std::size_t i ) const { return first[i]; }
+};
+
+/* Operations of a test case handed out in chunks, as they are generated,
+ * for test cases too large to be held in memory (see streaming.hpp).
+ */
+class operation_stream {
+public:
+    virtual ~operation_stream() = default;
+
+    // Next chunk, valid until the following call; empty at the end.
+    virtual test_view next() = 0;
+};
+
+/* A maximal run of bulk_load operations holds ascending keys
+ * that must be loaded at once into the (empty) tree.
+ */
+
+// Forward iterator over the keys of a sequence of operations.
+struct key_iterator {
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int *;
+    using reference = const int &;
+
+    const operation * op;
+
+    const int & operator*() const { return op->key; }
+    key_iterator & operator++() { ++op; return *this; }
+    key_iterator operator++(int) { key_iterator ret = *this; ++op; return ret; }
+    bool operator==( const key_iterator & other ) const { return op == other.op; }
+    bool operator!=( const key_iterator & other ) const { return op != other.op; }
+};
+
+/* Loads the ascending keys in [first, last) into the empty tree
+ * as fast as the tree allows: with assign_sorted, if the tree has it;
+ * with a range insert, as in std::set; or one key at a time.
+ * Call with 0 as the last argument; it selects the best overload.
+ */
+template< typename Tree, typename Iterator >
+auto load_sorted( Tree & tree, Iterator first, Iterator last, int )
+    -> decltype( tree.assign_sorted(first, last) )
+{
+    tree.assign_sorted( first, last );
+}
+
+template< typename Tree, typename Iterator >
+auto load_sorted( Tree & tree, Iterator first, Iterator last, long )
+    -> decltype( tree.insert(first, last) )
+{
+    tree.insert( first, last );
+}
+
+template< typename Tree, typename Iterator >
+void load_sorted( Tree & tree, Iterator first, Iterator last, ... ) {
+    for( ; first != last; ++first )
+        tree.insert( *first );
+}
+
+/* Inserts key with a std::set-like end() hint, if the tree has one;
+ * otherwise with a plain insert.
+ * Call with 0 as the last argument; it selects the best overload.
+ */
+template< typename Tree >
+auto insert_hinted( Tree & tree, int key, int )
+    -> decltype( (void) tree.insert(tree.end(), key) )
+{
+    tree.insert( tree.end(), key );
+}
+
+template< typename Tree >
+void insert_hinted( Tree & tree, int key, ... ) {
+    tree.insert( key );
+}
+
+/* Node size variants of the generic trees, to see how node size affects throughput:
+ * key_type is int or std::uint64_t, and mapped_type is void (a set) or payload.
+ * The test cases keep their int keys, which convert to the wider key type.
+ * (count_batch takes an array of key_type, so a tree of std::uint64_t
+ * counts a batch of int keys one at a time.)
+ */
+template< typename Key, typename Value >
+struct node_variant {
+    using key_type = Key;
+    using mapped_type = Value;
+};
+
+// 64 bytes of value per key, as a record in an index would be.
+struct payload {
+    unsigned char bytes[64];
+};
+
+/* Sets out[i] to tree.count(keys[i]), for i in [0, n):
+ * with count_batch, if the tree has it, or one key at a time.
+ * Call with 0 as the last argument; it selects the best overload.
+ */
+template< typename Tree >
+auto count_all( Tree & tree, const int * keys, std::size_t n, int * out, int )
+    -> decltype( tree.count_batch(keys, n, out) )
+{
+    tree.count_batch( keys, n, out );
+}
+
+template< typename Tree >
+void count_all( Tree & tree, const int * keys, std::size_t n, int * out, ... ) {
+    for( std::size_t i = 0; i < n; i++ )
+        out[i] = tree.count( keys[i] );
+}
+
+// Counts the nodes it is called with.
+struct node_counter {
+    int & count;
+
+    template< typename Node >
+    void operator()( const Node & ) const {
+        count++;
+    }
+};
+
+/* Visits the keys in [lo, hi) in order, and returns how many there are:
+ * with for_each_in_range, if the tree has it,
+ * or else by iterating from lower_bound, as in std::set.
+ * Call with 0 as the last argument; it selects the best overload.
+ */
+template< typename Tree >
+auto scan_range( const Tree & tree, int lo, int hi, int )
+    -> decltype( tree.for_each_in_range(lo, hi, std::declval<node_counter>()), 0 )
+{
+    int count = 0;
+    tree.for_each_in_range( lo, hi, node_counter{count} );
+    return count;
+}
+
+template< typename Tree >
+auto scan_range( const Tree & tree, int lo, int hi, long )
+    -> decltype( tree.lower_bound(lo), 0 )
+{
+    int count = 0;
+    for( auto it = tree.lower_bound(lo); it != tree.end() && *it < hi; ++it )
+        count++;
+    return count;
+}
+
+// Trees without range queries; main refuses test cases scanning them.
+template< typename Tree >
+int scan_range( const Tree &, int, int, ... ) {
+    return 0;
+}
+
+/* Returns tree.rank(key), the number of keys smaller than key,
+ * if the tree has order statistics; 0 otherwise.
+ * Call with 0 as the last argument; it selects the best overload.
+ */
+template< typename Tree >
+auto rank_of( const Tree & tree, int key, int )
+    -> decltype( std::size_t(tree.rank(key)) )
+{
+    return tree.rank( key );
+}
+
+template< typename Tree >
+std::size_t rank_of( const Tree &, int, ... ) {
+    return 0;
+}
+
 /* A test case is simply a list of operations that must be performed by the trees.
  * This header contains tools to generate varied test cases,
  * and to run them with trees.
@@ -28,253 +256,828 @@ typedef std::vector<operation> test_case;
  * The random number generator is fixed as std::mt19937.
  */
 
+// Number of count operations performed, and the time they took.
+struct lookup_stats {
+    long long lookups = 0;
+    std::chrono::steady_clock::duration time{};
+};
+
+// Number of keys visited by range_scan operations, and the time they took.
+struct scan_stats {
+    long long keys = 0;
+    std::chrono::steady_clock::duration time{};
+};
+
+// Number of operation types.
+constexpr int operation_types = operation_type::range_scan + 1;
+
+// Whether the test case holds operations of the given type.
+inline bool contains( test_view test, operation_type type ) {
+    return std::any_of( test.begin(), test.end(),
+        [type]( const operation & op ){ return op.type == type; });
+}
+
+/* Whether the test case updates the tree after a search;
+ * if not, it builds the tree, and then only reads it.
+ */
+inline bool updates_after_searches( test_view test ) {
+    auto is_update = []( const operation & op ){
+        return op.type == operation_type::insert || op.type == operation_type::erase
+            || op.type == operation_type::bulk_load;
+    };
+    auto first_search = std::find_if_not( test.begin(), test.end(), is_update );
+    return std::any_of( first_search, test.end(), is_update );
+}
+
+/* Latency of each operation, in nanoseconds, by operation type.
+ * A maximal run of bulk_load operations counts as a single operation.
+ */
+struct latency_stats {
+    latency::clock clock;
+    latency::histogram by_type[operation_types];
+};
+
+/* Hardware counters of a run of run_test_case:
+ * from the construction of the tree to the end of the last operation,
+ * and then the destruction of the tree.
+ */
+struct perf_stats {
+    perf::counter_group group;
+    perf::readings operations;
+    perf::readings teardown;
+};
+
+/* Knobs changing how run_test_case performs the operations.
+ */
+struct run_options {
+    // Insert with the end() hint (see insert_hinted) instead of a plain insert.
+    bool hinted_inserts = false;
+    // Perform each maximal run of count operations at once, with count_all.
+    bool batched_counts = false;
+    // If not null, the count operations are also timed apart, and added here.
+    lookup_stats * stats = nullptr;
+    // Likewise for the range_scan operations.
+    scan_stats * scans = nullptr;
+    /* If not null, every operation is timed apart, and added here.
+     * Not to be used with batched_counts or stats.
+     */
+    latency_stats * latencies = nullptr;
+    // If not null, the hardware counters of the run are stored here.
+    perf_stats * counters = nullptr;
+    /* If not null, the operations are taken from here instead of the test case.
+     * Runs of count or bulk_load operations are cut at the end of each chunk.
+     */
+    operation_stream * stream = nullptr;
+};
+
+/* Performs the maximal run of count operations starting at 'first',
+ * as asked by 'options', and adds their results to 'counter'.
+ * 'keys' and 'results' are scratch buffers for batched counts.
+ * Returns the end of the run.
+ */
+template< typename Tree >
+const operation * run_counts( Tree & tree, const operation * first, const operation * end,
+        const run_options & options, std::vector<int> & keys, std::vector<int> & results,
+        int & counter )
+{
+    const operation * last = std::find_if( first, end,
+        []( const operation & o ){ return o.type != operation_type::count; });
+    auto begin = std::chrono::steady_clock::now();
+    if( options.batched_counts ) {
+        keys.clear();
+        for( const operation * op = first; op != last; ++op )
+            keys.push_back( op->key );
+        results.resize( keys.size() );
+        count_all( tree, keys.data(), keys.size(), results.data(), 0 );
+        for( int r : results )
+            counter += r;
+    }
+    else {
+        for( const operation * op = first; op != last; ++op )
+            counter += tree.count(op->key);
+    }
+    if( options.stats ) {
+        options.stats->lookups += last - first;
+        options.stats->time += std::chrono::steady_clock::now() - begin;
+    }
+    return last;
+}
+
 /* Runs the test case, constructing a new tree every time using the functor 'maker'.
  * Both construction and destruction times are timed.
  * 'runs' is the number of times the same test case is executed.
  * Each new run means a call to 'maker'.
  */
 template< typename TreeMaker >
-int run_test_case( TreeMaker maker, const test_case & test ) {
+int run_test_case( TreeMaker maker, test_view test,
+        const run_options & options = {} )
+{
     int counter = 0;
+    std::vector<int> keys, results; // Only used by batched counts.
+    perf::readings operations;
+    if( options.counters )
+        options.counters->group.start();
     auto begin = std::chrono::steady_clock::now();
     {
         auto tree = maker();
-        for( const operation & op : test ) {
-            switch( op.type ) {
+        test_view chunk = options.stream ? options.stream->next() : test;
+        for( ; !chunk.empty(); chunk = options.stream ? options.stream->next() : test_view() )
+        for( const operation * op = chunk.begin(), * end = chunk.end(); op != end; ++op ) {
+            const operation * first = op;
+            std::uint64_t start = options.latencies ? latency::clock::now() : 0;
+            switch( op->type ) {
                 case operation_type::insert:
-                    tree.insert(op.key);
+                    if( options.hinted_inserts )
+                        insert_hinted( tree, op->key, 0 );
+                    else
+                        tree.insert(op->key);
                     break;
                 case operation_type::erase:
-                    tree.erase(op.key);
+                    tree.erase(op->key);
                     break;
                 case operation_type::count:
-                    counter += tree.count(op.key); // To avoid compiler optimizations
+                    if( options.batched_counts || options.stats ) {
+                        op = run_counts( tree, op, end, options, keys, results, counter ) - 1;
+                        break;
+                    }
+                    counter += tree.count(op->key); // To avoid compiler optimizations
+                    break;
+                case operation_type::bulk_load: {
+                    const operation * run_end = std::find_if( op, end,
+                        []( const operation & o ){ return o.type != operation_type::bulk_load; });
+                    load_sorted( tree, key_iterator{op}, key_iterator{run_end}, 0 );
+                    op = run_end - 1;
+                    break;
+                }
+                case operation_type::rank:
+                    counter += rank_of( tree, op->key, 0 );
                     break;
+                case operation_type::range_scan:
+                    if( options.scans ) {
+                        auto begin = std::chrono::steady_clock::now();
+                        int keys = scan_range( tree, op->key, op->hi(), 0 );
+                        options.scans->time += std::chrono::steady_clock::now() - begin;
+                        options.scans->keys += keys;
+                        counter += keys;
+                        break;
+                    }
+                    counter += scan_range( tree, op->key, op->hi(), 0 );
+                    break;
+            }
+            if( options.latencies ) {
+                latency_stats & l = *options.latencies;
+                l.by_type[first->type].record( l.clock.elapsed_ns(start, latency::clock::now()) );
             }
         }
+        if( options.counters )
+            operations = options.counters->group.read();
     }
     auto end = std::chrono::steady_clock::now();
+    if( options.counters ) {
+        perf_stats & s = *options.counters;
+        s.group.stop();
+        s.operations = operations;
+        s.teardown = s.group.read() - operations;
+    }
 
     int ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
     return ms + (counter == 0);
 }
 
-/* Returns a random vector with exactly 'zeros' values set to 0
- * and exacly 'ones' values set to 1.
- * (I've choosen to use unsigned char instead of bool
- * to avoid the std::vector<bool> specialization.)
+/* The test cases below are generated by chunks, in parallel on 'threads' threads
+ * (see generation.hpp); they only depend on the seed, not on the threads.
  */
-std::vector<unsigned char> random_bits( int zeros, int ones, std::mt19937 & rng ) {
-    std::vector<unsigned char> ret( zeros + ones );
-    for( int i = 0; i < ones; i++ )
-        ret[i]++;
-    std::shuffle( ret.begin(), ret.end(), rng );
-    return ret;
+
+/* Writes, from position 'first' on, the searches [first, last)
+ * of a mix of 'search_successes' searches for the keys 2, 4, ..., 2*values
+ * and 'search_failures' searches for odd keys, in random order.
+ * Which searches succeed is given by 'mix', a permutation of the searches:
+ * exactly search_successes of them are mapped below search_successes.
+ */
+inline void fill_searches( operation * out, std::size_t first, std::size_t last,
+        const generation::random_permutation & mix, int values, int search_successes,
+        std::mt19937 & rng )
+{
+    std::uniform_int_distribution<> success(1, values);
+    std::uniform_int_distribution<> failure(0, values);
+    for( std::size_t i = first; i < last; i++ )
+        if( mix(i) < (std::uint64_t) search_successes )
+            out[i] = operation{ operation_type::count, 2*success(rng) };
+        else
+            out[i] = operation{ operation_type::count, 2*failure(rng) + 1};
 }
 
-/* Returns a test case which is a sequence of 'values' insertions,
- * and then a random mix of 'search_successes' searches for values actually inserted
- * and 'search_failures' searches for values never inserted.
+/* insert_then_search, with the insertions shuffled or not.
  */
-test_case insert_then_search(
+inline test_case keys_then_search(
     int values,
     int search_successes,
     int search_failures,
-    unsigned int seed
+    unsigned int seed,
+    unsigned threads,
+    bool shuffled
 ) {
-    std::mt19937 rng(seed);
-    test_case ret( values + search_successes + search_failures );
+    test_case ret( (std::size_t) values + search_successes + search_failures );
 
     /* Simple trick to guarantee success/failure:
      * the values inserted will all be even,
      * and the search failures will all be odd.
      *
      * To guarantee no value is inserted twice,
-     * we will simply insert all value from 2 to 2*values.
-     * and shuffle the operation.
+     * we will simply insert all value from 2 to 2*values,
+     * in the order of a random permutation.
      */
+    generation::random_permutation order( values, seed, 0 );
+    generation::random_permutation mix( search_successes + search_failures, seed, 1 );
+    generation::for_each_chunk( ret.size(), threads,
+        [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+            std::size_t inserts = std::min<std::size_t>( last, values );
+            for( std::size_t i = first; i < inserts; i++ )
+                ret[i] = operation{ operation_type::insert,
+                    2 * int(shuffled ? order(i) : i) + 2 };
+            if( inserts < last ) {
+                std::mt19937 rng = generation::chunk_rng( seed, chunk );
+                first = std::max<std::size_t>( first, values );
+                fill_searches( ret.data() + values, first - values, last - values,
+                        mix, values, search_successes, rng );
+            }
+        });
+    return ret;
+}
+
+/* Returns a test case which is a sequence of 'values' insertions,
+ * and then a random mix of 'search_successes' searches for values actually inserted
+ * and 'search_failures' searches for values never inserted.
+ */
+inline test_case insert_then_search(
+    int values,
+    int search_successes,
+    int search_failures,
+    unsigned int seed,
+    unsigned threads = 1
+) {
+    return keys_then_search( values, search_successes, search_failures, seed, threads, true );
+}
+
+inline test_case ascending_insert_then_search(
+    int values,
+    int search_successes,
+    int search_failures,
+    unsigned int seed,
+    unsigned threads = 1
+) {
+    return keys_then_search( values, search_successes, search_failures, seed, threads, false );
+}
+
+/* Same as ascending_insert_then_search,
+ * but the tree is built from all the keys at once, with bulk_load operations.
+ * The searches are the same for the same seed.
+ */
+inline test_case bulk_load_then_search(
+    int values,
+    int search_successes,
+    int search_failures,
+    unsigned int seed,
+    unsigned threads = 1
+) {
+    test_case ret = ascending_insert_then_search(
+            values, search_successes, search_failures, seed, threads );
     for( int i = 0; i < values; i++ )
-        ret[i] = operation{ operation_type::insert, 2 * i + 2 };
+        ret[i].type = operation_type::bulk_load;
+    return ret;
+}
 
-    std::shuffle( ret.begin(), ret.begin() + values, rng );
+/* Returns a test case which is a sequence of 'values' insertions,
+ * as in insert_then_search, and then 'queries' rank queries
+ * for keys uniformly distributed over the whole key range,
+ * half of them present in the tree.
+ */
+inline test_case rank_queries( int values, int queries, unsigned int seed,
+        unsigned threads = 1 )
+{
+    test_case ret( (std::size_t) values + queries );
+    generation::random_permutation order( values, seed, 0 );
+    generation::for_each_chunk( ret.size(), threads,
+        [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+            std::mt19937 rng = generation::chunk_rng( seed, chunk );
+            std::uniform_int_distribution<> key(1, 2 * values + 1);
+            for( std::size_t i = first; i < last; i++ )
+                if( i < (std::size_t) values )
+                    ret[i] = operation{ operation_type::insert, 2 * int(order(i)) + 2 };
+                else
+                    ret[i] = operation{ operation_type::rank, key(rng) };
+        });
+    return ret;
+}
 
-    std::uniform_int_distribution<> success(1, values);
-    std::uniform_int_distribution<> failure(0, values);
+/* Returns a test case which is a sequence of 'values' insertions,
+ * as in insert_then_search, and then 'scans' range scans,
+ * each visiting 'length' consecutive keys from a random starting point.
+ */
+inline test_case scan_workload( int values, int scans, int length, unsigned int seed,
+        unsigned threads = 1 )
+{
+    test_case ret( (std::size_t) values + scans );
+    generation::random_permutation order( values, seed, 0 );
+    generation::for_each_chunk( ret.size(), threads,
+        [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+            std::mt19937 rng = generation::chunk_rng( seed, chunk );
+            std::uniform_int_distribution<> start(1, std::max(1, values - length + 1));
+            for( std::size_t i = first; i < last; i++ )
+                if( i < (std::size_t) values )
+                    ret[i] = operation{ operation_type::insert, 2 * int(order(i)) + 2 };
+                else {
+                    int lo = 2 * start(rng);
+                    ret[i] = operation{ operation_type::range_scan, lo, lo + 2 * length };
+                }
+        });
+    return ret;
+}
 
-    auto bits = random_bits(search_failures, search_successes, rng);
-    for( int i = 0; i < search_successes + search_failures; i++ )
-        if( bits[i] )
-            ret[i + values] = operation{ operation_type::count, 2*success(rng) };
-        else
-            ret[i + values] = operation{ operation_type::count, 2*failure(rng) + 1};
+/* Returns a test case which is a sequence of 'insertions' insertions,
+ * as in insert_then_search, then 'removals' removals of distinct keys
+ * (at most as many as insertions), and then a random mix of searches
+ * for the keys left and for keys never inserted.
+ * The removed keys are the first ones of a second permutation of the keys,
+ * and the successful searches look for the other ones
+ * (for the removed ones, if every key was removed).
+ */
+inline test_case insert_then_remove_then_search(
+    int insertions,
+    int removals,
+    int search_successes,
+    int search_failures,
+    unsigned int seed,
+    unsigned threads = 1
+) {
+    removals = std::min( removals, insertions );
+    std::size_t searches_start = (std::size_t) insertions + removals;
+    test_case ret( searches_start + search_successes + search_failures );
+    generation::random_permutation insert_order( insertions, seed, 0 );
+    generation::random_permutation remove_order( insertions, seed, 1 );
+    generation::random_permutation mix( search_successes + search_failures, seed, 2 );
 
+    generation::for_each_chunk( ret.size(), threads,
+        [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+            std::mt19937 rng = generation::chunk_rng( seed, chunk );
+            std::uniform_int_distribution<> success_index(
+                    removals < insertions ? removals : 0, std::max(insertions - 1, 0) );
+            std::uniform_int_distribution<> failure(0, insertions);
+            for( std::size_t i = first; i < last; i++ ) {
+                if( i < (std::size_t) insertions )
+                    ret[i] = operation{ operation_type::insert,
+                        2 * int(insert_order(i)) + 2 };
+                else if( i < searches_start )
+                    ret[i] = operation{ operation_type::erase,
+                        2 * int(remove_order(i - insertions)) + 2 };
+                else if( mix(i - searches_start) < (std::uint64_t) search_successes )
+                    ret[i] = operation{ operation_type::count,
+                        2 * int(remove_order(success_index(rng))) + 2 };
+                else
+                    ret[i] = operation{ operation_type::count, 2*failure(rng) + 1 };
+            }
+        });
     return ret;
 }
 
-test_case ascending_insert_then_search(
-    int values,
+/* Returns a test case which is a sequence of 'initial_insertions' insertions,
+ * and then a random mix of the other insertions (up to 'total_insertions'),
+ * 'removals' removals of keys in the tree at that time,
+ * and 'search_successes' searches for keys in the tree
+ * and 'search_failures' for keys never inserted.
+ * A removal drawn while the tree is empty removes a key never inserted.
+ *
+ * The operations are drawn in parallel, each removal and successful search
+ * with random bits in place of its key; then a sequential pass
+ * replaces these bits with keys of the tree, drawn from a live_keys.
+ */
+inline test_case mixed_workload(
+    int initial_insertions,
+    int total_insertions,
+    int removals,
     int search_successes,
     int search_failures,
-    unsigned int seed
+    unsigned int seed,
+    unsigned threads = 1
 ) {
+    initial_insertions = std::min( initial_insertions, total_insertions );
+    test_case ret( (std::size_t) total_insertions + removals + search_successes + search_failures );
+    std::size_t later_insertions = total_insertions - initial_insertions;
+    std::size_t searches_start = later_insertions + removals;
+    generation::random_permutation order( total_insertions, seed, 0 );
+    generation::random_permutation mix( ret.size() - initial_insertions, seed, 1 );
+
+    // Operations whose key is still to be drawn; bytes, so that chunks can set them at once.
+    std::vector<std::uint8_t> pending( ret.size() );
+    generation::for_each_chunk( ret.size(), threads,
+        [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+            std::mt19937 rng = generation::chunk_rng( seed, chunk );
+            std::uniform_int_distribution<> failure(0, total_insertions);
+            for( std::size_t i = first; i < last; i++ ) {
+                if( i < (std::size_t) initial_insertions ) {
+                    ret[i] = operation{ operation_type::insert, 2 * int(order(i)) + 2 };
+                    continue;
+                }
+                std::uint64_t m = mix( i - initial_insertions );
+                if( m < later_insertions )
+                    ret[i] = operation{ operation_type::insert,
+                        2 * int(order(initial_insertions + m)) + 2 };
+                else if( m < searches_start ) {
+                    ret[i] = operation{ operation_type::erase, int(rng()) };
+                    pending[i] = true;
+                }
+                else if( m - searches_start < (std::uint64_t) search_successes ) {
+                    ret[i] = operation{ operation_type::count, int(rng()) };
+                    pending[i] = true;
+                }
+                else
+                    ret[i] = operation{ operation_type::count, 2*failure(rng) + 1 };
+            }
+        });
+
+    generation::live_keys live;
+    live.reserve( total_insertions );
+    for( std::size_t i = 0; i < ret.size(); i++ ) {
+        operation & op = ret[i];
+        if( op.type == operation_type::insert ) {
+            live.push( op.key );
+            continue;
+        }
+        if( !pending[i] )
+            continue;
+        std::uint32_t random = op.key;
+        if( live.empty() )
+            op.key = 2 * int(random % (total_insertions + 1u)) + 1;
+        else if( op.type == operation_type::erase )
+            op.key = live.take( live.index(random) );
+        else
+            op.key = live[live.index(random)];
+    }
+    return ret;
+}
+
+/* The set-ops test case does not fit in a list of operations:
+ * it measures the set operations of treap::treap
+ * (union_with, intersect_with and difference_with)
+ * against the per-key loops they replace.
+ *
+ * The tree holds the keys 2, 4, ..., 2*values, as in the other test cases.
+ * The batch is a sorted list of distinct keys from [1, 2*values+1],
+ * so about half of it is already in the tree.
+ */
+struct set_ops_case {
+    std::vector<int> tree_keys; // In insertion order.
+    std::vector<int> batch; // Sorted.
+};
+
+struct set_ops_times {
+    int union_ms;
+    int intersection_ms;
+    int difference_ms;
+};
+
+inline set_ops_case make_set_ops_case( int values, int batch_size, unsigned int seed ) {
     std::mt19937 rng(seed);
-    test_case ret( values + search_successes + search_failures );
+    set_ops_case ret;
+    ret.tree_keys.resize( values );
     for( int i = 0; i < values; i++ )
-        ret[i] = operation{ operation_type::insert, 2 * i + 2 };
+        ret.tree_keys[i] = 2 * i + 2;
+    std::shuffle( ret.tree_keys.begin(), ret.tree_keys.end(), rng );
 
-    std::uniform_int_distribution<> success(1, values);
-    std::uniform_int_distribution<> failure(0, values);
+    std::vector<int> candidates( 2 * values + 1 );
+    for( int i = 0; i < 2 * values + 1; i++ )
+        candidates[i] = i + 1;
+    std::shuffle( candidates.begin(), candidates.end(), rng );
+    candidates.resize( std::min<std::size_t>(batch_size, candidates.size()) );
+    std::sort( candidates.begin(), candidates.end() );
+    ret.batch = std::move(candidates);
+    return ret;
+}
 
-    auto bits = random_bits(search_failures, search_successes, rng);
-    for( int i = 0; i < search_successes + search_failures; i++ )
-        if( bits[i] )
-            ret[i + values] = operation{ operation_type::count, 2*success(rng) };
-        else
-            ret[i + values] = operation{ operation_type::count, 2*failure(rng) + 1};
+/* Largest number of keys the tree holds at once during the test case,
+ * to tell the memory cost per key.
+ */
+inline std::size_t peak_keys( test_view test ) {
+    std::unordered_set<int> keys;
+    std::size_t peak = 0;
+    for( const operation & op : test ) {
+        if( op.type == operation_type::insert || op.type == operation_type::bulk_load )
+            keys.insert( op.key );
+        else if( op.type == operation_type::erase )
+            keys.erase( op.key );
+        peak = std::max( peak, keys.size() );
+    }
+    return peak;
+}
+
+// Milliseconds elapsed since 'begin'.
+inline int elapsed_ms( std::chrono::steady_clock::time_point begin ) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - begin ).count();
+}
+
+/* Builds a tree with the given keys, using 'maker'.
+ */
+template< typename TreeMaker >
+auto build_tree( TreeMaker maker, const std::vector<int> & keys ) {
+    auto tree = maker();
+    for( int key : keys )
+        tree.insert( key );
+    return tree;
+}
 
+/* Times the per-key loops: inserting every batch key in the tree,
+ * erasing every batch key from the tree,
+ * and building the intersection by looking up every batch key.
+ * The trees are built before the clock starts,
+ * and destroyed after it stops.
+ */
+template< typename TreeMaker >
+set_ops_times run_set_ops_baseline( TreeMaker maker, const set_ops_case & c ) {
+    using clock = std::chrono::steady_clock;
+    set_ops_times ret;
+    {
+        auto tree = build_tree( maker, c.tree_keys );
+        auto begin = clock::now();
+        for( int key : c.batch )
+            tree.insert( key );
+        ret.union_ms = elapsed_ms(begin);
+    }
+    {
+        auto tree = build_tree( maker, c.tree_keys );
+        auto result = maker();
+        auto begin = clock::now();
+        for( int key : c.batch )
+            if( tree.count(key) )
+                result.insert(key);
+        ret.intersection_ms = elapsed_ms(begin);
+    }
+    {
+        auto tree = build_tree( maker, c.tree_keys );
+        auto begin = clock::now();
+        for( int key : c.batch )
+            tree.erase( key );
+        ret.difference_ms = elapsed_ms(begin);
+    }
     return ret;
 }
 
-/* Structure to efficiently pick a random number known to be in the tree.
+/* Times the set operations between the tree and a tree with the batch keys,
+ * running them on a fork_join::pool with 'threads' workers.
+ * As above, the trees are built before the clock starts,
+ * and destroyed after it stops.
  */
-struct efficiently_choose_target_to_remove {
-    std::vector<std::pair<int, bool>> keys;
-    // The boolean tells whether the specified key was already choosen or not.
-    int available_keys;
+template< typename TreeMaker >
+set_ops_times run_set_ops( TreeMaker maker, const set_ops_case & c, unsigned threads ) {
+    using clock = std::chrono::steady_clock;
+    fork_join::pool pool( threads );
+    set_ops_times ret;
+    {
+        auto tree = build_tree( maker, c.tree_keys );
+        auto batch = build_tree( maker, c.batch );
+        auto begin = clock::now();
+        pool.run( [&]{ tree.union_with(batch); } );
+        ret.union_ms = elapsed_ms(begin);
+    }
+    {
+        auto tree = build_tree( maker, c.tree_keys );
+        auto batch = build_tree( maker, c.batch );
+        auto begin = clock::now();
+        pool.run( [&]{ tree.intersect_with(batch); } );
+        ret.intersection_ms = elapsed_ms(begin);
+    }
+    {
+        auto tree = build_tree( maker, c.tree_keys );
+        auto batch = build_tree( maker, c.batch );
+        auto begin = clock::now();
+        pool.run( [&]{ tree.difference_with(batch); } );
+        ret.difference_ms = elapsed_ms(begin);
+    }
+    return ret;
+}
 
-    int get_key( std::mt19937 & rng ) {
-        std::uniform_int_distribution<> new_index(0, keys.size() - 1);
-        int index = new_index(rng);
-        while( !keys[index].second )
-            index = new_index(rng);
+/* The concurrent test case runs several lists of operations at once,
+ * one thread each, on a single tree filled beforehand
+ * with the keys 2, 4, ..., 2*values.
+ * It measures how the throughput scales with the threads.
+ */
 
-        int key = keys[index].first;
-        keys[index].second = false;
-        available_keys--;
+// Serializes every operation of Tree with a mutex, the usual way to share a tree.
+template< typename Tree >
+class locked {
+    Tree tree;
+    std::mutex m;
 
-        // Resize the vector
-        if( keys.size() > 2 * available_keys )
-            keys.erase( std::remove_if( keys.begin(), keys.end(),
-                        [](auto x){ return !x.second; }
-                        ));
+public:
+    explicit locked( Tree && tree ) : tree( std::move(tree) ) {}
 
-        return key;
+    void insert( int key ) {
+        std::lock_guard<std::mutex> lock( m );
+        tree.insert( key );
     }
 
-    int peek_key( std::mt19937 & rng ) {
-        std::uniform_int_distribution<> new_index(0, keys.size() - 1);
-        int index = new_index(rng);
-        while( !keys[index].second )
-            index = new_index(rng);
-        return keys[index].first;
+    void erase( int key ) {
+        std::lock_guard<std::mutex> lock( m );
+        tree.erase( key );
     }
 
-    void push_key( int key ) {
-        keys.push_back( std::make_pair(key, true) );
-        available_keys++;
+    int count( int key ) {
+        std::lock_guard<std::mutex> lock( m );
+        return tree.count( key );
     }
 };
 
-test_case insert_then_remove_then_search(
-    int insertions,
-    int removals,
-    int search_successes,
-    int search_failures,
-    unsigned int seed
+/* Returns 'threads' lists of 'ops' operations each,
+ * on keys drawn uniformly from [1, 2*values]:
+ * counts with probability read_ratio, and else inserts and erases, evenly.
+ * The lists are generated by chunks, as the test cases above.
+ */
+inline std::vector<test_case> concurrent_workload(
+    int values,
+    int ops,
+    double read_ratio,
+    unsigned threads,
+    unsigned int seed,
+    unsigned generation_threads = 1
 ) {
-    std::mt19937 rng(seed);
-    test_case ret( insertions + search_successes + search_failures + removals );
-    auto rem = efficiently_choose_target_to_remove{
-        std::vector<std::pair<int,bool>>(insertions),
-        insertions
-    };
+    std::vector<test_case> ret( threads, test_case(ops) );
+    generation::for_each_chunk( (std::size_t) threads * ops, generation_threads,
+        [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+            std::mt19937 rng = generation::chunk_rng( seed, chunk );
+            std::uniform_int_distribution<> key(1, 2 * values);
+            std::bernoulli_distribution read(read_ratio);
+            for( std::size_t i = first; i < last; i++ ) {
+                operation & op = ret[i / ops][i % ops];
+                if( read(rng) )
+                    op.type = operation_type::count;
+                else
+                    op.type = rng() % 2 ? operation_type::insert : operation_type::erase;
+                op.key = key(rng);
+            }
+        });
+    return ret;
+}
 
-    // Generate the insertions
-    for( int i = 0; i < insertions; i++ ) {
-        ret[i] = operation{ operation_type::insert, 2 * i + 2 };
-        rem.keys[i] = std::make_pair( 2 * i + 2, true );
-    }
-    std::shuffle( ret.begin(), ret.begin() + insertions, rng );
+/* Builds a tree with 'maker', fills it with the keys 2, 4, ..., 2*values,
+ * and runs the first 'threads' lists at once, one thread each.
+ * The tree must be safe to share (see locked).
+ * Returns the time, in milliseconds, from the start of the threads to the end of the last.
+ */
+template< typename TreeMaker >
+int run_concurrent( TreeMaker maker, int values, const std::vector<test_case> & lists,
+        unsigned threads )
+{
+    auto tree = maker();
+    for( int i = 1; i <= values; i++ )
+        tree.insert( 2 * i );
 
-    // Generate the removals
-    for( int i = 0; i < removals; i++ )
-        ret[i+insertions] = operation{ operation_type::erase, rem.get_key(rng) };
+    std::atomic<unsigned> ready{0};
+    std::vector<int> counters( threads ); // To avoid compiler optimizations.
+    std::vector<std::thread> workers;
+    for( unsigned t = 0; t < threads; t++ )
+        workers.emplace_back( [&, t]{
+            ready++;
+            while( ready.load() < threads )
+                std::this_thread::yield(); // Start together.
+            int counter = 0;
+            for( const operation & op : lists[t] ) {
+                switch( op.type ) {
+                    case operation_type::insert:
+                        tree.insert( op.key );
+                        break;
+                    case operation_type::erase:
+                        tree.erase( op.key );
+                        break;
+                    default:
+                        counter += tree.count( op.key );
+                }
+            }
+            counters[t] = counter;
+        });
+    while( ready.load() < threads )
+        std::this_thread::yield();
+    auto begin = std::chrono::steady_clock::now();
+    for( std::thread & w : workers )
+        w.join();
+    int ms = elapsed_ms( begin );
+    int counter = 0;
+    for( int c : counters )
+        counter += c;
+    return ms + (counter == -1);
+}
 
-    // Generate the searches
-    std::uniform_int_distribution<> success_index(0, rem.keys.size()-1);
-    std::uniform_int_distribution<> failure(0, insertions);
+/* Pins the calling thread to the given CPU.
+ * Returns false where that is not supported.
+ */
+inline bool pin_to_cpu( unsigned cpu ) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu % CPU_SETSIZE, &set );
+    return pthread_setaffinity_np( pthread_self(), sizeof(set), &set ) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
 
-    auto bits = random_bits(search_failures, search_successes, rng);
-    for( int i = 0; i < search_successes + search_failures; i++ )
-        if( bits[i] )
-            ret[i + insertions+removals] =
-                operation{ operation_type::count, rem.keys[success_index(rng)].first };
-        else
-            ret[i + insertions+removals] =
-                operation{ operation_type::count, 2*failure(rng) + 1};
+// Times of run_replicas.
+struct replica_times {
+    std::vector<int> ms; // Of each replica, as returned by 'run'.
+    int wall_ms = 0;     // From the start of the replicas to the end of the last.
+};
 
+/* Runs 'replicas' independent copies of the test case at once, one thread each,
+ * thread i pinned to CPU i modulo the number of hardware threads.
+ * Each thread makes its own copy of the test case, so that it lives
+ * in the memory closest to its CPU, and then calls run(copy),
+ * which builds and runs its own tree, as run_test_case.
+ * The copies are made before the clock starts.
+ */
+template< typename Run >
+replica_times run_replicas( Run run, test_view test, unsigned replicas ) {
+    unsigned cpus = std::max( 1u, std::thread::hardware_concurrency() );
+    replica_times ret;
+    ret.ms.resize( replicas );
+    std::atomic<unsigned> ready{0};
+    std::vector<std::thread> workers;
+    for( unsigned r = 0; r < replicas; r++ )
+        workers.emplace_back( [&, r]{
+            pin_to_cpu( r % cpus );
+            test_case copy( test.begin(), test.end() );
+            ready++;
+            while( ready.load() < replicas )
+                std::this_thread::yield(); // Start together.
+            ret.ms[r] = run( copy );
+        });
+    while( ready.load() < replicas )
+        std::this_thread::yield();
+    auto begin = std::chrono::steady_clock::now();
+    for( std::thread & w : workers )
+        w.join();
+    ret.wall_ms = elapsed_ms( begin );
     return ret;
 }
 
-test_case mixed_workload(
-    int initial_insertions,
-    int total_insertions,
-    int removals,
-    int search_successes,
-    int search_failures,
-    unsigned int seed
-) {
-    std::mt19937 rng(seed);
-    test_case ret( total_insertions + removals + search_successes + search_failures );
-    auto rem = efficiently_choose_target_to_remove{
-        std::vector<std::pair<int,bool>>(initial_insertions),
-        initial_insertions
-    };
+// What run_sharded saw of the shards.
+struct sharding_stats {
+    std::vector<sharded::shard_load> loads; // Of the last run.
+    int rebalances = 0;
+    long long moved_keys = 0;
+};
 
-    for( int i = 0; i < total_insertions; i++ )
-        ret[i] = operation{ operation_type::insert, 2 * i + 2 };
-    std::shuffle( ret.begin(), ret.begin() + total_insertions, rng );
-    /* The first initial_insertions values will not be changed anymore.
-     * The other values will be shuffled together with the other values.
-     */
+/* Runs the test case through a sharded::sharded tree
+ * with 'shards' shards made by 'maker', split over the key range of the test case.
+ * Only insertions, removals and searches are supported;
+ * bulk loads are done as plain insertions,
+ * and std::invalid_argument is thrown for rank queries and range scans.
+ * Returns the time, in milliseconds, including construction and destruction,
+ * as run_test_case; if 'stats' is not null, the shard loads are stored there.
+ */
+template< typename TreeMaker >
+int run_sharded( TreeMaker maker, test_view test, std::size_t shards,
+        sharding_stats * stats = nullptr )
+{
+    if( contains(test, operation_type::rank) || contains(test, operation_type::range_scan) )
+        throw std::invalid_argument( "run_sharded: rank queries and range scans are not supported" );
 
-    for( int i = 0; i < initial_insertions; i++ )
-        rem.keys[i] = std::make_pair( ret[i].key, true );
-    // rem is usable.
-
-    for( int i = 0; i < removals; i++ )
-        ret[i+total_insertions].type = operation_type::erase;
-    for( int i = 0; i < search_successes + search_failures; i++ )
-        ret[i+total_insertions+removals].type = operation_type::count;
-    std::shuffle( ret.begin()+initial_insertions, ret.end(), rng );
-    /* All the operation types are correctly set,
-     * and every insert operation has the correct key set.
-     * Now, we will set the keys of the removals and the searches.
-     */
+    int lo = 0, hi = 0;
+    if( !test.empty() ) {
+        auto keys = std::minmax_element( test.begin(), test.end(),
+            []( const operation & a, const operation & b ){ return a.key < b.key; });
+        lo = keys.first->key;
+        hi = keys.second->key;
+    }
 
-    auto bits = random_bits(search_failures, search_successes, rng);
-    int decision = 0;
-
-    std::uniform_int_distribution<> failure(0, total_insertions);
-
-    for( int i = initial_insertions; i < ret.size(); i++ ) {
-        switch( ret[i].type ) {
-            case operation_type::insert:
-                rem.push_key( ret[i].key );
-                break;
-            case operation_type::erase:
-                ret[i].key = rem.get_key(rng);
-                break;
-            case operation_type::count:
-                if( bits[decision++] )
-                    ret[i].key = rem.peek_key(rng);
-                else
-                    ret[i].key = 2*failure(rng) + 1;
-                break;
+    long long counter = 0;
+    auto begin = std::chrono::steady_clock::now();
+    {
+        sharded::sharded<decltype(maker())> tree( maker, shards, lo, hi );
+        for( const operation & op : test ) {
+            switch( op.type ) {
+                case operation_type::insert:
+                case operation_type::bulk_load:
+                    tree.submit( sharded::op_kind::insert, op.key );
+                    break;
+                case operation_type::erase:
+                    tree.submit( sharded::op_kind::erase, op.key );
+                    break;
+                case operation_type::count:
+                    tree.submit( sharded::op_kind::count, op.key );
+                    break;
+                default:
+                    break; // Refused above.
+            }
+        }
+        counter = tree.drain();
+        if( stats ) {
+            stats->loads = tree.loads();
+            stats->rebalances = tree.rebalance_count();
+            stats->moved_keys = tree.moved_keys();
         }
     }
-
-    return ret;
+    int ms = elapsed_ms( begin );
+    return ms + (counter == -1);
 }
 
 #endif // SPEED_TEST_HPP
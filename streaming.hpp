@@ -0,0 +1,361 @@
+#ifndef STREAMING_HPP
+#define STREAMING_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "generation.hpp"
+#include "speed_test.hpp"
+
+/* Test cases generated on the fly, in chunks, instead of up front.
+ *
+ * The generators follow the distributions of the test cases of speed_test.hpp
+ * (the same operation counts, key ranges and mixes) without storing the
+ * operations: the shuffled insertions come from a random permutation computed
+ * on demand, and the random mixes are drawn one operation at a time.
+ * Their memory does not grow with the number of operations, so that
+ * soak tests of billions of operations fit in memory;
+ * mixed_workload still keeps the keys inserted and not removed yet,
+ * which are as many as the keys of the tree.
+ *
+ * double_buffer runs a generator on a background thread,
+ * filling a chunk while run_test_case performs the other one.
+ */
+namespace streaming {
+    class generator {
+    public:
+        virtual ~generator() = default;
+
+        /* Writes the next operations, at most 'max', to 'out'.
+         * Returns how many were written; 0 once all were generated.
+         */
+        virtual std::size_t fill( operation * out, std::size_t max ) = 0;
+    };
+
+    /* Generator of a known number of operations,
+     * each one returned by Derived::next.
+     */
+    template< typename Derived >
+    class counted_generator : public generator {
+        long long left; // Operations not generated yet.
+
+    public:
+        explicit counted_generator( long long total ) : left(total) {}
+
+        std::size_t fill( operation * out, std::size_t max ) override {
+            std::size_t n = std::min<long long>( max, left );
+            for( std::size_t i = 0; i < n; i++ )
+                out[i] = static_cast<Derived *>(this)->next();
+            left -= n;
+            return n;
+        }
+    };
+
+    /* Draws the categories of a random shuffle of counts[c] items
+     * of each category c, one item at a time, without storing the shuffle:
+     * every order is equally likely, as with std::shuffle.
+     */
+    template< std::size_t N >
+    class shuffled_counts {
+        std::array<long long, N> counts;
+        long long total = 0;
+
+    public:
+        explicit shuffled_counts( const std::array<long long, N> & counts ) : counts(counts) {
+            for( long long c : counts )
+                total += c;
+        }
+
+        // Category of the next item; there must be one left.
+        template< typename RNG >
+        std::size_t next( RNG & rng ) {
+            long long pick = std::uniform_int_distribution<long long>( 0, total - 1 )( rng );
+            std::size_t c = 0;
+            while( pick >= counts[c] )
+                pick -= counts[c++];
+            counts[c]--;
+            total--;
+            return c;
+        }
+
+        long long left( std::size_t c ) const {
+            return counts[c];
+        }
+    };
+
+    /* Streamed insert_then_search,
+     * or ascending_insert_then_search if 'ascending' is set.
+     */
+    class insert_then_search : public counted_generator<insert_then_search> {
+        std::mt19937 rng;
+        generation::random_permutation order;
+        bool ascending;
+        long long values;
+        long long inserted = 0;
+        shuffled_counts<2> searches; // Failures, then successes.
+        std::uniform_int_distribution<> success, failure;
+
+    public:
+        insert_then_search( int values, int search_successes, int search_failures,
+                unsigned int seed, bool ascending = false ) :
+            counted_generator( (long long) values + search_successes + search_failures ),
+            rng(seed), order(values, seed, 0), ascending(ascending), values(values),
+            searches({search_failures, search_successes}), success(1, values), failure(0, values)
+        {}
+
+        operation next() {
+            if( inserted < values ) {
+                long long i = inserted++;
+                return operation{ operation_type::insert,
+                    2 * int(ascending ? i : order(i)) + 2 };
+            }
+            if( searches.next(rng) )
+                return operation{ operation_type::count, 2*success(rng) };
+            return operation{ operation_type::count, 2*failure(rng) + 1 };
+        }
+    };
+
+    /* Streamed insert_then_remove_then_search.
+     * The removed keys are the first ones of a second random permutation,
+     * and the successful searches look for the other ones.
+     * There are at most as many removals as insertions.
+     */
+    class insert_then_remove_then_search :
+        public counted_generator<insert_then_remove_then_search>
+    {
+        std::mt19937 rng;
+        generation::random_permutation insert_order, remove_order;
+        long long insertions, removals;
+        long long done = 0;
+        shuffled_counts<2> searches;
+        std::uniform_int_distribution<long long> success_index;
+        std::uniform_int_distribution<> failure;
+
+    public:
+        insert_then_remove_then_search( int insertions, int removals,
+                int search_successes, int search_failures, unsigned int seed ) :
+            counted_generator( (long long) insertions + std::min(removals, insertions)
+                    + search_successes + search_failures ),
+            rng(seed), insert_order(insertions, seed, 0), remove_order(insertions, seed, 1),
+            insertions(insertions), removals(std::min(removals, insertions)),
+            searches({search_failures, search_successes}),
+            // With every key removed, the searches look for the removed keys.
+            success_index(this->removals < insertions ? this->removals : 0,
+                    std::max(insertions - 1, 0)),
+            failure(0, insertions)
+        {}
+
+        operation next() {
+            long long i = done++;
+            if( i < insertions )
+                return operation{ operation_type::insert, 2 * int(insert_order(i)) + 2 };
+            if( i < insertions + removals )
+                return operation{ operation_type::erase,
+                    2 * int(remove_order(i - insertions)) + 2 };
+            if( searches.next(rng) )
+                return operation{ operation_type::count,
+                    2 * int(remove_order(success_index(rng))) + 2 };
+            return operation{ operation_type::count, 2*failure(rng) + 1 };
+        }
+    };
+
+    /* Streamed mixed_workload: 'initial_insertions' insertions,
+     * then the other insertions, the removals and the searches, randomly mixed.
+     * A removal drawn while the tree is empty removes a key never inserted.
+     */
+    class mixed_workload : public counted_generator<mixed_workload> {
+        enum { insert_op, erase_op, count_op };
+
+        std::mt19937 rng;
+        generation::random_permutation order;
+        long long initial_insertions;
+        long long inserted = 0;
+        generation::live_keys live;
+        shuffled_counts<3> mix;
+        shuffled_counts<2> searches;
+        std::uniform_int_distribution<> failure;
+
+        operation insert() {
+            int key = 2 * int(order(inserted++)) + 2;
+            live.push( key );
+            return operation{ operation_type::insert, key };
+        }
+
+    public:
+        mixed_workload( int initial_insertions, int total_insertions, int removals,
+                int search_successes, int search_failures, unsigned int seed ) :
+            counted_generator( (long long) total_insertions + removals
+                    + search_successes + search_failures ),
+            rng(seed), order(total_insertions, seed, 0),
+            initial_insertions(std::min(initial_insertions, total_insertions)),
+            mix({total_insertions - this->initial_insertions, removals,
+                    (long long) search_successes + search_failures}),
+            searches({search_failures, search_successes}),
+            failure(0, total_insertions)
+        {}
+
+        operation next() {
+            if( inserted < initial_insertions )
+                return insert();
+            switch( mix.next(rng) ) {
+                case insert_op:
+                    return insert();
+                case erase_op:
+                    if( live.empty() )
+                        return operation{ operation_type::erase, 2*failure(rng) + 1 };
+                    return operation{ operation_type::erase, live.take(live.index(rng())) };
+                default:
+                    if( searches.next(rng) && !live.empty() )
+                        return operation{ operation_type::count, live[live.index(rng())] };
+                    return operation{ operation_type::count, 2*failure(rng) + 1 };
+            }
+        }
+    };
+
+    // Streamed rank_queries.
+    class rank_queries : public counted_generator<rank_queries> {
+        std::mt19937 rng;
+        generation::random_permutation order;
+        long long values;
+        long long inserted = 0;
+        std::uniform_int_distribution<> key;
+
+    public:
+        rank_queries( int values, int queries, unsigned int seed ) :
+            counted_generator( (long long) values + queries ),
+            rng(seed), order(values, seed, 0), values(values), key(1, 2 * values + 1)
+        {}
+
+        operation next() {
+            if( inserted < values )
+                return operation{ operation_type::insert, 2 * int(order(inserted++)) + 2 };
+            return operation{ operation_type::rank, key(rng) };
+        }
+    };
+
+    // Streamed scan_workload.
+    class scan_workload : public counted_generator<scan_workload> {
+        std::mt19937 rng;
+        generation::random_permutation order;
+        long long values;
+        long long inserted = 0;
+        int length;
+        std::uniform_int_distribution<> start;
+
+    public:
+        scan_workload( int values, int scans, int length, unsigned int seed ) :
+            counted_generator( (long long) values + scans ),
+            rng(seed), order(values, seed, 0), values(values), length(length),
+            start(1, std::max(1, values - length + 1))
+        {}
+
+        operation next() {
+            if( inserted < values )
+                return operation{ operation_type::insert, 2 * int(order(inserted++)) + 2 };
+            int lo = 2 * start(rng);
+            return operation{ operation_type::range_scan, lo, lo + 2 * length };
+        }
+    };
+
+    /* Stream of the operations of a generator, in chunks of 'chunk_size',
+     * generated on a background thread while the previous chunk is used.
+     * The generator must outlive the buffer.
+     */
+    class double_buffer : public operation_stream {
+        generator & source;
+        std::vector<operation> buffers[2];
+        std::size_t sizes[2] = {0, 0};
+        bool full[2] = {false, false};
+        int next_buffer = 0;   // Next buffer to hand out.
+        bool handed = false;   // Whether the other buffer is still in use.
+        bool stopping = false;
+        long long delivered = 0;
+        std::chrono::steady_clock::duration waited{};
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::thread producer;
+
+        void produce() {
+            for( int b = 0; ; b ^= 1 ) {
+                {
+                    std::unique_lock<std::mutex> lock( mutex );
+                    changed.wait( lock, [&]{ return !full[b] || stopping; } );
+                    if( stopping )
+                        return;
+                }
+                std::size_t n = source.fill( buffers[b].data(), buffers[b].size() );
+                {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    sizes[b] = n;
+                    full[b] = true;
+                }
+                changed.notify_all();
+                if( n == 0 )
+                    return;
+            }
+        }
+
+    public:
+        double_buffer( generator & source, std::size_t chunk_size = 1 << 16 ) :
+            source(source), buffers{ std::vector<operation>(chunk_size),
+                std::vector<operation>(chunk_size) },
+            producer( [this]{ produce(); } )
+        {}
+
+        ~double_buffer() {
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                stopping = true;
+            }
+            changed.notify_all();
+            producer.join();
+        }
+
+        double_buffer( const double_buffer & ) = delete;
+        double_buffer & operator=( const double_buffer & ) = delete;
+
+        /* Hands out the next chunk, giving back the previous one to the producer.
+         * Waits if the producer has not filled it yet.
+         */
+        test_view next() override {
+            std::unique_lock<std::mutex> lock( mutex );
+            if( handed ) {
+                full[next_buffer ^ 1] = false;
+                handed = false;
+                changed.notify_all();
+            }
+            int b = next_buffer;
+            if( !full[b] ) {
+                auto begin = std::chrono::steady_clock::now();
+                changed.wait( lock, [&]{ return full[b]; } );
+                waited += std::chrono::steady_clock::now() - begin;
+            }
+            if( sizes[b] == 0 )
+                return test_view();
+            next_buffer ^= 1;
+            handed = true;
+            delivered += sizes[b];
+            return test_view( buffers[b].data(), sizes[b] );
+        }
+
+        // Operations handed out so far.
+        long long operations() const {
+            return delivered;
+        }
+
+        // Time next spent waiting for the producer.
+        std::chrono::steady_clock::duration stalled() const {
+            return waited;
+        }
+    };
+}
+
+#endif // STREAMING_HPP
@@ -1,5 +1,10 @@
 #include "avl.hpp"
 #include <catch.hpp>
+#include <random>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
 
 bool is_avl( const std::unique_ptr<avl::node> & tree ) {
     if( !tree )
@@ -9,6 +14,19 @@ bool is_avl( const std::unique_ptr<avl::node> & tree ) {
     return is_avl( tree->lchild ) && is_avl( tree->rchild );
 }
 
+/* Checks both the balance and whether the stored heights are correct.
+ * Returns the real height of the tree, or -2 if something is wrong.
+ */
+int checked_height( const std::unique_ptr<avl::node> & tree ) {
+    if( !tree )
+        return -1;
+    int l = checked_height( tree->lchild );
+    int r = checked_height( tree->rchild );
+    if( l == -2 || r == -2 || std::abs(l - r) > 1 || tree->h != std::max(l, r) + 1 )
+        return -2;
+    return tree->h;
+}
+
 TEST_CASE( "AVL height and rotation", "[avl]" ) {
     auto tree = 
         std::make_unique<avl::node>( 10,
@@ -131,3 +149,205 @@ TEST_CASE( "AVL std::set-like interface", "[avl]" ) {
     CHECK( tree.count(3) == 1 );
     CHECK( tree.count(12) == 0 );
 }
+
+TEST_CASE( "AVL with the pool allocator", "[avl]" ) {
+    avl::avl<int, void, std::less<int>, pool_allocator> tree;
+    for( int i = 0; i < 10000; i++ )
+        tree.insert( (i * 7919) % 10000 );
+    for( int i = 0; i < 10000; i += 2 )
+        tree.erase( i );
+    for( int i = 0; i < 5000; i++ )
+        tree.insert( 10000 + i );
+
+    CHECK( tree.count(0) == 0 );
+    CHECK( tree.count(1) == 1 );
+    CHECK( tree.count(9998) == 0 );
+    CHECK( tree.count(9999) == 1 );
+    CHECK( tree.count(14999) == 1 );
+    CHECK( tree.count(15000) == 0 );
+}
+
+TEST_CASE( "AVL random insertions and removals", "[avl]" ) {
+    std::unique_ptr<avl::node> tree;
+    std::set<int> reference;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 1000);
+
+    for( int i = 0; i < 10000; i++ ) {
+        int k = key(rng);
+        if( rng() % 3 ) {
+            avl::insert( tree, k );
+            reference.insert( k );
+        }
+        else {
+            avl::remove( tree, k );
+            reference.erase( k );
+        }
+        REQUIRE( checked_height(tree) != -2 );
+    }
+    for( int k = 0; k <= 1000; k++ )
+        CHECK( avl::contains(tree, k) == (reference.count(k) == 1) );
+}
+
+TEST_CASE( "AVL built from a sorted range", "[avl]" ) {
+    std::vector<int> keys;
+    for( int i = 0; i < 1000; i++ )
+        keys.push_back( 3 * i );
+
+    for( int n : {0, 1, 2, 3, 7, 8, 1000} ) {
+        auto first = keys.begin();
+        malloc_arena<avl::node> arena;
+        auto tree = avl::build_sorted( first, n, arena );
+        CHECK( first == keys.begin() + n );
+        REQUIRE( checked_height(tree) != -2 );
+        for( int k = 0; k < 3001; k++ )
+            CHECK( avl::contains(tree, k) == (k % 3 == 0 && k < 3 * n) );
+    }
+
+    avl::avl<int, void, std::less<int>, pool_allocator> tree;
+    tree.insert( 1 );
+    tree.assign_sorted( keys.begin(), keys.end() );
+    CHECK( tree.count(1) == 0 );
+    CHECK( tree.count(2997) == 1 );
+    tree.insert( 1 );
+    tree.erase( 0 );
+    CHECK( tree.count(1) == 1 );
+    CHECK( tree.count(0) == 0 );
+}
+
+TEST_CASE( "AVL split and join", "[avl]" ) {
+    std::mt19937 rng(0);
+    for( int n : {0, 1, 2, 10, 100, 1000} ) {
+        for( int key : {-1, 0, n / 3, n / 2, n, n + 1} ) {
+            std::unique_ptr<avl::node> tree, left, right;
+            for( int i = 0; i < n; i++ )
+                avl::insert( tree, (int) (rng() % (2 * n + 1)) );
+            std::set<int> reference;
+            for( int k = 0; k <= 2 * n; k++ )
+                if( avl::contains(tree, k) )
+                    reference.insert( k );
+
+            avl::split( tree, key, left, right );
+            CHECK( !tree );
+            REQUIRE( checked_height(left) != -2 );
+            REQUIRE( checked_height(right) != -2 );
+            for( int k = 0; k <= 2 * n; k++ ) {
+                bool present = reference.count(k) == 1;
+                REQUIRE( avl::contains(left, k) == (present && k < key) );
+                REQUIRE( avl::contains(right, k) == (present && k >= key) );
+            }
+
+            tree = avl::concat( std::move(left), std::move(right) );
+            REQUIRE( checked_height(tree) != -2 );
+            for( int k = 0; k <= 2 * n; k++ )
+                REQUIRE( avl::contains(tree, k) == (reference.count(k) == 1) );
+        }
+    }
+
+    // Joining trees of very different heights.
+    std::unique_ptr<avl::node> small, big;
+    avl::insert( small, 1 );
+    for( int k = 10; k < 5000; k++ )
+        avl::insert( big, k );
+    auto tree = avl::join( std::move(small), std::make_unique<avl::node>(5), std::move(big) );
+    REQUIRE( checked_height(tree) != -2 );
+    CHECK( avl::contains(tree, 1) );
+    CHECK( avl::contains(tree, 5) );
+    CHECK( avl::contains(tree, 4999) );
+}
+
+TEST_CASE( "AVL insertion with a finger", "[avl]" ) {
+    std::unique_ptr<avl::node> tree;
+    malloc_arena<avl::node> arena;
+    avl::finger<std::unique_ptr<avl::node>> f;
+    std::set<int> reference;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 100000);
+
+    // Ascending, then descending, then random runs, reusing the same finger.
+    for( int i = 0; i < 3000; i++ ) {
+        int k;
+        if( i < 1000 )
+            k = 2 * i;
+        else if( i < 2000 )
+            k = 4001 - 2 * (i - 1000);
+        else
+            k = key(rng);
+        avl::node * n = avl::insert_with_finger( tree, k, arena, f ).first;
+        reference.insert( k );
+        REQUIRE( n->key == k );
+        REQUIRE( checked_height(tree) != -2 );
+    }
+    // Inserting an existing key changes nothing.
+    CHECK( avl::insert_with_finger( tree, 10, arena, f ).first->key == 10 );
+    CHECK( checked_height(tree) != -2 );
+    for( int k = 0; k <= 100000; k++ )
+        CHECK( avl::contains(tree, k) == (reference.count(k) == 1) );
+
+    // The class resets its finger whenever the tree changes otherwise.
+    avl::avl<int, void, std::less<int>, pool_allocator> t;
+    for( int i = 0; i < 1000; i++ )
+        t.insert( t.end(), i );
+    t.erase( 999 );
+    t.insert( 500 );
+    for( int i = 999; i < 2000; i++ )
+        CHECK( t.insert( t.end(), i )->key == i );
+    for( int i = 0; i < 2000; i++ )
+        CHECK( t.count(i) == 1 );
+}
+
+namespace {
+    // Counts the live instances, to check that maps destroy their values.
+    struct tracked {
+        static int live;
+        std::unique_ptr<int> value; // Move-only.
+        tracked( int v ) : value(std::make_unique<int>(v)) { live++; }
+        ~tracked() { live--; }
+    };
+    int tracked::live = 0;
+}
+
+TEST_CASE( "AVL map interface", "[avl]" ) {
+    avl::avl<std::uint64_t, std::string> map;
+    map[10] = "ten";
+    map[1ull << 40] = "big";
+    CHECK( map.emplace(10, "other").second == false );
+    CHECK( *map.emplace(10, "other").first == "ten" );
+    CHECK( map.emplace(3, 2, 'x').second == true );
+    CHECK( *map.find(3) == "xx" );
+    CHECK( *map.find(1ull << 40) == "big" );
+    CHECK( map.find(4) == nullptr );
+    CHECK( map.count(10) == 1 );
+    map.erase( 10 );
+    CHECK( map.find(10) == nullptr );
+    CHECK( map[10].empty() );
+
+    avl::avl<int, int, std::greater<int>> descending;
+    for( int i = 0; i < 100; i++ )
+        descending.insert( descending.end(), 100 - i );
+    for( int i = 1; i <= 100; i++ )
+        descending[i] += i;
+    for( int i = 1; i <= 100; i++ )
+        CHECK( *descending.find(i) == i );
+}
+
+TEST_CASE( "AVL map with move-only values", "[avl]" ) {
+    SECTION( "malloc" ) {
+        avl::avl<int, tracked> map;
+        for( int i = 0; i < 1000; i++ )
+            map.emplace( i, i * i );
+        for( int i = 0; i < 1000; i += 2 )
+            map.erase( i );
+        CHECK( tracked::live == 500 );
+        CHECK( *map.find(999)->value == 999 * 999 );
+    }
+    CHECK( tracked::live == 0 );
+
+    SECTION( "pool" ) {
+        avl::avl<int, tracked, std::less<int>, pool_allocator> map;
+        for( int i = 0; i < 1000; i++ )
+            map.emplace( i, i );
+        CHECK( tracked::live == 1000 );
+    }
+    CHECK( tracked::live == 0 );
+}
@@ -0,0 +1,61 @@
+#include "batch_lookup.hpp"
+#include "avl.hpp"
+#include "compact_avl.hpp"
+#include "compact_treap.hpp"
+#include "frozen.hpp"
+#include "treap.hpp"
+#include "xorshift.hpp"
+#include <catch.hpp>
+#include <random>
+#include <set>
+#include <vector>
+
+/* Fills the tree with random keys, and checks count_batch against count
+ * for batches of several sizes, including partial groups.
+ */
+template< typename Tree >
+void check_count_batch( Tree & tree ) {
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 3000);
+
+    std::vector<int> keys( 1000 ), out( 1000 );
+    for( int & k : keys )
+        k = key(rng);
+    tree.count_batch( keys.data(), keys.size(), out.data() ); // Empty tree.
+    for( int r : out )
+        REQUIRE( r == 0 );
+
+    for( int i = 0; i < 1000; i++ )
+        tree.insert( key(rng) );
+    for( std::size_t n : {0, 1, 15, 16, 17, 1000} ) {
+        std::fill( out.begin(), out.end(), -1 );
+        tree.count_batch( keys.data(), n, out.data() );
+        for( std::size_t i = 0; i < n; i++ )
+            REQUIRE( out[i] == tree.count(keys[i]) );
+        for( std::size_t i = n; i < out.size(); i++ )
+            REQUIRE( out[i] == -1 );
+    }
+}
+
+TEST_CASE( "Batched lookups agree with count", "[batch_lookup]" ) {
+    SECTION( "avl" ) {
+        avl::avl<int, void, std::less<int>, pool_allocator> tree;
+        check_count_batch( tree );
+    }
+    SECTION( "treap" ) {
+        treap::treap<> tree{std::mt19937{}};
+        check_count_batch( tree );
+    }
+    SECTION( "compact avl" ) {
+        compact_avl::avl tree;
+        check_count_batch( tree );
+    }
+    SECTION( "compact treap" ) {
+        compact_treap::treap<xorshift> tree{xorshift{1}};
+        check_count_batch( tree );
+    }
+    SECTION( "frozen avl" ) {
+        frozen::freezing<avl::avl<>> tree{ avl::avl<>() };
+        check_count_batch( tree );
+    }
+}
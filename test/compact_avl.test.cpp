@@ -0,0 +1,88 @@
+#include "compact_avl.hpp"
+#include <catch.hpp>
+#include <set>
+#include <random>
+#include <climits>
+
+/* Height of the subtree at n, recomputed from the leaves;
+ * -2 if a stored balance code disagrees with the heights
+ * or a key is outside (lo, hi).
+ */
+int checked_height( const compact_avl::avl & tree, compact_avl::index n,
+        long long lo = LLONG_MIN, long long hi = LLONG_MAX )
+{
+    if( n == compact_avl::null )
+        return -1;
+    const compact_avl::node & x = tree.at( n );
+    if( x.key <= lo || x.key >= hi )
+        return -2;
+    int l = checked_height( tree, x.lchild_and_balance & compact_avl::index_mask, lo, x.key );
+    int r = checked_height( tree, x.rchild, x.key, hi );
+    if( l == -2 || r == -2 || std::abs(l - r) > 1 )
+        return -2;
+    // 0 for balanced, 1 for right-heavy, 2 for left-heavy.
+    compact_avl::index code = x.lchild_and_balance >> compact_avl::index_bits;
+    if( code != compact_avl::index(r - l == -1 ? 2 : r - l) )
+        return -2;
+    return std::max( l, r ) + 1;
+}
+
+TEST_CASE( "Compact AVL std::set-like interface", "[compact_avl]" ) {
+    compact_avl::avl tree;
+    CHECK( tree.count(5) == 0 );
+    tree.insert( 1 );
+    CHECK( tree.count(1) == 1 );
+    tree.insert( 3 );
+    tree.insert( 6 );
+    tree.insert( 12 );
+    tree.insert( 9 );
+    tree.insert( 1 );
+    CHECK( tree.count(3) == 1 );
+    CHECK( tree.count(12) == 1 );
+    CHECK( tree.count(9) == 1 );
+    tree.erase( 3 );
+    tree.erase( 12 );
+    tree.insert( 3 );
+    CHECK( tree.count(3) == 1 );
+    CHECK( tree.count(12) == 0 );
+}
+
+TEST_CASE( "Compact AVL agrees with std::set", "[compact_avl]" ) {
+    compact_avl::avl tree;
+    std::set<int> reference;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 2000);
+    std::uniform_int_distribution<> op(0, 2);
+
+    for( int i = 0; i < 20000; i++ ) {
+        int k = key(rng);
+        switch( op(rng) ) {
+            case 0:
+                tree.insert(k);
+                reference.insert(k);
+                REQUIRE( checked_height(tree, tree.root_index()) != -2 );
+                break;
+            case 1:
+                tree.erase(k);
+                reference.erase(k);
+                REQUIRE( checked_height(tree, tree.root_index()) != -2 );
+                break;
+            case 2:
+                REQUIRE( tree.count(k) == (int) reference.count(k) );
+                break;
+        }
+    }
+    for( int k = 0; k <= 2000; k++ )
+        REQUIRE( tree.count(k) == (int) reference.count(k) );
+}
+
+TEST_CASE( "Compact AVL stays balanced on sorted insertions", "[compact_avl]" ) {
+    compact_avl::avl tree;
+    for( int k = 0; k < 4095; k++ )
+        tree.insert( k );
+    // A perfect tree of 4095 nodes.
+    CHECK( checked_height(tree, tree.root_index()) == 11 );
+    for( int k = 0; k < 4095; k += 2 )
+        tree.erase( k );
+    CHECK( checked_height(tree, tree.root_index()) != -2 );
+}
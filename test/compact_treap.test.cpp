@@ -0,0 +1,72 @@
+#include "compact_treap.hpp"
+#include <catch.hpp>
+#include <set>
+#include <random>
+#include <climits>
+
+/* Whether the subtree at n is a treap: no child has a higher priority
+ * than its parent, and the keys are ordered and inside (lo, hi).
+ */
+template< typename RNG >
+bool is_treap( const compact_treap::treap<RNG> & tree, compact_treap::index n,
+        long long lo = LLONG_MIN, long long hi = LLONG_MAX )
+{
+    if( n == compact_treap::null )
+        return true;
+    const compact_treap::node & x = tree.at( n );
+    if( x.key <= lo || x.key >= hi )
+        return false;
+    for( compact_treap::index c : x.child )
+        if( c != compact_treap::null && tree.at(c).priority > x.priority )
+            return false;
+    return is_treap( tree, x.child[0], lo, x.key ) && is_treap( tree, x.child[1], x.key, hi );
+}
+
+TEST_CASE( "Compact treap std::set-like interface", "[compact_treap]" ) {
+    compact_treap::treap<std::mt19937> tree{std::mt19937{}};
+    CHECK( tree.count(5) == 0 );
+    tree.insert( 1 );
+    CHECK( tree.count(1) == 1 );
+    tree.insert( 3 );
+    tree.insert( 6 );
+    tree.insert( 12 );
+    tree.insert( 9 );
+    tree.insert( 1 );
+    CHECK( tree.count(3) == 1 );
+    CHECK( tree.count(12) == 1 );
+    CHECK( tree.count(9) == 1 );
+    tree.erase( 3 );
+    tree.erase( 12 );
+    tree.insert( 3 );
+    CHECK( tree.count(3) == 1 );
+    CHECK( tree.count(12) == 0 );
+}
+
+TEST_CASE( "Compact treap agrees with std::set", "[compact_treap]" ) {
+    compact_treap::treap<std::mt19937> tree{std::mt19937{}};
+    std::set<int> reference;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 2000);
+    std::uniform_int_distribution<> op(0, 2);
+
+    for( int i = 0; i < 20000; i++ ) {
+        int k = key(rng);
+        switch( op(rng) ) {
+            case 0:
+                tree.insert(k);
+                reference.insert(k);
+                REQUIRE( is_treap(tree, tree.root_index()) );
+                break;
+            case 1:
+                tree.erase(k);
+                reference.erase(k);
+                REQUIRE( is_treap(tree, tree.root_index()) );
+                break;
+            case 2:
+                REQUIRE( tree.count(k) == (int) reference.count(k) );
+                break;
+        }
+    }
+    for( int k = 0; k <= 2000; k++ )
+        REQUIRE( tree.count(k) == (int) reference.count(k) );
+}
@@ -0,0 +1,79 @@
+#include "concurrent_treap.hpp"
+#include <catch.hpp>
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+    using int_treap = concurrent_treap::treap<int, std::mt19937>;
+}
+
+TEST_CASE( "Concurrent treap std::set-like interface", "[concurrent_treap]" ) {
+    int_treap tree{std::mt19937{}};
+    std::set<int> reference;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 1000);
+
+    for( int i = 0; i < 20000; i++ ) {
+        int k = key(rng);
+        if( rng() % 3 ) {
+            tree.insert( k );
+            reference.insert( k );
+        }
+        else {
+            tree.erase( k );
+            reference.erase( k );
+        }
+    }
+    for( int k = 0; k <= 1000; k++ )
+        CHECK( tree.count(k) == (int) reference.count(k) );
+    // Nothing is reading; only the last few retirements may still wait.
+    CHECK( tree.pending_reclamation() < 64 * 8 );
+}
+
+TEST_CASE( "Concurrent treap readers during updates", "[concurrent_treap]" ) {
+    int_treap tree{std::mt19937{}};
+    // Even keys stay in the tree; the writers only touch odd keys.
+    for( int k = 0; k < 2000; k += 2 )
+        tree.insert( k );
+
+    std::atomic<bool> done{false};
+    std::atomic<int> errors{0};
+    std::vector<std::thread> threads;
+    for( int r = 0; r < 3; r++ )
+        threads.emplace_back( [&]{
+            while( !done.load() ) {
+                for( int k = 0; k < 2000; k += 2 )
+                    if( tree.count(k) != 1 )
+                        errors++;
+                if( tree.count(-1) != 0 || tree.count(2001) != 0 )
+                    errors++;
+            }
+        });
+
+    // Each writer owns the odd keys of its residue class, and ends with a known state.
+    std::vector<std::thread> writers;
+    for( int w = 0; w < 2; w++ )
+        writers.emplace_back( [&tree, w]{
+            for( int round = 0; round < 20; round++ )
+                for( int k = 1 + 2 * w; k < 2000; k += 4 ) {
+                    tree.insert( k );
+                    if( round % 2 == 0 || k % 3 == 0 )
+                        tree.erase( k );
+                }
+        });
+    for( std::thread & w : writers )
+        w.join();
+    done = true;
+    for( std::thread & t : threads )
+        t.join();
+
+    CHECK( errors == 0 );
+    for( int k = 0; k < 2000; k++ ) {
+        // The last round is odd: odd keys not multiple of 3 stay.
+        int expected = k % 2 == 0 || k % 3 != 0 ? 1 : 0;
+        REQUIRE( tree.count(k) == expected );
+    }
+}
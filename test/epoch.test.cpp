@@ -0,0 +1,62 @@
+#include "epoch.hpp"
+#include <catch.hpp>
+#include <thread>
+
+namespace {
+    struct counted {
+        static int live;
+        counted() { live++; }
+        ~counted() { live--; }
+    };
+    int counted::live = 0;
+}
+
+TEST_CASE( "Epoch-based reclamation waits for the readers", "[epoch]" ) {
+    {
+        ebr::domain d;
+        {
+            ebr::guard g( d );
+            for( int i = 0; i < 1000; i++ )
+                d.retire( new counted );
+            // The epoch cannot get two past the guard's.
+            d.collect();
+            d.collect();
+            CHECK( counted::live == 1000 );
+        }
+        d.collect();
+        d.collect();
+        d.collect();
+        CHECK( counted::live == 0 );
+        CHECK( d.pending() == 0 );
+
+        // A guard of another thread blocks the reclamation as well.
+        for( int i = 0; i < 10; i++ )
+            d.retire( new counted );
+        std::thread reader( [&]{
+            ebr::guard g( d );
+            for( int i = 0; i < 5; i++ )
+                d.collect();
+            CHECK( counted::live == 10 );
+        });
+        reader.join();
+        for( int i = 0; i < 5; i++ )
+            d.collect();
+        CHECK( counted::live == 0 );
+
+        for( int i = 0; i < 10; i++ )
+            d.retire( new counted );
+    }
+    // The domain frees what is left.
+    CHECK( counted::live == 0 );
+}
+
+TEST_CASE( "Epoch thread indices are reused", "[epoch]" ) {
+    std::size_t main_index = ebr::thread_index();
+    for( int i = 0; i < 2 * (int) ebr::max_threads; i++ ) {
+        std::size_t index = 0;
+        std::thread t( [&]{ index = ebr::thread_index(); } );
+        t.join();
+        CHECK( index != main_index );
+        CHECK( index < ebr::max_threads );
+    }
+}
@@ -0,0 +1,104 @@
+#include "fast_rng.hpp"
+#include <catch.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "treap.hpp"
+#include "xorshift.hpp"
+
+TEST_CASE( "Reference outputs of the fast generators", "[fast_rng]" ) {
+    fast_rng::xoshiro256ss xoshiro( std::array<std::uint64_t, 4>{1, 2, 3, 4} );
+    CHECK( xoshiro() == 11520 );
+    CHECK( xoshiro() == 0 );
+    CHECK( xoshiro() == 1509978240 );
+    CHECK( xoshiro() == 1215971899390074240 );
+
+    // The output of pcg32-demo.
+    fast_rng::pcg32 pcg( 42, 54 );
+    CHECK( pcg() == 0xa15c02b7 );
+    CHECK( pcg() == 0x7b47f409 );
+    CHECK( pcg() == 0xba1d3330 );
+    CHECK( pcg() == 0x83d2f293 );
+
+    fast_rng::wyrand wy( 1 );
+    CHECK( wy() == 14839104130206199084u );
+    CHECK( wy() == 7050053486739369280u );
+}
+
+TEST_CASE( "xorshift lanes follow scalar xorshift", "[fast_rng]" ) {
+    fast_rng::xorshift_lanes<16> lanes( 7 );
+    std::vector<xorshift> scalar;
+    for( std::uint32_t i = 0; i < 16; i++ ) {
+        lanes.seed_lane( i, i + 1, 3 * i, 0x12345678 ^ i, 99 );
+        scalar.push_back( xorshift(i + 1, 3 * i, 0x12345678 ^ i, 99) );
+    }
+    std::uint32_t out[16];
+    for( int step = 0; step < 100; step++ ) {
+        lanes.step( out );
+        for( int i = 0; i < 16; i++ )
+            REQUIRE( out[i] == scalar[i]() );
+    }
+}
+
+TEST_CASE( "Buffered lanes hand out every step in order", "[fast_rng]" ) {
+    fast_rng::xorshift_lanes<8> lanes( 3 );
+    fast_rng::buffered<fast_rng::xorshift_lanes<8>, 2> buffered( lanes );
+    std::uint32_t out[8];
+    for( int step = 0; step < 10; step++ ) {
+        lanes.step( out );
+        for( int i = 0; i < 8; i++ )
+            REQUIRE( buffered() == out[i] );
+    }
+}
+
+TEST_CASE( "Seeds give different lanes", "[fast_rng]" ) {
+    fast_rng::simd_xorshift a( 1 ), b( 1 ), c( 2 );
+    std::vector<std::uint32_t> first;
+    bool same = true, other = true;
+    for( int i = 0; i < 64; i++ ) {
+        std::uint32_t x = a();
+        first.push_back( x );
+        same &= x == b();
+        other &= x == c();
+    }
+    CHECK( same );
+    CHECK_FALSE( other );
+    std::sort( first.begin(), first.end() );
+    CHECK( std::unique(first.begin(), first.end()) == first.end() );
+}
+
+namespace {
+    template< typename RNG >
+    void check_generator() {
+        treap::treap<int, void, RNG> tree{ RNG{5} };
+        std::mt19937 shuffle( 1 );
+        std::vector<int> keys( 2000 );
+        for( int i = 0; i < 2000; i++ )
+            keys[i] = i;
+        std::shuffle( keys.begin(), keys.end(), shuffle );
+        for( int key : keys )
+            tree.insert( key );
+        for( int i = 0; i < 2000; i += 2 )
+            tree.erase( i );
+        for( int i = 0; i < 2000; i++ )
+            REQUIRE( tree.count(i) == i % 2 );
+
+        // Uniform enough for <random>.
+        RNG rng{ 9 };
+        std::uniform_int_distribution<int> die( 0, 5 );
+        int counts[6] = {};
+        for( int i = 0; i < 60'000; i++ )
+            counts[die(rng)]++;
+        for( int c : counts )
+            CHECK( std::abs(c - 10'000) < 500 );
+    }
+}
+
+TEST_CASE( "Treaps with the fast generators", "[fast_rng]" ) {
+    check_generator<fast_rng::xoshiro256ss>();
+    check_generator<fast_rng::pcg32>();
+    check_generator<fast_rng::wyrand>();
+    check_generator<fast_rng::simd_xorshift>();
+}
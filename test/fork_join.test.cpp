@@ -0,0 +1,43 @@
+#include "fork_join.hpp"
+#include <catch.hpp>
+
+namespace {
+    long long parallel_sum( const int * begin, const int * end ) {
+        if( end - begin < 64 ) {
+            long long sum = 0;
+            for( const int * p = begin; p != end; p++ )
+                sum += *p;
+            return sum;
+        }
+        const int * middle = begin + (end - begin) / 2;
+        long long left, right;
+        fork_join::join(
+            [&]{ left = parallel_sum( begin, middle ); },
+            [&]{ right = parallel_sum( middle, end ); }
+        );
+        return left + right;
+    }
+}
+
+TEST_CASE( "Fork-join outside a pool runs sequentially", "[fork_join]" ) {
+    std::vector<int> order;
+    fork_join::join( [&]{ order.push_back(1); }, [&]{ order.push_back(2); } );
+    REQUIRE( order.size() == 2 );
+    CHECK( order[0] == 1 );
+    CHECK( order[1] == 2 );
+}
+
+TEST_CASE( "Fork-join pool runs nested joins", "[fork_join]" ) {
+    std::vector<int> values( 100000 );
+    for( int i = 0; i < (int) values.size(); i++ )
+        values[i] = i;
+    long long expected = 100000LL * 99999 / 2;
+
+    fork_join::pool pool(4);
+    CHECK( pool.size() == 4 );
+    for( int i = 0; i < 5; i++ ) {
+        long long sum = 0;
+        pool.run( [&]{ sum = parallel_sum( values.data(), values.data() + values.size() ); } );
+        CHECK( sum == expected );
+    }
+}
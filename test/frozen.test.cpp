@@ -0,0 +1,57 @@
+#include "frozen.hpp"
+#include "avl.hpp"
+#include "treap.hpp"
+#include <catch.hpp>
+#include <random>
+#include <set>
+#include <vector>
+
+TEST_CASE( "Eytzinger index search", "[frozen]" ) {
+    for( int n : {0, 1, 2, 3, 15, 16, 17, 100, 1000} ) {
+        std::vector<int> keys;
+        for( int i = 0; i < n; i++ )
+            keys.push_back( 3 * i + 1 );
+        frozen::eytzinger index( keys );
+        CHECK( index.size() == keys.size() );
+        for( int k = -2; k < 3 * n + 3; k++ )
+            REQUIRE( index.count(k) == (k > 0 && k % 3 == 1 && k < 3 * n) );
+    }
+}
+
+TEST_CASE( "Freezing trees", "[frozen]" ) {
+    avl::avl<int, void, std::less<int>, pool_allocator> a;
+    treap::treap<> t{std::mt19937{}};
+    std::set<int> reference;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(-5000, 5000);
+    for( int i = 0; i < 3000; i++ ) {
+        int k = key(rng);
+        a.insert( k );
+        t.insert( k );
+        reference.insert( k );
+    }
+
+    std::vector<int> keys;
+    frozen::in_order_keys( std::unique_ptr<avl::node>(), keys );
+    CHECK( keys.empty() );
+
+    frozen::eytzinger fa = a.freeze(), ft = t.freeze();
+    CHECK( fa.size() == reference.size() );
+    CHECK( ft.size() == reference.size() );
+    for( int k = -5001; k <= 5001; k++ ) {
+        REQUIRE( fa.count(k) == (int) reference.count(k) );
+        REQUIRE( ft.count(k) == (int) reference.count(k) );
+    }
+}
+
+TEST_CASE( "Freezing adapter thaws on updates", "[frozen]" ) {
+    frozen::freezing<avl::avl<>> tree{ avl::avl<>() };
+    for( int i = 0; i < 100; i++ )
+        tree.insert( 2 * i );
+    CHECK( tree.count(10) == 1 );
+    CHECK( tree.count(11) == 0 );
+    tree.insert( 11 );
+    tree.erase( 10 );
+    CHECK( tree.count(10) == 0 );
+    CHECK( tree.count(11) == 1 );
+}
@@ -0,0 +1,135 @@
+#include "generation.hpp"
+#include "speed_test.hpp"
+#include <catch.hpp>
+
+#include <set>
+
+namespace {
+    bool same_operations( const test_case & a, const test_case & b ) {
+        if( a.size() != b.size() )
+            return false;
+        for( std::size_t i = 0; i < a.size(); i++ )
+            if( a[i].type != b[i].type || a[i].key != b[i].key || a[i].hi() != b[i].hi() )
+                return false;
+        return true;
+    }
+}
+
+TEST_CASE( "Random permutations are bijections", "[generation]" ) {
+    for( std::uint64_t n : {1, 2, 3, 16, 17, 1000, 4096, 12345} ) {
+        generation::random_permutation p( n, n * 7 );
+        std::vector<bool> seen( n );
+        for( std::uint64_t i = 0; i < n; i++ ) {
+            std::uint64_t v = p(i);
+            REQUIRE( v < n );
+            CHECK_FALSE( seen[v] );
+            seen[v] = true;
+        }
+    }
+    generation::random_permutation a( 1000, 1 ), b( 1000, 2 ), c( 1000, 1, 1 );
+    int same_seed = 0, same_stream = 0;
+    for( int i = 0; i < 1000; i++ ) {
+        same_seed += a(i) == b(i);
+        same_stream += a(i) == c(i);
+    }
+    CHECK( same_seed < 20 );
+    CHECK( same_stream < 20 );
+}
+
+TEST_CASE( "Chunks are all visited once", "[generation]" ) {
+    for( unsigned threads : {1, 4} ) {
+        std::size_t n = 5 * generation::chunk_size + 17;
+        std::vector<int> visits( n );
+        std::vector<int> chunks( 6 );
+        generation::for_each_chunk( n, threads,
+            [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+                chunks[chunk]++;
+                CHECK( first == chunk * generation::chunk_size );
+                for( std::size_t i = first; i < last; i++ )
+                    visits[i]++;
+            });
+        CHECK( std::count(visits.begin(), visits.end(), 1) == (long) n );
+        CHECK( std::count(chunks.begin(), chunks.end(), 1) == 6 );
+    }
+}
+
+TEST_CASE( "Live keys", "[generation]" ) {
+    generation::live_keys live;
+    for( int k = 1; k <= 10; k++ )
+        live.push( k );
+    CHECK( live.index(0) == 0 );
+    CHECK( live.index(~std::uint32_t(0)) == 9 );
+
+    CHECK( live.take(2) == 3 );
+    CHECK( live.size() == 9 );
+    CHECK( live[2] == 10 ); // The last key fills the hole.
+
+    std::set<int> left;
+    for( std::size_t i = 0; i < live.size(); i++ )
+        left.insert( live[i] );
+    CHECK( left == std::set<int>{1, 2, 4, 5, 6, 7, 8, 9, 10} );
+
+    while( !live.empty() )
+        live.take( live.index(12345u * live.size()) );
+}
+
+TEST_CASE( "Generated test cases do not depend on the threads", "[generation]" ) {
+    int n = 3 * generation::chunk_size;
+    CHECK( same_operations( insert_then_search(n, n, n, 3, 1),
+                            insert_then_search(n, n, n, 3, 4) ) );
+    CHECK( same_operations( insert_then_remove_then_search(n, n / 2, n, n, 3, 1),
+                            insert_then_remove_then_search(n, n / 2, n, n, 3, 3) ) );
+    CHECK( same_operations( mixed_workload(n / 2, n, n / 2, n, n, 3, 1),
+                            mixed_workload(n / 2, n, n / 2, n, n, 3, 4) ) );
+    CHECK( same_operations( scan_workload(n, n, 10, 3, 1), scan_workload(n, n, 10, 3, 2) ) );
+    for( const operation & op : scan_workload(1000, 100, 10, 3) )
+        if( op.type == operation_type::range_scan )
+            REQUIRE( op.hi() == op.key + 20 );
+    CHECK_FALSE( same_operations( insert_then_search(n, n, n, 3, 1),
+                                  insert_then_search(n, n, n, 4, 1) ) );
+}
+
+TEST_CASE( "Generated test cases keep their counts", "[generation]" ) {
+    int n = 100'000;
+    test_case c = insert_then_search( n, 3000, 2000, 9, 2 );
+    std::set<int> keys;
+    for( int i = 0; i < n; i++ )
+        keys.insert( c[i].key );
+    CHECK( keys.size() == (std::size_t) n );
+    int successes = 0;
+    for( std::size_t i = n; i < c.size(); i++ )
+        successes += keys.count( c[i].key );
+    CHECK( successes == 3000 );
+
+    c = mixed_workload( n / 10, n, n / 2, 3000, 2000, 9, 2 );
+    keys.clear();
+    int inserts = 0, removed = 0, found = 0, searches = 0;
+    for( const operation & op : c ) {
+        CHECK( op.width == 0 );
+        switch( op.type ) {
+            case operation_type::insert:
+                inserts++;
+                CHECK( keys.insert(op.key).second );
+                break;
+            case operation_type::erase:
+                removed += keys.erase( op.key );
+                break;
+            default:
+                searches++;
+                found += keys.count( op.key );
+        }
+    }
+    CHECK( inserts == n );
+    CHECK( removed == n / 2 ); // The tree never gets empty here.
+    CHECK( searches == 5000 );
+    CHECK( found == 3000 );
+}
+
+TEST_CASE( "Test cases searching only after their updates", "[generation]" ) {
+    CHECK_FALSE( updates_after_searches(insert_then_search(1000, 500, 500, 1)) );
+    CHECK_FALSE( updates_after_searches(bulk_load_then_search(1000, 500, 500, 1)) );
+    CHECK_FALSE( updates_after_searches(
+            insert_then_remove_then_search(1000, 500, 500, 500, 1)) );
+    CHECK( updates_after_searches(mixed_workload(500, 1000, 500, 500, 500, 1)) );
+    CHECK_FALSE( updates_after_searches(test_case()) );
+}
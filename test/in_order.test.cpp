@@ -0,0 +1,130 @@
+#include "avl.hpp"
+#include "treap.hpp"
+#include <catch.hpp>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+    // Checks every traversal and range query against the reference set.
+    template< typename Tree >
+    void check_ranges( const Tree & tree, const std::set<int> & reference, int max_key ) {
+        std::vector<int> forward, backward;
+        for( auto it = tree.begin(); it != tree.end(); ++it )
+            forward.push_back( it->key );
+        for( auto it = tree.end(); it != tree.begin(); )
+            backward.push_back( (--it)->key );
+        REQUIRE( forward == std::vector<int>(reference.begin(), reference.end()) );
+        REQUIRE( backward == std::vector<int>(reference.rbegin(), reference.rend()) );
+
+        for( int k = -1; k <= max_key + 1; k++ ) {
+            auto lower = reference.lower_bound(k);
+            auto upper = reference.upper_bound(k);
+            auto it = tree.lower_bound(k);
+            REQUIRE( (it == tree.end()) == (lower == reference.end()) );
+            if( lower != reference.end() )
+                REQUIRE( it->key == *lower );
+            it = tree.upper_bound(k);
+            REQUIRE( (it == tree.end()) == (upper == reference.end()) );
+            if( upper != reference.end() ) {
+                REQUIRE( it->key == *upper );
+                // Iterators from a search go both ways.
+                if( upper != reference.begin() )
+                    REQUIRE( (--it)->key == *std::prev(upper) );
+            }
+        }
+
+        for( int lo = -1; lo <= max_key; lo += 13 ) {
+            int hi = lo + 40;
+            std::vector<int> got;
+            tree.for_each_in_range( lo, hi, [&]( const auto & n ){ got.push_back(n.key); } );
+            REQUIRE( got == std::vector<int>(reference.lower_bound(lo), reference.lower_bound(hi)) );
+        }
+    }
+
+    template< typename Tree >
+    void check_random_ranges( Tree & tree ) {
+        std::set<int> reference;
+        std::mt19937 rng(0);
+        std::uniform_int_distribution<> key(0, 2000);
+
+        CHECK( tree.begin() == tree.end() );
+        for( int i = 0; i < 1500; i++ ) {
+            int k = key(rng);
+            tree.insert( k );
+            reference.insert( k );
+        }
+        check_ranges( tree, reference, 2000 );
+
+        for( int i = 0; i < 50; i++ ) {
+            int lo = key(rng);
+            int hi = lo + key(rng) % 100;
+            if( i % 10 == 0 )
+                std::swap( lo, hi ); // Empty range.
+            tree.erase_range( lo, hi );
+            if( lo < hi )
+                reference.erase( reference.lower_bound(lo), reference.lower_bound(hi) );
+        }
+        check_ranges( tree, reference, 2000 );
+
+        // The tree stays usable after the splits and joins.
+        for( int k = 0; k <= 2000; k += 7 ) {
+            tree.insert( k );
+            reference.insert( k );
+        }
+        tree.erase_range( -10, 100 );
+        tree.erase_range( 1900, 3000 );
+        reference.erase( reference.begin(), reference.lower_bound(100) );
+        reference.erase( reference.lower_bound(1900), reference.end() );
+        check_ranges( tree, reference, 2000 );
+        tree.erase_range( -10, 3000 );
+        CHECK( tree.begin() == tree.end() );
+    }
+}
+
+TEST_CASE( "In-order iteration and range queries", "[in_order]" ) {
+    SECTION( "AVL" ) {
+        avl::avl<int, void, std::less<int>, pool_allocator> tree;
+        check_random_ranges( tree );
+    }
+    SECTION( "Rotation treap" ) {
+        treap::treap<> tree{std::mt19937{}};
+        check_random_ranges( tree );
+    }
+    SECTION( "Split-merge treap" ) {
+        treap::treap<int, void, std::mt19937, std::less<int>,
+            pool_allocator, treap::split_merge_engine> tree{std::mt19937{}};
+        check_random_ranges( tree );
+    }
+    SECTION( "With order statistics" ) {
+        avl::avl<int, void, std::less<int>, malloc_allocator, order_statistics> a;
+        treap::treap<int, void, std::mt19937, std::less<int>,
+            malloc_allocator, treap::rotation_engine, order_statistics> t{std::mt19937{}};
+        for( int k = 0; k < 1000; k++ ) {
+            a.insert( k );
+            t.insert( k );
+        }
+        a.erase_range( 100, 300 );
+        t.erase_range( 100, 300 );
+        CHECK( a.rank(500) == 300 );
+        CHECK( t.rank(500) == 300 );
+        CHECK( a.select(100)->key == 300 );
+        CHECK( t.select(100)->key == 300 );
+        CHECK( a.count_range(0, 1000) == 800 );
+        CHECK( t.count_range(0, 1000) == 800 );
+    }
+}
+
+TEST_CASE( "In-order iteration of a map", "[in_order]" ) {
+    avl::avl<int, int, std::greater<int>> map;
+    for( int k = 0; k < 10; k++ )
+        map[k] = 10 * k;
+    std::vector<int> values;
+    for( const auto & n : map )
+        values.push_back( n.value );
+    CHECK( values == std::vector<int>{90, 80, 70, 60, 50, 40, 30, 20, 10, 0} );
+    CHECK( map.lower_bound(5)->key == 5 );
+    CHECK( map.upper_bound(5)->key == 4 );
+}
@@ -0,0 +1,62 @@
+#include "latency.hpp"
+#include <catch.hpp>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+TEST_CASE( "Latency histogram percentiles", "[latency]" ) {
+    latency::histogram h;
+    CHECK( h.count() == 0 );
+    CHECK( h.percentile(99) == 0 );
+
+    std::mt19937_64 rng(0);
+    std::vector<std::uint64_t> values;
+    for( int i = 0; i < 100000; i++ ) {
+        // Spread over many orders of magnitude.
+        std::uint64_t v = rng() >> (rng() % 60);
+        values.push_back( v );
+        h.record( v );
+    }
+    std::sort( values.begin(), values.end() );
+    CHECK( h.count() == values.size() );
+    CHECK( h.min() == values.front() );
+    CHECK( h.max() == values.back() );
+
+    for( double p : {1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 100.0} ) {
+        std::uint64_t exact = values[std::ceil(p * values.size() / 100 - 1e-9) - 1];
+        std::uint64_t got = h.percentile( p );
+        // At most one bucket above the exact value.
+        CHECK( got >= exact );
+        CHECK( got - exact <= exact / 128 + 1 );
+    }
+}
+
+TEST_CASE( "Latency histogram of small values", "[latency]" ) {
+    latency::histogram h;
+    for( std::uint64_t v = 1; v <= 100; v++ )
+        h.record( v );
+    CHECK( h.percentile(50) == 50 );
+    CHECK( h.percentile(99) == 99 );
+    CHECK( h.percentile(99.9) == 100 );
+    CHECK( h.mean() == Approx(50.5) );
+
+    latency::histogram other;
+    other.record( 1000000 );
+    h.merge( other );
+    CHECK( h.count() == 101 );
+    CHECK( h.max() == 1000000 );
+    CHECK( h.percentile(100) == 1000000 );
+    h.clear();
+    CHECK( h.count() == 0 );
+}
+
+TEST_CASE( "Latency clock", "[latency]" ) {
+    latency::clock clock;
+    std::uint64_t begin = latency::clock::now();
+    std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+    std::uint64_t ns = clock.elapsed_ns( begin, latency::clock::now() );
+    CHECK( ns >= 15'000'000 );
+    CHECK( ns < 2'000'000'000 );
+    CHECK( clock.elapsed_ns(begin, begin) == 0 );
+}
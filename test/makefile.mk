@@ -17,6 +17,11 @@ all : $(test)
 test: $(test)
 	$(test)
 
+# Runs main once in each mode; see smoke.sh.
+.PHONY: smoke
+smoke: main
+	$(testdir)smoke.sh
+
 
 .PHONY: test-clean test-mostlyclean
 
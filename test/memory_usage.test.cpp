@@ -0,0 +1,42 @@
+#include "memory_usage.hpp"
+#include "node_allocator.hpp"
+#include <catch.hpp>
+
+TEST_CASE( "Memory usage counters", "[memory_usage]" ) {
+    memory_usage::allocated( 1000 ); // Not counting yet.
+    CHECK_FALSE( memory_usage::counting() );
+    memory_usage::start();
+    CHECK( memory_usage::counting() );
+    memory_usage::allocated( 100 );
+    memory_usage::allocated( 50 );
+    memory_usage::freed( 100 );
+    memory_usage::allocated( 20 );
+    memory_usage::usage u = memory_usage::stop();
+    CHECK( u.live_bytes == 70 );
+    CHECK( u.peak_bytes == 150 );
+    CHECK( u.allocations == 3 );
+
+    CHECK_FALSE( memory_usage::counting() );
+    memory_usage::allocated( 1000 );
+    u = memory_usage::stop();
+    CHECK( u.allocations == 3 );
+}
+
+TEST_CASE( "Memory usage of the slab pool", "[memory_usage]" ) {
+    struct node {
+        long long data[4];
+    };
+    memory_usage::start();
+    {
+        slab_pool<node> pool;
+        for( int i = 0; i < 5000; i++ )
+            pool.allocate();
+        memory_usage::usage u = memory_usage::stop();
+        memory_usage::start();
+        // 5000 nodes of 32 bytes take three 64 KiB slabs.
+        CHECK( u.allocations == 3 );
+        CHECK( u.live_bytes == 3 * slab_pool<node>::slab_size );
+    }
+    memory_usage::usage u = memory_usage::stop();
+    CHECK( u.live_bytes == -3 * (long long) slab_pool<node>::slab_size );
+}
@@ -0,0 +1,88 @@
+#include "node_allocator.hpp"
+#include <catch.hpp>
+#include <functional>
+#include <set>
+#include <vector>
+
+namespace {
+    struct test_node {
+        int key;
+        std::unique_ptr<test_node, pool_delete<test_node>> next;
+        test_node( int k ) : key(k) {}
+        static constexpr bool trivially_releasable = true;
+    };
+}
+
+TEST_CASE( "Slab pool recycles erased nodes", "[allocator]" ) {
+    slab_pool<test_node> pool;
+    auto a = pool.make(1);
+    auto b = pool.make(2);
+    CHECK( a->key == 1 );
+    CHECK( b->key == 2 );
+
+    test_node * address = a.get();
+    a.reset();
+    auto c = pool.make(3);
+    CHECK( c.get() == address );
+    CHECK( c->key == 3 );
+}
+
+TEST_CASE( "Slab pool spans several slabs", "[allocator]" ) {
+    slab_pool<test_node> pool;
+    std::unique_ptr<test_node, pool_delete<test_node>> head;
+    const int n = 3 * slab_pool<test_node>::slab_size / sizeof(test_node);
+    std::set<test_node *> addresses;
+    for( int i = 0; i < n; i++ ) {
+        auto ptr = pool.make(i);
+        addresses.insert( ptr.get() );
+        ptr->next = std::move(head);
+        head = std::move(ptr);
+    }
+    CHECK( addresses.size() == n );
+
+    int expected = n;
+    for( test_node * p = head.get(); p; p = p->next.get() )
+        CHECK( p->key == --expected );
+    CHECK( expected == 0 );
+
+    pool.release( head );
+    CHECK( head == nullptr );
+
+    auto again = pool.make(42);
+    CHECK( again->key == 42 );
+}
+
+TEST_CASE( "Slab pool takes frees from several workers", "[allocator]" ) {
+    using pointer = slab_pool<test_node>::pointer;
+    slab_pool<test_node> pool;
+    std::vector<pointer> nodes;
+    std::set<test_node *> addresses;
+    for( int i = 0; i < 4000; i++ ) {
+        nodes.push_back( pool.make(i) );
+        addresses.insert( nodes.back().get() );
+    }
+
+    std::function<void(pointer *, pointer *)> free_all = [&]( pointer * first, pointer * last ){
+        if( last - first <= 100 ) {
+            for( ; first != last; ++first )
+                first->reset();
+            return;
+        }
+        pointer * mid = first + (last - first) / 2;
+        fork_join::join( [&]{ free_all(first, mid); }, [&]{ free_all(mid, last); } );
+    };
+    fork_join::pool workers( 4 );
+    workers.run( [&]{
+        pool.begin_parallel_frees();
+        free_all( nodes.data(), nodes.data() + nodes.size() );
+        pool.end_parallel_frees();
+    });
+
+    // Every slot is back in the free list, once.
+    std::set<test_node *> reused;
+    for( int i = 0; i < 4000; i++ ) {
+        nodes[i] = pool.make(i);
+        reused.insert( nodes[i].get() );
+    }
+    CHECK( reused == addresses );
+}
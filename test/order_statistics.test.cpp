@@ -0,0 +1,143 @@
+#include "avl.hpp"
+#include "treap.hpp"
+#include <catch.hpp>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+    using sized_avl = avl::avl<int, void, std::less<int>, pool_allocator, order_statistics>;
+
+    template< typename Engine >
+    using sized_treap = treap::treap<int, void, std::mt19937, std::less<int>,
+          pool_allocator, Engine, order_statistics>;
+
+    /* Checks rank, select and count_range on every key up to max_key
+     * against the reference set.
+     */
+    template< typename Tree >
+    void check_order_statistics( const Tree & tree, const std::set<int> & reference, int max_key ) {
+        std::vector<int> keys( reference.begin(), reference.end() );
+        for( std::size_t i = 0; i < keys.size(); i++ ) {
+            auto pos = tree.select( i );
+            REQUIRE( pos != nullptr );
+            REQUIRE( pos->key == keys[i] );
+        }
+        CHECK( tree.select( keys.size() ) == nullptr );
+
+        for( int k = -1; k <= max_key + 1; k++ ) {
+            auto rank = std::distance( reference.begin(), reference.lower_bound(k) );
+            REQUIRE( tree.rank(k) == (std::size_t) rank );
+        }
+        for( int lo = -1; lo <= max_key + 1; lo += 7 )
+            for( int hi : {lo - 1, lo, lo + 1, lo + 50, max_key + 1} ) {
+                auto expected = lo < hi ? std::distance(
+                        reference.lower_bound(lo), reference.lower_bound(hi) ) : 0;
+                REQUIRE( tree.count_range(lo, hi) == (std::size_t) expected );
+            }
+    }
+
+    template< typename Tree >
+    void check_random_updates( Tree & tree ) {
+        std::set<int> reference;
+        std::mt19937 rng(0);
+        std::uniform_int_distribution<> key(0, 1000);
+
+        for( int i = 0; i < 5000; i++ ) {
+            int k = key(rng);
+            switch( rng() % 4 ) {
+                case 0:
+                    tree.erase( k );
+                    reference.erase( k );
+                    break;
+                case 1:
+                    tree.insert( tree.end(), k );
+                    reference.insert( k );
+                    break;
+                default:
+                    tree.insert( k );
+                    reference.insert( k );
+            }
+            if( i % 500 == 0 )
+                check_order_statistics( tree, reference, 1000 );
+        }
+        check_order_statistics( tree, reference, 1000 );
+
+        // Ascending keys with hints, as in a bulk append.
+        for( int k = 1001; k < 2000; k++ ) {
+            tree.insert( tree.end(), k );
+            reference.insert( k );
+        }
+        check_order_statistics( tree, reference, 2000 );
+
+        std::vector<int> sorted;
+        for( int k = 0; k < 1000; k += 3 )
+            sorted.push_back( k );
+        tree.assign_sorted( sorted.begin(), sorted.end() );
+        check_order_statistics( tree, std::set<int>(sorted.begin(), sorted.end()), 1000 );
+    }
+}
+
+TEST_CASE( "Order statistics with random updates", "[order_statistics]" ) {
+    SECTION( "AVL" ) {
+        sized_avl tree;
+        check_random_updates( tree );
+    }
+    SECTION( "Rotation treap" ) {
+        sized_treap<treap::rotation_engine> tree{std::mt19937{}};
+        check_random_updates( tree );
+    }
+    SECTION( "Split-merge treap" ) {
+        sized_treap<treap::split_merge_engine> tree{std::mt19937{}};
+        check_random_updates( tree );
+    }
+}
+
+TEST_CASE( "Order statistics after set operations", "[order_statistics]" ) {
+    using tree_type = sized_treap<treap::split_merge_engine>;
+    auto make = []( int step, unsigned seed ) {
+        tree_type tree{std::mt19937{seed}};
+        std::set<int> keys;
+        for( int k = 0; k < 3000; k += step ) {
+            tree.insert( k );
+            keys.insert( k );
+        }
+        return std::make_pair( std::move(tree), keys );
+    };
+
+    auto a = make( 2, 1 );
+    auto b = make( 3, 2 );
+    std::set<int> expected;
+
+    SECTION( "Union" ) {
+        a.first.union_with( b.first );
+        std::set_union( a.second.begin(), a.second.end(), b.second.begin(), b.second.end(),
+                std::inserter(expected, expected.end()) );
+    }
+    SECTION( "Intersection" ) {
+        a.first.intersect_with( b.first );
+        std::set_intersection( a.second.begin(), a.second.end(), b.second.begin(), b.second.end(),
+                std::inserter(expected, expected.end()) );
+    }
+    SECTION( "Difference" ) {
+        a.first.difference_with( b.first );
+        std::set_difference( a.second.begin(), a.second.end(), b.second.begin(), b.second.end(),
+                std::inserter(expected, expected.end()) );
+    }
+    check_order_statistics( a.first, expected, 3000 );
+
+    a.first.insert( 1 );
+    a.first.erase( 0 );
+    expected.insert( 1 );
+    expected.erase( 0 );
+    check_order_statistics( a.first, expected, 3000 );
+}
+
+TEST_CASE( "Order statistics cost nothing when disabled", "[order_statistics]" ) {
+    CHECK( sizeof(avl::node) <
+        sizeof(avl::basic_node<int, void, malloc_allocator, order_statistics>) );
+    CHECK( sizeof(treap::node) <
+        sizeof(treap::basic_node<int, void, malloc_allocator, order_statistics>) );
+}
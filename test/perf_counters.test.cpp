@@ -0,0 +1,38 @@
+#include "perf_counters.hpp"
+#include <catch.hpp>
+
+TEST_CASE( "Performance counters", "[perf_counters]" ) {
+    perf::counter_group group;
+    // Without perf events, the group says why, and reads zeros.
+    if( !group.available() ) {
+        CHECK( !group.why_unavailable().empty() );
+        group.start();
+        CHECK( group.read()[perf::instructions] == 0 );
+        return;
+    }
+
+    group.start();
+    volatile int sink = 0;
+    for( int i = 0; i < 1000000; i++ )
+        sink = sink + i;
+    perf::readings first = group.read();
+    for( int i = 0; i < 1000000; i++ )
+        sink = sink + i;
+    perf::readings second = group.read();
+    group.stop();
+
+    CHECK( first[perf::cycles] > 0 );
+    if( group.available(perf::instructions) ) {
+        CHECK( first[perf::instructions] > 1000000 );
+        CHECK( (second - first)[perf::instructions] > 1000000 );
+    }
+}
+
+TEST_CASE( "Performance counter readings", "[perf_counters]" ) {
+    perf::readings a, b;
+    a.values[perf::cycles] = 10;
+    b.values[perf::cycles] = 4;
+    CHECK( (a - b)[perf::cycles] == 6 );
+    CHECK( (a - b)[perf::branch_misses] == 0 );
+    CHECK( std::string(perf::event_name(perf::llc_misses)) == "LLC misses" );
+}
@@ -0,0 +1,142 @@
+#include "persistent_treap.hpp"
+#include "treap.hpp"
+#include <catch.hpp>
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+    using int_treap = persistent_treap::treap<int, std::mt19937>;
+
+    template< typename Snapshot >
+    std::vector<int> keys_of( const Snapshot & s ) {
+        std::vector<int> ret;
+        for( const auto & n : s )
+            ret.push_back( n.key );
+        return ret;
+    }
+
+    bool same_shape( const persistent_treap::node<int> * a, const treap::node * b ) {
+        if( !a || !b )
+            return !a && !b;
+        return a->key == b->key && a->priority == b->priority &&
+            same_shape( a->lchild.get(), b->lchild.get() ) &&
+            same_shape( a->rchild.get(), b->rchild.get() );
+    }
+}
+
+TEST_CASE( "Persistent treap keeps every version", "[persistent_treap]" ) {
+    int_treap tree{std::mt19937{}};
+    std::set<int> reference;
+    std::vector<int_treap::snapshot_type> snapshots;
+    std::vector<std::vector<int>> expected;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 500);
+
+    for( int i = 0; i < 3000; i++ ) {
+        int k = key(rng);
+        if( rng() % 3 ) {
+            tree.insert( k );
+            reference.insert( k );
+        }
+        else {
+            tree.erase( k );
+            reference.erase( k );
+        }
+        REQUIRE( tree.size() == reference.size() );
+        if( i % 10 == 0 ) {
+            snapshots.push_back( tree.snapshot() );
+            expected.emplace_back( reference.begin(), reference.end() );
+        }
+    }
+    for( int k = 0; k <= 500; k++ )
+        CHECK( tree.count(k) == (int) reference.count(k) );
+
+    // The old versions are unchanged by the later updates.
+    for( std::size_t i = 0; i < snapshots.size(); i++ ) {
+        REQUIRE( keys_of(snapshots[i]) == expected[i] );
+        for( int k : expected[i] )
+            CHECK( snapshots[i].count(k) == 1 );
+    }
+
+    // Versions share most of their nodes.
+    std::vector<const persistent_treap::node<int> *> roots;
+    for( const auto & s : snapshots )
+        roots.push_back( s.get() );
+    std::size_t keys = 0;
+    for( const auto & e : expected )
+        keys += e.size();
+    CHECK( persistent_treap::count_nodes(roots) < keys / 2 );
+}
+
+TEST_CASE( "Persistent treap has the shape of the mutable one", "[persistent_treap]" ) {
+    persistent_treap::node_ptr<int> persistent;
+    std::unique_ptr<treap::node> mutable_tree;
+    malloc_arena<treap::node> arena;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<> key(0, 1000);
+
+    for( int i = 0; i < 2000; i++ ) {
+        int k = key(rng);
+        bool present = persistent_treap::find( persistent, k ) != nullptr;
+        if( rng() % 4 ) {
+            unsigned p = rng();
+            if( !present )
+                persistent = persistent_treap::insert( persistent, k, p );
+            treap::insert( mutable_tree, k, p, arena );
+        }
+        else {
+            if( present )
+                persistent = persistent_treap::erase( persistent, k );
+            treap::remove( mutable_tree, k );
+        }
+        REQUIRE( same_shape(persistent.get(), mutable_tree.get()) );
+    }
+}
+
+TEST_CASE( "Persistent treap snapshots read by another thread", "[persistent_treap]" ) {
+    int_treap tree{std::mt19937{}};
+    for( int k = 0; k < 1000; k++ )
+        tree.insert( 2 * k );
+
+    std::atomic<bool> done{false};
+    std::atomic<int> mismatches{0};
+    auto snapshot = tree.snapshot();
+    std::thread reader( [&, snapshot]{
+        // The writer below never changes what this snapshot sees.
+        while( !done.load() )
+            for( int k = 0; k < 2000; k++ )
+                if( snapshot.count(k) != (k % 2 == 0 ? 1 : 0) )
+                    mismatches++;
+    });
+    for( int i = 0; i < 20000; i++ ) {
+        tree.erase( 2 * (i % 1000) );
+        tree.insert( 2 * (i % 1000) + 1 );
+        tree.erase( 2 * (i % 1000) + 1 );
+        tree.insert( 2 * (i % 1000) );
+    }
+    done = true;
+    reader.join();
+    CHECK( mismatches == 0 );
+}
+
+TEST_CASE( "Snapshotting adapter", "[persistent_treap]" ) {
+    persistent_treap::snapshot_stats stats;
+    {
+        persistent_treap::snapshotting<int_treap> tree( int_treap{std::mt19937{}}, 10, 3, &stats );
+        for( int k = 0; k < 100; k++ )
+            tree.insert( k );
+        for( int k = 0; k < 100; k += 2 )
+            tree.erase( k );
+        CHECK( tree.count(1) == 1 );
+        CHECK( tree.count(2) == 0 );
+    }
+    CHECK( stats.snapshots == 15 );
+    CHECK( stats.keys == 50 );
+    // The current version and three snapshots, of at most 70 keys each.
+    CHECK( stats.nodes >= 50 );
+    CHECK( stats.nodes <= 4 * 70 );
+    CHECK( stats.node_bytes == stats.nodes * sizeof(persistent_treap::node<int>) );
+}
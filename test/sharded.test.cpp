@@ -0,0 +1,101 @@
+#include "sharded.hpp"
+#include "avl.hpp"
+#include "treap.hpp"
+#include <catch.hpp>
+#include <limits>
+#include <random>
+#include <set>
+#include <thread>
+
+TEST_CASE( "Single-producer single-consumer queue", "[sharded]" ) {
+    sharded::spsc_queue<int> queue( 8 );
+    int value;
+    CHECK( !queue.try_pop(value) );
+    for( int i = 0; i < 8; i++ )
+        CHECK( queue.try_push(int(i)) );
+    CHECK( !queue.try_push(8) );
+    CHECK( queue.try_pop(value) );
+    CHECK( value == 0 );
+
+    long long sum = 0;
+    std::thread consumer( [&]{
+        int v;
+        for( int received = 0; received < 100007; )
+            if( queue.try_pop(v) ) {
+                sum += v;
+                received++;
+            }
+    });
+    // 1 to 7 are still in the queue.
+    for( int i = 8; i < 100008; i++ )
+        while( !queue.try_push(int(i)) )
+            std::this_thread::yield();
+    consumer.join();
+    CHECK( sum == 100007LL * 100008 / 2 );
+}
+
+namespace {
+    template< typename TreeMaker >
+    void check_sharded( TreeMaker maker ) {
+        sharded::options opts;
+        opts.batch_size = 16;
+        opts.rebalance_period = 1000;
+        sharded::sharded<decltype(maker())> tree( maker, 4, 0, 10000, opts );
+        std::set<int> reference;
+        std::mt19937 rng(0);
+        long long expected = 0;
+
+        // Uniform at first, then skewed towards the lowest keys.
+        for( int i = 0; i < 40000; i++ ) {
+            int k = i < 10000 ? rng() % 10000 : rng() % 1000;
+            switch( rng() % 3 ) {
+                case 0:
+                    tree.submit( sharded::op_kind::insert, k );
+                    reference.insert( k );
+                    break;
+                case 1:
+                    tree.submit( sharded::op_kind::erase, k );
+                    reference.erase( k );
+                    break;
+                default:
+                    tree.submit( sharded::op_kind::count, k );
+                    expected += reference.count( k );
+            }
+        }
+        REQUIRE( tree.drain() == expected );
+        CHECK( tree.rebalance_count() > 0 );
+        CHECK( tree.moved_keys() > 0 );
+
+        // Every key is still found, wherever it was moved.
+        for( int k = -10; k < 10010; k++ )
+            tree.submit( sharded::op_kind::count, k );
+        CHECK( tree.drain() == expected + (long long) reference.size() );
+
+        long long ops = 0;
+        for( const auto & load : tree.loads() )
+            ops += load.ops;
+        CHECK( ops == 40000 + 10020 );
+    }
+}
+
+TEST_CASE( "Sharded trees", "[sharded]" ) {
+    SECTION( "AVL" ) {
+        check_sharded( [](){ return avl::avl<>(); } );
+    }
+    SECTION( "Treap" ) {
+        check_sharded( [](){ return treap::treap<>{std::mt19937{}}; } );
+    }
+}
+
+TEST_CASE( "Sharded trees over the whole key range", "[sharded]" ) {
+    const int lo = std::numeric_limits<int>::min(), hi = std::numeric_limits<int>::max();
+    sharded::sharded<avl::avl<>> tree( [](){ return avl::avl<>(); }, 4, lo, hi );
+    // Two keys in each quarter of the range.
+    for( int key : {lo, lo / 2 - 10, lo / 2 + 10, -10, 0, hi / 2 - 10, hi / 2 + 10, hi} ) {
+        tree.submit( sharded::op_kind::insert, key );
+        tree.submit( sharded::op_kind::count, key );
+    }
+    CHECK( tree.drain() == 8 );
+    for( const auto & load : tree.loads() )
+        CHECK( load.ops == 4 );
+}
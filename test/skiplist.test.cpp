@@ -0,0 +1,98 @@
+#include "skiplist.hpp"
+#include "xorshift.hpp"
+#include <catch.hpp>
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+    using int_skiplist = skiplist::skiplist<int, xorshift>;
+}
+
+TEST_CASE( "Skip list seeded with 0", "[skiplist]" ) {
+    int_skiplist list{0};
+    for( int i = 0; i < 4096; i++ )
+        list.insert( i );
+    for( int i = -1; i <= 4096; i++ )
+        REQUIRE( list.count(i) == (i >= 0 && i < 4096) );
+    // A degenerate list would have every node at the greatest height.
+    CHECK( list.levels() < 24 );
+}
+
+TEST_CASE( "Skip list std::set-like interface", "[skiplist]" ) {
+    int_skiplist list{1};
+    std::set<int> reference;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 1000);
+
+    for( int i = 0; i < 20000; i++ ) {
+        int k = key(rng);
+        if( rng() % 3 ) {
+            list.insert( k );
+            reference.insert( k );
+        }
+        else {
+            list.erase( k );
+            reference.erase( k );
+        }
+        if( i % 1000 == 0 )
+            for( int j = 0; j <= 1000; j++ )
+                REQUIRE( list.count(j) == (int) reference.count(j) );
+    }
+    for( int k = -1; k <= 1001; k++ )
+        CHECK( list.count(k) == (int) reference.count(k) );
+}
+
+TEST_CASE( "Skip list with a custom comparator", "[skiplist]" ) {
+    skiplist::skiplist<int, std::mt19937, std::greater<int>> list{1};
+    for( int k = 0; k < 100; k++ )
+        list.insert( k );
+    for( int k = 0; k < 100; k += 2 )
+        list.erase( k );
+    for( int k = 0; k < 100; k++ )
+        CHECK( list.count(k) == k % 2 );
+}
+
+TEST_CASE( "Skip list shared by several threads", "[skiplist]" ) {
+    int_skiplist list{1};
+    // Multiples of 3 stay in the list; the writers never touch them.
+    for( int k = 0; k < 3000; k += 3 )
+        list.insert( k );
+
+    std::atomic<bool> done{false};
+    std::atomic<int> errors{0};
+    std::thread reader( [&]{
+        while( !done.load() )
+            for( int k = 0; k < 3000; k += 3 )
+                if( list.count(k) != 1 )
+                    errors++;
+    });
+
+    // Every writer inserts the same keys, then erases the same ones.
+    std::vector<std::thread> writers;
+    for( int w = 0; w < 4; w++ )
+        writers.emplace_back( [&list, w]{
+            for( int round = 0; round < 5; round++ ) {
+                for( int i = 0; i < 3000; i++ ) {
+                    int k = (i * 7 + w * 1000) % 3000;
+                    if( k % 3 != 0 )
+                        list.insert( k );
+                }
+                for( int i = 0; i < 3000; i++ ) {
+                    int k = (i * 11 + w * 1000) % 3000;
+                    if( k % 3 == 1 )
+                        list.erase( k );
+                }
+            }
+        });
+    for( std::thread & w : writers )
+        w.join();
+    done = true;
+    reader.join();
+
+    CHECK( errors == 0 );
+    for( int k = 0; k < 3000; k++ )
+        REQUIRE( list.count(k) == (k % 3 == 1 ? 0 : 1) );
+}
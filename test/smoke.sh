@@ -0,0 +1,27 @@
+#!/bin/bash
+# Runs ./main once in each of its modes, on small test cases,
+# and fails if any of them fails.
+# Run from the root of the repository, after building main.
+
+small="--total-insertions 2000 --initial-insertions 1000 --search-successes 1000"
+small="$small --search-failures 1000 --removals 500 --runs 1"
+
+runs=(
+    "treap-xorshift insert-then-search"
+    "avl mixed-workload"
+    "treap-persistent mixed-workload --snapshot-every 100"
+    "treap-xorshift insert-then-search --stream"
+    "treap-simd sliding-window --window 500"
+    "skiplist mixed-workload"
+    "frozen-avl insert-then-search"
+)
+
+status=0
+for run in "${runs[@]}"; do
+    if ! ./main $run $small > /dev/null; then
+        echo "FAILED: ./main $run"
+        status=1
+    fi
+done
+[ $status -eq 0 ] && echo "All ${#runs[@]} smoke runs passed"
+exit $status
@@ -0,0 +1,139 @@
+#include "streaming.hpp"
+#include <catch.hpp>
+
+#include <set>
+
+namespace {
+    test_case generate_all( streaming::generator & g, std::size_t chunk ) {
+        test_case ret;
+        std::vector<operation> buffer( chunk );
+        while( std::size_t n = g.fill(buffer.data(), chunk) )
+            ret.insert( ret.end(), buffer.begin(), buffer.begin() + n );
+        return ret;
+    }
+
+    long long count_type( const test_case & ops, operation_type type ) {
+        return std::count_if( ops.begin(), ops.end(),
+                [type]( const operation & op ){ return op.type == type; });
+    }
+}
+
+TEST_CASE( "Shuffled counts draw each category exactly", "[streaming]" ) {
+    std::mt19937 rng( 3 );
+    streaming::shuffled_counts<3> counts({ 5, 0, 20 });
+    int drawn[3] = {0, 0, 0};
+    for( int i = 0; i < 25; i++ )
+        drawn[counts.next(rng)]++;
+    CHECK( drawn[0] == 5 );
+    CHECK( drawn[1] == 0 );
+    CHECK( drawn[2] == 20 );
+}
+
+TEST_CASE( "Streamed insert-then-search", "[streaming]" ) {
+    for( bool ascending : {false, true} ) {
+        streaming::insert_then_search g( 1000, 300, 200, 5, ascending );
+        test_case ops = generate_all( g, 64 );
+        REQUIRE( ops.size() == 1500 );
+
+        std::set<int> keys;
+        for( int i = 0; i < 1000; i++ ) {
+            REQUIRE( ops[i].type == operation_type::insert );
+            keys.insert( ops[i].key );
+            if( ascending )
+                CHECK( ops[i].key == 2 * i + 2 );
+        }
+        CHECK( keys.size() == 1000 );
+        CHECK( *keys.begin() == 2 );
+        CHECK( *keys.rbegin() == 2000 );
+
+        int successes = 0;
+        for( std::size_t i = 1000; i < ops.size(); i++ ) {
+            REQUIRE( ops[i].type == operation_type::count );
+            successes += keys.count( ops[i].key );
+        }
+        CHECK( successes == 300 );
+    }
+}
+
+TEST_CASE( "Streamed insert-then-remove-then-search", "[streaming]" ) {
+    streaming::insert_then_remove_then_search g( 1000, 400, 300, 200, 7 );
+    test_case ops = generate_all( g, 100 );
+    REQUIRE( ops.size() == 1900 );
+
+    std::set<int> keys;
+    int removed = 0, successes = 0;
+    for( const operation & op : ops ) {
+        if( op.type == operation_type::insert )
+            CHECK( keys.insert(op.key).second );
+        else if( op.type == operation_type::erase )
+            removed += keys.erase( op.key );
+        else
+            successes += keys.count( op.key );
+    }
+    CHECK( removed == 400 );
+    CHECK( successes == 300 );
+}
+
+TEST_CASE( "Streamed mixed workload", "[streaming]" ) {
+    streaming::mixed_workload g( 100, 1000, 500, 300, 200, 11 );
+    test_case ops = generate_all( g, 33 );
+    REQUIRE( ops.size() == 2000 );
+    CHECK( count_type(ops, operation_type::insert) == 1000 );
+    CHECK( count_type(ops, operation_type::erase) == 500 );
+    CHECK( count_type(ops, operation_type::count) == 500 );
+    for( int i = 0; i < 100; i++ )
+        CHECK( ops[i].type == operation_type::insert );
+
+    // Removals only miss when the tree is empty.
+    std::set<int> keys;
+    for( const operation & op : ops ) {
+        if( op.type == operation_type::insert )
+            CHECK( keys.insert(op.key).second );
+        else if( op.type == operation_type::erase && !keys.empty() )
+            CHECK( keys.erase(op.key) == 1 );
+    }
+}
+
+TEST_CASE( "Double buffer hands out the generated operations in order", "[streaming]" ) {
+    streaming::insert_then_search expected_g( 1000, 3000, 1000, 13 );
+    test_case expected = generate_all( expected_g, 1000 );
+
+    streaming::insert_then_search g( 1000, 3000, 1000, 13 );
+    streaming::double_buffer buffer( g, 37 );
+    test_case got;
+    for( test_view chunk = buffer.next(); !chunk.empty(); chunk = buffer.next() ) {
+        CHECK( chunk.size() <= 37 );
+        got.insert( got.end(), chunk.begin(), chunk.end() );
+    }
+    CHECK( buffer.next().empty() );
+    CHECK( buffer.operations() == 5000 );
+    REQUIRE( got.size() == expected.size() );
+    for( std::size_t i = 0; i < got.size(); i++ ) {
+        REQUIRE( got[i].type == expected[i].type );
+        REQUIRE( got[i].key == expected[i].key );
+    }
+}
+
+TEST_CASE( "Double buffer stops early", "[streaming]" ) {
+    streaming::insert_then_search g( 100000, 0, 0, 1 );
+    streaming::double_buffer buffer( g, 64 );
+    CHECK( buffer.next().size() == 64 );
+    // The destructor must not wait for the rest.
+}
+
+TEST_CASE( "run_test_case reads the stream", "[streaming]" ) {
+    streaming::insert_then_search g( 500, 500, 0, 17 );
+    streaming::double_buffer buffer( g, 50 );
+    std::set<int> keys;
+    struct recorder {
+        std::set<int> * keys;
+        void insert( int key ) { keys->insert(key); }
+        void erase( int key ) { keys->erase(key); }
+        int count( int key ) const { return keys->count(key); }
+    };
+    run_options options;
+    options.stream = &buffer;
+    run_test_case( [&](){ return recorder{ &keys }; }, test_view(), options );
+    CHECK( keys.size() == 500 );
+    CHECK( buffer.operations() == 1000 );
+}
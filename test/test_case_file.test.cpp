@@ -0,0 +1,145 @@
+#include "test_case_file.hpp"
+#include <catch.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    // Temporary file, removed at the end of the scope.
+    struct temp_file {
+        std::string path = "test_case_file.test.tmp";
+        ~temp_file() {
+            std::remove( path.c_str() );
+        }
+    };
+}
+
+TEST_CASE( "Test case files round trip", "[test_case_file]" ) {
+    test_case ops = {
+        {operation_type::insert, 5},
+        {operation_type::insert, -3},
+        {operation_type::count, 5},
+        {operation_type::erase, -3},
+        {operation_type::range_scan, 1, 9},
+    };
+    temp_file f;
+    test_case_file::save( f.path, ops );
+
+    test_case_file::mapped file( f.path );
+    test_view v = file.view();
+    REQUIRE( v.size() == ops.size() );
+    for( std::size_t i = 0; i < ops.size(); i++ ) {
+        CHECK( v[i].type == ops[i].type );
+        CHECK( v[i].key == ops[i].key );
+        CHECK( v[i].hi() == ops[i].hi() );
+    }
+
+    test_case_file::mapped moved( std::move(file) );
+    CHECK( moved.view().data() == v.data() );
+
+    test_case_file::save( f.path, test_case() );
+    CHECK( test_case_file::mapped( f.path ).view().empty() );
+}
+
+TEST_CASE( "Invalid test case files are refused", "[test_case_file]" ) {
+    temp_file f;
+    test_case ops( 10, operation{operation_type::insert, 1} );
+    test_case_file::save( f.path, ops );
+
+    std::string bytes;
+    {
+        std::ifstream in( f.path, std::ios::binary );
+        bytes.assign( std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() );
+    }
+    auto write = [&]( const std::string & content ) {
+        std::ofstream( f.path, std::ios::binary ) << content;
+    };
+
+    write( bytes.substr(0, bytes.size() - 1) );
+    CHECK_THROWS_AS( test_case_file::mapped( f.path ), std::runtime_error );
+
+    write( bytes.substr(0, 4) );
+    CHECK_THROWS_AS( test_case_file::mapped( f.path ), std::runtime_error );
+
+    std::string bad_magic = bytes;
+    bad_magic[0] = 'X';
+    write( bad_magic );
+    CHECK_THROWS_AS( test_case_file::mapped( f.path ), std::runtime_error );
+
+    CHECK_THROWS_AS( test_case_file::mapped( "no/such/file" ), std::runtime_error );
+
+    // The type of the last operation is its first byte.
+    std::string bad_type = bytes;
+    bad_type[bytes.size() - sizeof(operation)] = operation_types;
+    write( bad_type );
+    CHECK_THROWS_WITH( test_case_file::mapped( f.path ), Catch::Contains("unknown type, at 9") );
+}
+
+TEST_CASE( "Text traces are imported", "[test_case_file]" ) {
+    std::istringstream in(
+        "# A trace\n"
+        "load -9\n"
+        "LOAD 2\n"
+        "Insert 4\n"
+        "PUT -7\n"
+        "\n"
+        "get 4\n"
+        "12\n"
+        "delete 4\n"
+        "Scan 1 10\n"
+        "rank 3\n"
+    );
+    test_case ops = test_case_file::import_text( in );
+    REQUIRE( ops.size() == 9 );
+    CHECK( ops[0].type == operation_type::bulk_load );
+    CHECK( ops[0].key == -9 );
+    CHECK( ops[1].type == operation_type::bulk_load );
+    CHECK( ops[1].key == 2 );
+    ops.erase( ops.begin(), ops.begin() + 2 );
+    CHECK( ops[0].type == operation_type::insert );
+    CHECK( ops[0].key == 4 );
+    CHECK( ops[1].type == operation_type::insert );
+    CHECK( ops[1].key == -7 );
+    CHECK( ops[2].type == operation_type::count );
+    CHECK( ops[3].type == operation_type::count );
+    CHECK( ops[3].key == 12 );
+    CHECK( ops[4].type == operation_type::erase );
+    CHECK( ops[5].type == operation_type::range_scan );
+    CHECK( ops[5].key == 1 );
+    CHECK( ops[5].hi() == 10 );
+    CHECK( ops[6].type == operation_type::rank );
+
+    for( std::string line : {"jump 3", "insert", "insert 3 4", "scan 1", "scan 5 1",
+            "scan 0 20000000", "3 4", "get x"} ) {
+        std::istringstream bad( "insert 1\n" + line + "\n" );
+        CHECK_THROWS_WITH( test_case_file::import_text( bad ),
+                Catch::Contains( "line 2" ) );
+    }
+}
+
+TEST_CASE( "Bulk loads must open the test case in ascending keys", "[test_case_file]" ) {
+    for( const char * trace : {"load 1\nload 1\n", "load 2\nload 1\n", "insert 1\nload 2\n",
+            "load 1\ncount 1\nload 2\n"} ) {
+        std::istringstream bad( trace );
+        CHECK_THROWS_WITH( test_case_file::import_text( bad ),
+                Catch::Contains( "out of order or after other operations" ) );
+    }
+
+    temp_file f;
+    test_case ops = {
+        {operation_type::bulk_load, 1},
+        {operation_type::bulk_load, 3},
+        {operation_type::count, 3},
+    };
+    test_case_file::save( f.path, ops );
+    CHECK( test_case_file::mapped( f.path ).view().size() == 3 );
+
+    ops.push_back( {operation_type::bulk_load, 5} );
+    test_case_file::save( f.path, ops );
+    CHECK_THROWS_WITH( test_case_file::mapped( f.path ), Catch::Contains("at 3") );
+
+    ops = { {operation_type::bulk_load, 3}, {operation_type::bulk_load, 3} };
+    test_case_file::save( f.path, ops );
+    CHECK_THROWS_WITH( test_case_file::mapped( f.path ), Catch::Contains("at 1") );
+}
@@ -1,6 +1,15 @@
 #include "treap.hpp"
 #include <catch.hpp>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <functional>
 #include <random>
+#include <string>
+
+// Treap of int keys with the given allocator and engine.
+template< typename Allocator, typename Engine = treap::rotation_engine >
+using int_treap = treap::treap<int, void, std::mt19937, std::less<int>, Allocator, Engine>;
 
 TEST_CASE( "Treap rotation", "[treap]") {
     constexpr int A = 1, B = 2, alpha = 3, beta = 4, gamma = 5;
@@ -111,7 +120,7 @@ TEST_CASE( "Treap insert and remove", "[treap]" ) {
 }
 
 TEST_CASE( "Treap std::set-like interface", "[treap]" ) {
-    treap::treap<std::mt19937> tree{std::mt19937{}}; // most vexing parse
+    treap::treap<> tree{std::mt19937{}}; // most vexing parse
     CHECK( tree.count(5) == 0 );
     tree.insert( 1 );
     CHECK( tree.count(1) == 1 );
@@ -129,3 +138,284 @@ TEST_CASE( "Treap std::set-like interface", "[treap]" ) {
     CHECK( tree.count(3) == 1 );
     CHECK( tree.count(12) == 0 );
 }
+
+TEST_CASE( "Treap with the pool allocator", "[treap]" ) {
+    int_treap<pool_allocator> tree{std::mt19937{}};
+    for( int i = 0; i < 10000; i++ )
+        tree.insert( (i * 7919) % 10000 );
+    for( int i = 0; i < 10000; i += 2 )
+        tree.erase( i );
+    for( int i = 0; i < 5000; i++ )
+        tree.insert( 10000 + i );
+
+    CHECK( tree.count(0) == 0 );
+    CHECK( tree.count(1) == 1 );
+    CHECK( tree.count(9998) == 0 );
+    CHECK( tree.count(9999) == 1 );
+    CHECK( tree.count(14999) == 1 );
+    CHECK( tree.count(15000) == 0 );
+}
+
+bool same_shape( const std::unique_ptr<treap::node> & a, const std::unique_ptr<treap::node> & b ) {
+    if( !a || !b )
+        return !a && !b;
+    return a->key == b->key && a->priority == b->priority
+        && same_shape( a->lchild, b->lchild ) && same_shape( a->rchild, b->rchild );
+}
+
+TEST_CASE( "Treap split and merge", "[treap]" ) {
+    auto tree = std::make_unique<treap::node>(5, 80,
+            std::make_unique<treap::node>(2, 50,
+                nullptr,
+                std::make_unique<treap::node>(4, 40)),
+            std::make_unique<treap::node>(9, 20,
+                std::make_unique<treap::node>(7, 10),
+                nullptr));
+
+    std::unique_ptr<treap::node> left, right;
+    treap::split( tree, 5, left, right );
+    CHECK( tree == nullptr );
+    CHECK( left->key == 2 );
+    CHECK( left->rchild->key == 4 );
+    CHECK( left->rchild->rchild == nullptr );
+    CHECK( right->key == 5 );
+    CHECK( right->lchild == nullptr );
+    CHECK( right->rchild->key == 9 );
+    CHECK( right->rchild->lchild->key == 7 );
+
+    tree = treap::merge( left, right );
+    CHECK( left == nullptr );
+    CHECK( right == nullptr );
+    CHECK( tree->key == 5 );
+    CHECK( tree->lchild->key == 2 );
+    CHECK( tree->lchild->rchild->key == 4 );
+    CHECK( tree->rchild->key == 9 );
+    CHECK( tree->rchild->lchild->key == 7 );
+}
+
+TEST_CASE( "Treap engines build the same tree", "[treap]" ) {
+    std::unique_ptr<treap::node> rotated, split;
+    malloc_arena<treap::node> arena;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 500);
+    std::uniform_int_distribution<unsigned> priority(0, 100); // Force some ties.
+
+    for( int i = 0; i < 5000; i++ ) {
+        int k = key(rng);
+        if( rng() % 3 ) {
+            unsigned p = priority(rng);
+            treap::insert( rotated, k, p, arena );
+            treap::split_insert( split, k, p, arena );
+        }
+        else {
+            treap::remove( rotated, k );
+            treap::merge_remove( split, k );
+        }
+        REQUIRE( same_shape(rotated, split) );
+    }
+}
+
+TEST_CASE( "Split-merge treap std::set-like interface", "[treap]" ) {
+    int_treap<malloc_allocator, treap::split_merge_engine> tree{std::mt19937{}};
+    CHECK( tree.count(5) == 0 );
+    tree.insert( 1 );
+    CHECK( tree.count(1) == 1 );
+    tree.insert( 3 );
+    tree.insert( 6 );
+    tree.insert( 12 );
+    tree.insert( 9 );
+    tree.insert( 1 );
+    CHECK( tree.count(3) == 1 );
+    CHECK( tree.count(12) == 1 );
+    CHECK( tree.count(9) == 1 );
+    tree.erase( 3 );
+    tree.erase( 12 );
+    tree.insert( 3 );
+    CHECK( tree.count(3) == 1 );
+    CHECK( tree.count(12) == 0 );
+}
+
+namespace {
+    template< typename Treap >
+    Treap make_treap( const std::vector<int> & keys, unsigned seed ) {
+        Treap tree{std::mt19937{seed}};
+        for( int key : keys )
+            tree.insert( key );
+        return tree;
+    }
+
+    template< typename Treap >
+    void check_contents( Treap & tree, const std::vector<int> & expected, int max_key ) {
+        for( int k = 0; k <= max_key; k++ ) {
+            bool present = std::binary_search( expected.begin(), expected.end(), k );
+            REQUIRE( tree.count(k) == (present ? 1 : 0) );
+        }
+    }
+
+    template< typename Treap >
+    void check_set_operations( fork_join::pool * pool ) {
+        std::vector<int> a, b;
+        for( int i = 0; i < 3000; i += 2 )
+            a.push_back(i);
+        for( int i = 0; i < 3000; i += 3 )
+            b.push_back(i);
+
+        auto run = [&]( auto f ) {
+            if( pool )
+                pool->run( f );
+            else
+                f();
+        };
+
+        std::vector<int> expected;
+        {
+            auto x = make_treap<Treap>( a, 1 );
+            auto y = make_treap<Treap>( b, 2 );
+            run( [&]{ x.union_with(y); } );
+            std::set_union( a.begin(), a.end(), b.begin(), b.end(),
+                    std::back_inserter(expected) );
+            check_contents( x, expected, 3000 );
+            check_contents( y, {}, 3000 );
+        }
+        expected.clear();
+        {
+            auto x = make_treap<Treap>( a, 1 );
+            auto y = make_treap<Treap>( b, 2 );
+            run( [&]{ x.intersect_with(y); } );
+            std::set_intersection( a.begin(), a.end(), b.begin(), b.end(),
+                    std::back_inserter(expected) );
+            check_contents( x, expected, 3000 );
+        }
+        expected.clear();
+        {
+            auto x = make_treap<Treap>( a, 1 );
+            auto y = make_treap<Treap>( b, 2 );
+            run( [&]{ x.difference_with(y); } );
+            std::set_difference( a.begin(), a.end(), b.begin(), b.end(),
+                    std::back_inserter(expected) );
+            check_contents( x, expected, 3000 );
+            // The result must still be a valid treap.
+            x.insert( 3 );
+            x.erase( 4 );
+            CHECK( x.count(3) == 1 );
+            CHECK( x.count(4) == 0 );
+        }
+    }
+}
+
+TEST_CASE( "Treap set operations", "[treap]" ) {
+    using malloc_treap = treap::treap<>;
+    using pool_treap = int_treap<pool_allocator>;
+
+    SECTION( "Sequential" ) {
+        check_set_operations<malloc_treap>( nullptr );
+        check_set_operations<pool_treap>( nullptr );
+    }
+    SECTION( "Parallel" ) {
+        fork_join::pool pool(4);
+        check_set_operations<malloc_treap>( &pool );
+        check_set_operations<pool_treap>( &pool );
+    }
+}
+
+/* Checks the search tree and the heap properties.
+ * Every key must be in the open interval (lo, hi).
+ */
+bool is_treap( const std::unique_ptr<treap::node> & tree, long long lo, long long hi ) {
+    if( !tree )
+        return true;
+    if( tree->key <= lo || tree->key >= hi )
+        return false;
+    for( auto * child : {tree->lchild.get(), tree->rchild.get()} )
+        if( child && child->priority > tree->priority )
+            return false;
+    return is_treap( tree->lchild, lo, tree->key ) && is_treap( tree->rchild, tree->key, hi );
+}
+
+TEST_CASE( "Treap built from a sorted range", "[treap]" ) {
+    std::vector<int> keys;
+    for( int i = 0; i < 1000; i++ )
+        keys.push_back( 3 * i );
+
+    std::mt19937 rng(0);
+    malloc_arena<treap::node> arena;
+    auto tree = treap::build_sorted( keys.begin(), keys.end(), rng, arena );
+    CHECK( is_treap(tree, -1, 3000) );
+    for( int k = 0; k < 3000; k++ )
+        CHECK( (treap::search(tree, k) != nullptr) == (k % 3 == 0) );
+
+    int_treap<pool_allocator> t{std::mt19937{}};
+    t.insert( 1 );
+    t.assign_sorted( keys.begin(), keys.end() );
+    CHECK( t.count(1) == 0 );
+    CHECK( t.count(2997) == 1 );
+    t.insert( 1 );
+    t.erase( 0 );
+    CHECK( t.count(1) == 1 );
+    CHECK( t.count(0) == 0 );
+}
+
+TEST_CASE( "Treap insertion with a finger", "[treap]" ) {
+    std::unique_ptr<treap::node> fingered, rotated;
+    malloc_arena<treap::node> arena;
+    treap::finger<std::unique_ptr<treap::node>> f;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> key(0, 100000);
+
+    // Ascending, then descending, then random runs, reusing the same finger.
+    for( int i = 0; i < 3000; i++ ) {
+        int k;
+        if( i < 1000 )
+            k = 2 * i;
+        else if( i < 2000 )
+            k = 4001 - 2 * (i - 1000);
+        else
+            k = key(rng);
+        unsigned p = rng();
+        treap::node * n = treap::insert_with_finger( fingered, k, p, arena, f ).first;
+        treap::insert( rotated, k, p, arena );
+        REQUIRE( n->key == k );
+        REQUIRE( same_shape(fingered, rotated) );
+    }
+    CHECK( is_treap(fingered, -1, 100001) );
+
+    int_treap<pool_allocator, treap::split_merge_engine> t{std::mt19937{}};
+    for( int i = 0; i < 1000; i++ )
+        t.insert( t.end(), i );
+    t.erase( 999 );
+    t.insert( 500 );
+    for( int i = 999; i < 2000; i++ )
+        CHECK( t.insert( t.end(), i )->key == i );
+    for( int i = 0; i < 2000; i++ )
+        CHECK( t.count(i) == 1 );
+}
+
+TEST_CASE( "Treap map interface", "[treap]" ) {
+    using map_type = treap::treap<std::uint64_t, std::unique_ptr<std::string>, std::mt19937,
+          std::less<std::uint64_t>, pool_allocator, treap::split_merge_engine>;
+    map_type map{std::mt19937{}};
+    for( std::uint64_t i = 0; i < 1000; i++ )
+        map.emplace( i << 33, std::make_unique<std::string>(std::to_string(i)) );
+    CHECK( map.emplace( 5ull << 33, nullptr ).second == false );
+    CHECK( **map.find(5ull << 33) == "5" );
+    CHECK( map.find(5) == nullptr );
+    map.erase( 5ull << 33 );
+    CHECK( map.find(5ull << 33) == nullptr );
+    CHECK( map[5ull << 33] == nullptr );
+
+    // Set operations carry the values along.
+    map_type other{std::mt19937{1}};
+    for( std::uint64_t i = 1000; i < 1100; i++ )
+        other.emplace( i << 33, std::make_unique<std::string>(std::to_string(i)) );
+    map.union_with( other );
+    CHECK( **map.find(1050ull << 33) == "1050" );
+    CHECK( **map.find(999ull << 33) == "999" );
+
+    treap::treap<int, int, std::mt19937, std::greater<int>> descending{std::mt19937{}};
+    for( int i = 0; i < 100; i++ )
+        descending.insert( descending.end(), i );
+    for( int i = 0; i < 100; i++ )
+        descending[i] = -i;
+    for( int i = 0; i < 100; i++ )
+        CHECK( *descending.find(i) == -i );
+}
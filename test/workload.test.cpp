@@ -0,0 +1,150 @@
+#include "workload.hpp"
+#include <catch.hpp>
+
+#include <map>
+#include <set>
+#include <sstream>
+
+TEST_CASE( "Zipf distribution", "[workload]" ) {
+    std::mt19937 rng( 1 );
+    generation::zipf z( 100, 1.0 );
+    std::vector<int> counts( 100 );
+    int draws = 200'000;
+    for( int i = 0; i < draws; i++ ) {
+        std::uint64_t k = z(rng);
+        REQUIRE( k < 100 );
+        counts[k]++;
+    }
+    double harmonic = 0;
+    for( int k = 1; k <= 100; k++ )
+        harmonic += 1.0 / k;
+    for( int k : {0, 1, 9, 99} ) {
+        double expected = draws / (k + 1) / harmonic;
+        CHECK( std::abs(counts[k] - expected) < 5 * std::sqrt(expected) );
+    }
+
+    generation::zipf uniform( 10, 0 );
+    std::vector<int> flat( 10 );
+    for( int i = 0; i < 100'000; i++ )
+        flat[uniform(rng)]++;
+    for( int c : flat )
+        CHECK( std::abs(c - 10'000) < 500 );
+
+    generation::zipf one( 1, 0.99 );
+    CHECK( one(rng) == 0 );
+}
+
+TEST_CASE( "Workload specs are read", "[workload]" ) {
+    std::istringstream in(
+        "# A spec\n"
+        "keys 500\n"
+        "phase 500\n"
+        "  insert 1 fresh\n"
+        "phase 1000 cycle  # In order\n"
+        "  insert 1 fresh\n"
+        "  erase 1 oldest\n"
+        "  search 3 recent 100 0.9\n"
+        "phase 10\n"
+        "  search 0.5 zipf 1.2\n"
+        "  search 0.25 hot 0.1 0.9\n"
+        "  search 0.25 miss\n"
+        "  scan 1 20\n"
+        "  rank 1 recent\n"
+    );
+    // Ranks only take their keys uniformly.
+    CHECK_THROWS_WITH( workload::parse(in, 7), Catch::Contains("line 14") );
+
+    std::istringstream good(
+        "keys 500\n"
+        "phase 500\n"
+        "insert 1 fresh\n"
+        "phase 1000 cycle\n"
+        "erase 1 oldest\n"
+        "search 3 recent 100\n"
+        "scan 2 20 zipf 0.5\n"
+    );
+    workload::spec s = workload::parse( good, 7 );
+    CHECK( s.keys == 500 );
+    REQUIRE( s.phases.size() == 2 );
+    CHECK( s.size() == 1500 );
+    CHECK_FALSE( s.phases[0].cycle );
+    CHECK( s.phases[1].cycle );
+    REQUIRE( s.phases[1].steps.size() == 3 );
+    CHECK( s.phases[1].steps[1].keys.choice == workload::key_choice::recent );
+    CHECK( s.phases[1].steps[1].keys.window == 100 );
+    CHECK( s.phases[1].steps[1].keys.theta == 0 );
+    CHECK( s.phases[1].steps[2].type == operation_type::range_scan );
+    CHECK( s.phases[1].steps[2].length == 20 );
+    CHECK( s.phases[1].steps[2].keys.theta == 0.5 );
+
+    for( std::string bad : {
+            "insert 1",                  // Outside a phase.
+            "phase 10\nfly 1",
+            "phase 10\ninsert 0",
+            "phase 10 cycle\ninsert 1.5",
+            "phase 10\nerase 1 fresh",
+            "phase 10\nsearch 1 hot 2 0.5",
+            "phase 10\nsearch 1 zipf",
+            "phase 10\nsearch 1 miss extra",
+            "phase 10\nscan 1",
+            "phase 10\nscan 1 10000000",   // Wider than an operation holds.
+            "phase 10",                  // No steps.
+            "keys 0\nphase 1\ninsert 1",
+            "" } ) {
+        std::istringstream b( bad );
+        CHECK_THROWS_AS( workload::parse(b, 10), std::runtime_error );
+    }
+}
+
+TEST_CASE( "Sliding window keeps the newest keys", "[workload]" ) {
+    int window = 1000;
+    test_case c = workload::generate( workload::sliding_window(20'000, window, 3, 0.99), 5, 2 );
+    REQUIRE( c.size() == window + 19'000u * 5 );
+
+    std::set<int> keys;
+    for( std::size_t i = 0; i < c.size(); i++ ) {
+        const operation & op = c[i];
+        switch( op.type ) {
+            case operation_type::insert:
+                CHECK( keys.insert(op.key).second );
+                break;
+            case operation_type::erase:
+                CHECK( keys.erase(op.key) == 1 );
+                CHECK( keys.size() == (std::size_t) window );
+                break;
+            default:
+                CHECK( keys.count(op.key) == 1 );
+        }
+        if( i >= (std::size_t) window )
+            CHECK( op.type == (operation_type[]){ operation_type::insert, operation_type::erase,
+                    operation_type::count, operation_type::count,
+                    operation_type::count }[(i - window) % 5] );
+    }
+}
+
+TEST_CASE( "Hot and cold keys", "[workload]" ) {
+    int values = 10'000;
+    test_case c = workload::generate(
+            workload::hot_set_search(values, 100'000, 0, 0.01, 0.9), 3, 1 );
+    std::map<int, int> hits;
+    for( std::size_t i = values; i < c.size(); i++ )
+        hits[c[i].key]++;
+    std::vector<int> counts;
+    for( auto & h : hits )
+        counts.push_back( h.second );
+    std::sort( counts.rbegin(), counts.rend() );
+    // The 100 hot keys get 90% of the searches.
+    long long hot = std::accumulate( counts.begin(), counts.begin() + 100, 0LL );
+    CHECK( std::abs(hot - 90'000) < 1'000 );
+}
+
+TEST_CASE( "Workloads do not depend on the threads", "[workload]" ) {
+    workload::spec s = workload::zipf_search( 100'000, 100'000, 50'000, 0.8 );
+    s.phases.push_back( workload::sliding_window(200'000, 5'000, 2, 0).phases[1] );
+    test_case a = workload::generate( s, 9, 1 ), b = workload::generate( s, 9, 4 );
+    REQUIRE( a.size() == b.size() );
+    bool same = true;
+    for( std::size_t i = 0; i < a.size(); i++ )
+        same &= a[i].type == b[i].type && a[i].key == b[i].key && a[i].hi() == b[i].hi();
+    CHECK( same );
+}
@@ -0,0 +1,218 @@
+#ifndef TEST_CASE_FILE_HPP
+#define TEST_CASE_FILE_HPP
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "speed_test.hpp"
+
+/* Binary test case files, to record test cases and replay them.
+ *
+ * A file is a header followed by the operations, packed as they are in memory,
+ * so that a mapped file is run as it is, without reading nor copying it.
+ * The header records the size of an operation and a byte-order mark,
+ * so that a file is refused by a build that would lay the operations out
+ * differently; and a file with operations of unknown types is refused,
+ * as is one with misplaced bulk_load operations (see may_follow).
+ *
+ * import_text turns text traces into test cases:
+ * the output of --show, or traces of production traffic.
+ */
+namespace test_case_file {
+    static_assert( std::is_trivially_copyable<operation>::value,
+            "operations are written as they are in memory" );
+
+    struct header {
+        char magic[8];             // "TREECASE"
+        std::uint32_t byte_order;  // byte_order_mark, as written.
+        std::uint32_t record_size; // sizeof(operation)
+        std::uint64_t count;       // Number of operations.
+    };
+
+    constexpr char magic[8] = {'T', 'R', 'E', 'E', 'C', 'A', 'S', 'E'};
+    constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+    /* Whether op may follow 'previous' (null at the start of the test case).
+     * run_test_case loads a run of bulk_load operations at once into the
+     * empty tree, so such a run must open the test case, in ascending keys.
+     */
+    inline bool may_follow( const operation * previous, const operation & op ) {
+        return op.type != operation_type::bulk_load || !previous ||
+            (previous->type == operation_type::bulk_load && previous->key < op.key);
+    }
+
+    // Writes the operations to the file at 'path', which is replaced.
+    inline void save( const std::string & path, test_view ops ) {
+        std::FILE * f = std::fopen( path.c_str(), "wb" );
+        if( !f )
+            throw std::runtime_error( "cannot create " + path + ": " + std::strerror(errno) );
+        header h;
+        std::memcpy( h.magic, magic, sizeof(magic) );
+        h.byte_order = byte_order_mark;
+        h.record_size = sizeof(operation);
+        h.count = ops.size();
+        bool ok = std::fwrite( &h, sizeof(h), 1, f ) == 1 &&
+            std::fwrite( ops.data(), sizeof(operation), ops.size(), f ) == ops.size();
+        ok = std::fclose( f ) == 0 && ok;
+        if( !ok )
+            throw std::runtime_error( "cannot write " + path );
+    }
+
+    // Test case file mapped in memory, read-only.
+    class mapped {
+        void * address = nullptr;
+        std::size_t length = 0;
+        test_view ops;
+
+    public:
+        // Throws std::runtime_error if the file cannot be mapped or is not valid.
+        explicit mapped( const std::string & path ) {
+            int fd = open( path.c_str(), O_RDONLY );
+            if( fd < 0 )
+                throw std::runtime_error( "cannot open " + path + ": " + std::strerror(errno) );
+            struct stat st;
+            if( fstat(fd, &st) != 0 || (std::size_t) st.st_size < sizeof(header) ) {
+                close( fd );
+                throw std::runtime_error( path + " is not a test case file" );
+            }
+            length = st.st_size;
+            address = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+            close( fd ); // The mapping stays.
+            if( address == MAP_FAILED ) {
+                address = nullptr;
+                throw std::runtime_error( "cannot map " + path + ": " + std::strerror(errno) );
+            }
+
+            const header & h = *static_cast<const header *>( address );
+            const char * error = nullptr;
+            if( std::memcmp(h.magic, magic, sizeof(magic)) != 0 )
+                error = " is not a test case file";
+            else if( h.byte_order != byte_order_mark || h.record_size != sizeof(operation) )
+                error = " was written by an incompatible build";
+            else if( h.count > (length - sizeof(header)) / sizeof(operation) )
+                error = " is truncated";
+            if( error ) {
+                munmap( address, length );
+                address = nullptr;
+                throw std::runtime_error( path + error );
+            }
+            ops = test_view( reinterpret_cast<const operation *>(
+                    static_cast<const char *>(address) + sizeof(header) ), h.count );
+            /* run_test_case indexes tables by the type of an operation,
+             * so the types are checked once here instead of at every run.
+             */
+            for( std::size_t i = 0; i < ops.size(); i++ ) {
+                if( ops[i].type >= operation_types )
+                    error = " has an operation of unknown type, at ";
+                else if( !may_follow(i > 0 ? &ops[i-1] : nullptr, ops[i]) )
+                    error = " has a bulk_load out of order or after other operations, at ";
+                if( error ) {
+                    munmap( address, length );
+                    address = nullptr;
+                    throw std::runtime_error( path + error + std::to_string(i) );
+                }
+            }
+            // The operations are read once, in order.
+            madvise( address, length, MADV_SEQUENTIAL );
+        }
+
+        mapped( mapped && other ) :
+            address(std::exchange(other.address, nullptr)), length(other.length), ops(other.ops)
+        {}
+
+        mapped & operator=( mapped other ) {
+            std::swap( address, other.address );
+            std::swap( length, other.length );
+            std::swap( ops, other.ops );
+            return *this;
+        }
+
+        ~mapped() {
+            if( address )
+                munmap( address, length );
+        }
+
+        test_view view() const {
+            return ops;
+        }
+    };
+
+    /* Reads a text trace, one operation per line: a name and a key,
+     * and for scans, the end of the range. The names are
+     *  insert, put, set, add      - insert
+     *  erase, delete, del, remove - erase
+     *  count, get, find, lookup, read - count
+     *  load, rank, scan           - bulk_load, rank, range_scan
+     * in any case, which covers the output of --show.
+     * A line with a key alone is a count, as in traces of lookups.
+     * Blank lines, and lines starting with #, are skipped.
+     * The loads must come first, in ascending keys (see may_follow).
+     * Throws std::runtime_error on the first line it cannot read.
+     */
+    inline test_case import_text( std::istream & in ) {
+        test_case ret;
+        std::string line;
+        for( int number = 1; std::getline(in, line); number++ ) {
+            std::istringstream words( line );
+            std::string name;
+            if( !(words >> name) || name[0] == '#' )
+                continue;
+            for( char & c : name )
+                c = std::tolower( static_cast<unsigned char>(c) );
+
+            operation op{ operation_type::count, 0 };
+            bool has_name = true;
+            if( name == "insert" || name == "put" || name == "set" || name == "add" )
+                op.type = operation_type::insert;
+            else if( name == "erase" || name == "delete" || name == "del" || name == "remove" )
+                op.type = operation_type::erase;
+            else if( name == "count" || name == "get" || name == "find" ||
+                    name == "lookup" || name == "read" )
+                op.type = operation_type::count;
+            else if( name == "load" )
+                op.type = operation_type::bulk_load;
+            else if( name == "rank" )
+                op.type = operation_type::rank;
+            else if( name == "scan" )
+                op.type = operation_type::range_scan;
+            else
+                has_name = false;
+
+            std::istringstream key( has_name ? std::string() : name );
+            std::istream & source = has_name ? static_cast<std::istream &>(words) : key;
+            bool ok = static_cast<bool>( source >> op.key );
+            if( ok && op.type == operation_type::range_scan ) {
+                int hi;
+                ok = words >> hi && hi >= op.key
+                    && (long long) hi - op.key <= operation::max_width;
+                if( ok )
+                    op = operation{ op.type, op.key, hi };
+            }
+            std::string rest;
+            if( !ok || words >> rest || (!has_name && key >> rest) )
+                throw std::runtime_error( "line " + std::to_string(number) +
+                        ": cannot read \"" + line + "\"" );
+            if( !may_follow(ret.empty() ? nullptr : &ret.back(), op) )
+                throw std::runtime_error( "line " + std::to_string(number) +
+                        ": \"" + line + "\" is out of order or after other operations" );
+            ret.push_back( op );
+        }
+        return ret;
+    }
+}
+
+#endif // TEST_CASE_FILE_HPP
@@ -1,30 +1,60 @@
 #ifndef TREAP_HPP
 #define TREAP_HPP
 
+#include <functional>
 #include <memory>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "batch_lookup.hpp"
+#include "fork_join.hpp"
+#include "frozen.hpp"
+#include "in_order.hpp"
+#include "node_allocator.hpp"
+#include "node_data.hpp"
+#include "order_statistics.hpp"
 
 namespace treap {
     /* C-like structure representing a treap node.
      * To have a std::set-like interface, see the treap class below.
+     *
+     * The key and the value (none if Value is void) come from node_data,
+     * and the subtree size (none without order statistics) from subtree_size.
+     * The Allocator policy (see node_allocator.hpp)
+     * chooses the deleter of the child pointers.
      */
-    struct node {
-        int key;
+    template< typename Key, typename Value, typename Allocator,
+        typename Statistics = no_order_statistics >
+    struct basic_node : node_data<Key, Value>, subtree_size<Statistics> {
+        using pointer = std::unique_ptr<basic_node,
+              typename Allocator::template deleter<basic_node>>;
+
         unsigned int priority;
-        std::unique_ptr<node> lchild, rchild;
+        pointer lchild, rchild;
+
+        // The arguments after the priority construct the value.
+        template< typename ... Args, typename = std::enable_if_t<
+            std::is_constructible<node_data<Key, Value>, const Key &, Args...>::value>>
+        basic_node( const Key & k, unsigned int p, Args && ... args ) :
+            node_data<Key, Value>( k, std::forward<Args>(args)... ), priority(p)
+        {}
 
-        node() = default;
-        node( int k, int p ) : key(k), priority(p) {}
-        node( int k, int p,
-                std::unique_ptr<node>&& lchild, std::unique_ptr<node>&& rchild ) :
-            key(k), priority(p), lchild(std::move(lchild)), rchild(std::move(rchild))
+        basic_node( const Key & k, unsigned int p, pointer&& lchild, pointer&& rchild ) :
+            node_data<Key, Value>(k), priority(p),
+            lchild(std::move(lchild)), rchild(std::move(rchild))
         {}
     };
 
+    using node = basic_node<int, void, malloc_allocator>;
+
     /* Assigns ptr2 to ptr1, ptr3 to ptr2, and ptr1 to ptr3,
      * without destroying any object.
      */
-    inline void circular_shift_unique_ptr( std::unique_ptr<node> & ptr1,
-            std::unique_ptr<node> & ptr2, std::unique_ptr<node> & ptr3 )
+    template< typename Node, typename Deleter >
+    inline void circular_shift_unique_ptr( std::unique_ptr<Node, Deleter> & ptr1,
+            std::unique_ptr<Node, Deleter> & ptr2, std::unique_ptr<Node, Deleter> & ptr3 )
     {
         ptr1.swap(ptr2);
         ptr2.swap(ptr3);
@@ -33,56 +63,200 @@ namespace treap {
     /* Performs a left rotation.
      * n.rchild is assumed to be non-null.
      */
-    inline void rotate_left( std::unique_ptr<node> & ptr ) {
+    template< typename Node, typename Deleter >
+    inline void rotate_left( std::unique_ptr<Node, Deleter> & ptr ) {
         circular_shift_unique_ptr(ptr, ptr->rchild, ptr->rchild->lchild);
+        order_stats::update_size( ptr->lchild );
+        order_stats::update_size( ptr );
     }
 
     /* Performs a right rotation.
      * n.lchild is assumed to be non-null.
      */
-    inline void rotate_right( std::unique_ptr<node> & ptr ) {
+    template< typename Node, typename Deleter >
+    inline void rotate_right( std::unique_ptr<Node, Deleter> & ptr ) {
         circular_shift_unique_ptr(ptr, ptr->lchild, ptr->lchild->rchild);
+        order_stats::update_size( ptr->rchild );
+        order_stats::update_size( ptr );
     }
 
     /* Returns a pointer to the unique_ptr holding a tree
      * whose root has the requested key,
      * or a pointer to the place in the tree the key would be inserted
      * if it is not in the tree.
+     * Keys are ordered by comp.
      */
-    inline std::unique_ptr<node> & search( std::unique_ptr<node> & tree, int key ) {
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    inline std::unique_ptr<Node, Deleter> & search(
+            std::unique_ptr<Node, Deleter> & tree, const typename Node::key_type & key,
+            const Compare & comp = Compare() )
+    {
         if( !tree ) // key is not in the tree.
             return tree;
-        if( key < tree->key )
-            return search(tree->lchild, key);
-        if( tree->key < key )
-            return search(tree->rchild, key);
+        if( comp(key, tree->key) )
+            return search(tree->lchild, key, comp);
+        if( comp(tree->key, key) )
+            return search(tree->rchild, key, comp);
         return tree; // key is here.
     }
 
     /* Inserts a node with the specified key and priority in the treap.
      * If the key already exists, the treap is not modified.
+     * New nodes are obtained from the given arena,
+     * and their value (if any) is constructed from args.
+     *
+     * Returns the node with the key,
+     * and whether it was inserted (false if the key was already there).
      */
-    inline void insert( std::unique_ptr<node> & tree, int key, unsigned int priority ) {
+    template< typename Node, typename Deleter, typename Arena,
+        typename Compare = std::less<>, typename ... Args >
+    inline std::pair<Node *, bool> insert( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, unsigned int priority, Arena & arena,
+            const Compare & comp = Compare(), Args && ... args )
+    {
         if( !tree ) {
-            tree = std::make_unique<node>(key, priority);
-            return;
+            tree = arena.make( key, priority, std::forward<Args>(args)... );
+            return {tree.get(), true};
         }
-        if( key < tree->key ) {
-            insert( tree->lchild, key, priority );
+        if( comp(key, tree->key) ) {
+            auto ret = insert( tree->lchild, key, priority, arena, comp,
+                    std::forward<Args>(args)... );
+            order_stats::update_size( tree );
             if( tree->lchild->priority > tree->priority )
                 rotate_right(tree);
+            return ret;
         }
-        if( tree->key < key ) {
-            insert( tree->rchild, key, priority );
+        if( comp(tree->key, key) ) {
+            auto ret = insert( tree->rchild, key, priority, arena, comp,
+                    std::forward<Args>(args)... );
+            order_stats::update_size( tree );
             if( tree->rchild->priority > tree->priority )
                 rotate_left(tree);
+            return ret;
         }
+        return {tree.get(), false};
+    }
+
+    /* Same as above, allocating the new node with operator new.
+     */
+    inline void insert( std::unique_ptr<node> & tree, int key, unsigned int priority ) {
+        malloc_arena<node> arena;
+        insert( tree, key, priority, arena );
+    }
+
+    /* Path from the root to the node of the last insert_with_finger,
+     * together with the range of keys each subtree in the path may hold.
+     * The finger stays valid while the tree is only changed by insert_with_finger;
+     * any other change must reset it, with clear().
+     */
+    template< typename Pointer >
+    struct finger {
+        using key_type = typename Pointer::element_type::key_type;
+
+        std::vector<Pointer *> slot;
+        /* The keys in *slot[i] lie in the open interval (*lo[i], *hi[i]).
+         * The bounds point to the keys of ancestors, which never move;
+         * a null bound is infinite.
+         */
+        std::vector<const key_type *> lo;
+        std::vector<const key_type *> hi;
+
+        void clear() {
+            resize( 0 );
+        }
+
+        std::size_t depth() const {
+            return slot.size();
+        }
+
+        void resize( std::size_t depth ) {
+            slot.resize( depth );
+            lo.resize( depth );
+            hi.resize( depth );
+        }
+
+        void push( Pointer * s, const key_type * l, const key_type * h ) {
+            slot.push_back( s );
+            lo.push_back( l );
+            hi.push_back( h );
+        }
+
+        // Whether the last subtree of the path may hold key.
+        template< typename Compare >
+        bool covers( const key_type & key, const Compare & comp ) const {
+            return (!lo.back() || comp(*lo.back(), key)) &&
+                   (!hi.back() || comp(key, *hi.back()));
+        }
+
+        /* Extends the path down from its last slot towards key,
+         * until reaching the node with that key (returns true)
+         * or an empty slot (returns false).
+         */
+        template< typename Compare >
+        bool descend( const key_type & key, const Compare & comp ) {
+            while( Pointer & ptr = *slot.back() ) {
+                if( comp(key, ptr->key) )
+                    push( &ptr->lchild, lo.back(), &ptr->key );
+                else if( comp(ptr->key, key) )
+                    push( &ptr->rchild, &ptr->key, hi.back() );
+                else
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    /* Same as insert, but the search starts from the finger f
+     * rather than from the root: the finger is first shortened
+     * until its last subtree may hold the key, and then extended down.
+     * The new node is then rotated up along the finger.
+     * When the keys arrive in (nearly) ascending or descending order,
+     * the new node hangs just below the end of the finger,
+     * so the insertion costs expected amortized O(1).
+     *
+     * f must have been cleared (or used only with this tree since).
+     * Afterwards, f ends at the node with the key.
+     * Returns the same as insert.
+     */
+    template< typename Node, typename Deleter, typename Arena,
+        typename Compare = std::less<>, typename ... Args >
+    inline std::pair<Node *, bool> insert_with_finger( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, unsigned int priority, Arena & arena,
+            finger<std::unique_ptr<Node, Deleter>> & f,
+            const Compare & comp = Compare(), Args && ... args )
+    {
+        if( f.depth() == 0 )
+            f.push( &tree, nullptr, nullptr );
+        while( f.depth() > 1 && !f.covers(key, comp) )
+            f.resize( f.depth() - 1 );
+        if( f.descend(key, comp) )
+            return {f.slot.back()->get(), false}; // Key is already here.
+
+        *f.slot.back() = arena.make( key, priority, std::forward<Args>(args)... );
+        Node * ret = f.slot.back()->get();
+
+        /* Each rotation moves the new node into its parent's slot,
+         * whose key range is the same; so the finger simply loses its last entry.
+         * f.slot[0] is the root, so the ancestors are all in the finger.
+         */
+        std::size_t d = f.depth() - 1;
+        order_stats::adjust_sizes( f.slot.data(), d, +1 );
+        while( d > 0 && (*f.slot[d-1])->priority < priority ) {
+            auto & parent = *f.slot[--d];
+            if( comp(key, parent->key) )
+                rotate_right( parent );
+            else
+                rotate_left( parent );
+        }
+        f.resize( d + 1 );
+        return {ret, true};
     }
 
     /* Delete the root of the given treap.
      * The tree is assumed to be non-null.
      */
-    inline void root_delete( std::unique_ptr<node> & tree ) {
+    template< typename Node, typename Deleter >
+    inline void root_delete( std::unique_ptr<Node, Deleter> & tree ) {
         if( !tree->lchild )
             tree = std::move(tree->rchild);
         else if( !tree->rchild )
@@ -90,46 +264,605 @@ namespace treap {
         else if( tree->lchild->priority < tree->rchild->priority ) {
             rotate_left(tree);
             root_delete(tree->lchild);
+            order_stats::update_size( tree );
         }
         else {
             rotate_right(tree);
             root_delete(tree->rchild);
+            order_stats::update_size( tree );
         }
     }
 
     /* Erases the given key from the tree.
      */
-    inline void remove( std::unique_ptr<node> & tree, int key ) {
-        auto & ptr = search(tree, key);
-        if( ptr ) // ptr is always non null; it points to another pointer
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    inline void remove( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, const Compare & comp = Compare() )
+    {
+        auto & ptr = search(tree, key, comp);
+        if( ptr ) { // ptr is always non null; it points to another pointer
+            order_stats::adjust_sizes_above( tree, key, comp, -1 );
             root_delete( ptr );
+        }
+    }
+
+    /* Splits the given tree into the nodes with keys smaller than key,
+     * which go to 'left', and the remaining nodes, which go to 'right'.
+     * 'tree' is left empty; 'left' and 'right' are assumed to be empty.
+     *
+     * The tree is walked once, top-down,
+     * hooking each node to the bottom of the side it belongs to.
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    inline void split( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key,
+            std::unique_ptr<Node, Deleter> & left, std::unique_ptr<Node, Deleter> & right,
+            const Compare & comp = Compare() )
+    {
+        std::unique_ptr<Node, Deleter> * lhook = &left;
+        std::unique_ptr<Node, Deleter> * rhook = &right;
+        while( tree ) {
+            if( comp(tree->key, key) ) {
+                *lhook = std::move(tree);
+                tree = std::move((*lhook)->rchild);
+                lhook = &(*lhook)->rchild;
+            }
+            else {
+                *rhook = std::move(tree);
+                tree = std::move((*rhook)->lchild);
+                rhook = &(*rhook)->lchild;
+            }
+        }
+        // The hooked nodes are the right spine of 'left' and the left spine of 'right'.
+        order_stats::update_spine( left, true );
+        order_stats::update_spine( right, false );
+    }
+
+    /* Merges the treaps 'left' and 'right' into a single treap,
+     * assuming every key in 'left' is smaller than every key in 'right'.
+     * Both arguments are left empty.
+     *
+     * The two right/left spines are zipped top-down.
+     * As in root_delete, the left side wins priority ties.
+     * Every hooked node roots the merge of what is left of both sides,
+     * so its size is known when it is hooked.
+     */
+    template< typename Node, typename Deleter >
+    inline std::unique_ptr<Node, Deleter> merge(
+            std::unique_ptr<Node, Deleter> & left, std::unique_ptr<Node, Deleter> & right )
+    {
+        std::unique_ptr<Node, Deleter> ret;
+        std::unique_ptr<Node, Deleter> * hook = &ret;
+        while( left && right ) {
+            std::size_t size = 0;
+            if constexpr( Node::sized )
+                size = order_stats::size(left) + order_stats::size(right);
+            if( left->priority < right->priority ) {
+                order_stats::set_size( right, size );
+                *hook = std::move(right);
+                right = std::move((*hook)->lchild);
+                hook = &(*hook)->lchild;
+            }
+            else {
+                order_stats::set_size( left, size );
+                *hook = std::move(left);
+                left = std::move((*hook)->rchild);
+                hook = &(*hook)->rchild;
+            }
+        }
+        *hook = left ? std::move(left) : std::move(right);
+        return ret;
+    }
+
+    /* Same as insert, but without rotations.
+     * The tree is descended only until the new priority wins;
+     * the subtree found there is split around the key
+     * and its halves become the children of the new node.
+     */
+    template< typename Node, typename Deleter, typename Arena,
+        typename Compare = std::less<>, typename ... Args >
+    inline std::pair<Node *, bool> split_insert( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, unsigned int priority, Arena & arena,
+            const Compare & comp = Compare(), Args && ... args )
+    {
+        std::unique_ptr<Node, Deleter> * slot = &tree;
+        while( *slot && !((*slot)->priority < priority) ) {
+            if( comp(key, (*slot)->key) )
+                slot = &(*slot)->lchild;
+            else if( comp((*slot)->key, key) )
+                slot = &(*slot)->rchild;
+            else
+                return {slot->get(), false}; // Key is already here.
+        }
+        // The key may still be further down; look for it before splitting.
+        if( auto & found = search(*slot, key, comp) )
+            return {found.get(), false};
+
+        auto ptr = arena.make( key, priority, std::forward<Args>(args)... );
+        split( *slot, key, ptr->lchild, ptr->rchild, comp );
+        order_stats::update_size( ptr );
+        *slot = std::move(ptr);
+        order_stats::adjust_sizes_above( tree, key, comp, +1 );
+        return {slot->get(), true};
+    }
+
+    /* Same as remove, but without rotations.
+     * The two children of the removed node are merged in its place.
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    inline void merge_remove( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & key, const Compare & comp = Compare() )
+    {
+        auto & ptr = search(tree, key, comp);
+        if( ptr ) {
+            order_stats::adjust_sizes_above( tree, key, comp, -1 );
+            ptr = merge( ptr->lchild, ptr->rchild );
+        }
+    }
+
+    /* Removes the keys in [lo, hi) from the tree,
+     * by splitting off the range, dropping it, and merging the rest.
+     * Takes expected O(log n + k) for k removed keys.
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    inline void erase_range( std::unique_ptr<Node, Deleter> & tree,
+            const typename Node::key_type & lo, const typename Node::key_type & hi,
+            const Compare & comp = Compare() )
+    {
+        if( !comp(lo, hi) )
+            return;
+        std::unique_ptr<Node, Deleter> left, rest, range, right;
+        split( tree, lo, left, rest, comp );
+        split( rest, hi, range, right, comp );
+        range.reset();
+        tree = merge( left, right );
+    }
+
+    /* Same as split, but the node with the given key, if any,
+     * goes to neither side; it is returned instead (without children).
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    inline std::unique_ptr<Node, Deleter> split_extract(
+            std::unique_ptr<Node, Deleter> & tree, const typename Node::key_type & key,
+            std::unique_ptr<Node, Deleter> & left, std::unique_ptr<Node, Deleter> & right,
+            const Compare & comp = Compare() )
+    {
+        std::unique_ptr<Node, Deleter> * lhook = &left;
+        std::unique_ptr<Node, Deleter> * rhook = &right;
+        while( tree ) {
+            if( comp(tree->key, key) ) {
+                *lhook = std::move(tree);
+                tree = std::move((*lhook)->rchild);
+                lhook = &(*lhook)->rchild;
+            }
+            else if( comp(key, tree->key) ) {
+                *rhook = std::move(tree);
+                tree = std::move((*rhook)->lchild);
+                rhook = &(*rhook)->lchild;
+            }
+            else {
+                *lhook = std::move(tree->lchild);
+                *rhook = std::move(tree->rchild);
+                order_stats::set_size( tree, 1 );
+                break;
+            }
+        }
+        order_stats::update_spine( left, true );
+        order_stats::update_spine( right, false );
+        return std::move(tree);
+    }
+
+    /* Builds a treap with the keys in [first, last),
+     * which must be strictly ascending, and returns it.
+     * Priorities are drawn from rng and new nodes from the given arena.
+     *
+     * This is the stack-based Cartesian tree construction:
+     * the right spine is kept in a stack, and each new key,
+     * being the largest so far, hangs at the bottom of the spine
+     * after popping the nodes it beats, which become its left subtree.
+     * Every node is pushed and popped at most once, so it takes linear time.
+     * A popped node is complete, and so is the spine at the end;
+     * that is when their sizes, if any, are computed.
+     */
+    template< typename Iterator, typename RNG, typename Arena >
+    auto build_sorted( Iterator first, Iterator last, RNG & rng, Arena & arena )
+        -> decltype( arena.make(0, 0u) )
+    {
+        using pointer = decltype( arena.make(0, 0u) );
+        pointer root;
+        std::vector<typename pointer::element_type *> spine;
+        for( ; first != last; ++first ) {
+            pointer ptr = arena.make( *first, rng() );
+            while( !spine.empty() && spine.back()->priority < ptr->priority ) {
+                order_stats::update_size( spine.back() );
+                spine.pop_back();
+            }
+            pointer & hook = spine.empty() ? root : spine.back()->rchild;
+            ptr->lchild = std::move(hook);
+            hook = std::move(ptr);
+            spine.push_back( hook.get() );
+        }
+        while( !spine.empty() ) {
+            order_stats::update_size( spine.back() );
+            spine.pop_back();
+        }
+        return root;
+    }
+
+    /* Number of recursion levels of the set operations below
+     * that fork their two halves with fork_join::join.
+     * Deeper calls run sequentially;
+     * as treaps are balanced in expectation, this is the grain size:
+     * with depth d, subproblems smaller than about n / 2**d keys
+     * are not worth a task.
+     */
+    constexpr int default_parallel_depth = 8;
+
+    /* Runs f and g in parallel if there are parallel levels left,
+     * sequentially otherwise.
+     */
+    template< typename F, typename G >
+    inline void fork( int parallel_depth, F && f, G && g ) {
+        if( parallel_depth > 0 )
+            fork_join::join( f, g );
+        else {
+            f();
+            g();
+        }
     }
 
-    // std::set-like interface
-    template< typename RNG >
+    /* Join-based set operations.
+     * Each function consumes both trees, leaving them empty,
+     * and returns the resulting treap, built from their nodes;
+     * nodes not in the result are destroyed.
+     *
+     * Both halves of each recursive step touch disjoint subtrees,
+     * so they are forked with fork_join::join;
+     * they run in parallel when called inside fork_join::pool::run.
+     *
+     * In maps, a key present in both trees keeps the value of either one.
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    std::unique_ptr<Node, Deleter> set_union(
+            std::unique_ptr<Node, Deleter> & a, std::unique_ptr<Node, Deleter> & b,
+            int parallel_depth = default_parallel_depth, const Compare & comp = Compare() )
+    {
+        if( !a ) return std::move(b);
+        if( !b ) return std::move(a);
+        if( a->priority < b->priority )
+            a.swap(b);
+        // a's root stays the root; the duplicate of its key in b, if any, is dropped.
+        std::unique_ptr<Node, Deleter> left, right;
+        split_extract( b, a->key, left, right, comp );
+        fork( parallel_depth,
+            [&]{ a->lchild = set_union( a->lchild, left, parallel_depth - 1, comp ); },
+            [&]{ a->rchild = set_union( a->rchild, right, parallel_depth - 1, comp ); }
+        );
+        order_stats::update_size( a );
+        return std::move(a);
+    }
+
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    std::unique_ptr<Node, Deleter> set_intersection(
+            std::unique_ptr<Node, Deleter> & a, std::unique_ptr<Node, Deleter> & b,
+            int parallel_depth = default_parallel_depth, const Compare & comp = Compare() )
+    {
+        if( !a || !b ) {
+            a.reset();
+            b.reset();
+            return nullptr;
+        }
+        if( a->priority < b->priority )
+            a.swap(b);
+        std::unique_ptr<Node, Deleter> left, right;
+        bool found = split_extract( b, a->key, left, right, comp ) != nullptr;
+        std::unique_ptr<Node, Deleter> l, r;
+        fork( parallel_depth,
+            [&]{ l = set_intersection( a->lchild, left, parallel_depth - 1, comp ); },
+            [&]{ r = set_intersection( a->rchild, right, parallel_depth - 1, comp ); }
+        );
+        if( !found ) {
+            a.reset();
+            return merge( l, r );
+        }
+        a->lchild = std::move(l);
+        a->rchild = std::move(r);
+        order_stats::update_size( a );
+        return std::move(a);
+    }
+
+    /* Keys of a that are not in b.
+     * The result is a subset of a, so a's roots can always stay on top;
+     * b is split around them.
+     */
+    template< typename Node, typename Deleter, typename Compare = std::less<> >
+    std::unique_ptr<Node, Deleter> set_difference(
+            std::unique_ptr<Node, Deleter> & a, std::unique_ptr<Node, Deleter> & b,
+            int parallel_depth = default_parallel_depth, const Compare & comp = Compare() )
+    {
+        if( !a || !b ) {
+            b.reset();
+            return std::move(a);
+        }
+        std::unique_ptr<Node, Deleter> left, right;
+        bool found = split_extract( b, a->key, left, right, comp ) != nullptr;
+        std::unique_ptr<Node, Deleter> l, r;
+        fork( parallel_depth,
+            [&]{ l = set_difference( a->lchild, left, parallel_depth - 1, comp ); },
+            [&]{ r = set_difference( a->rchild, right, parallel_depth - 1, comp ); }
+        );
+        if( found ) {
+            a.reset();
+            return merge( l, r );
+        }
+        a->lchild = std::move(l);
+        a->rchild = std::move(r);
+        order_stats::update_size( a );
+        return std::move(a);
+    }
+
+    /* Engines select the algorithms used by the treap class below.
+     * rotation_engine uses insert and remove;
+     * split_merge_engine uses split_insert and merge_remove.
+     */
+    struct rotation_engine {
+        template< typename Ptr, typename Key, typename Arena, typename Compare,
+            typename ... Args >
+        static auto insert( Ptr & tree, const Key & key, unsigned int priority,
+                Arena & arena, const Compare & comp, Args && ... args )
+        {
+            return ::treap::insert( tree, key, priority, arena, comp,
+                    std::forward<Args>(args)... );
+        }
+
+        template< typename Ptr, typename Key, typename Compare >
+        static void remove( Ptr & tree, const Key & key, const Compare & comp ) {
+            ::treap::remove( tree, key, comp );
+        }
+    };
+
+    struct split_merge_engine {
+        template< typename Ptr, typename Key, typename Arena, typename Compare,
+            typename ... Args >
+        static auto insert( Ptr & tree, const Key & key, unsigned int priority,
+                Arena & arena, const Compare & comp, Args && ... args )
+        {
+            return ::treap::split_insert( tree, key, priority, arena, comp,
+                    std::forward<Args>(args)... );
+        }
+
+        template< typename Ptr, typename Key, typename Compare >
+        static void remove( Ptr & tree, const Key & key, const Compare & comp ) {
+            ::treap::merge_remove( tree, key, comp );
+        }
+    };
+
+    /* std::set-like interface, or std::map-like if Value is not void.
+     * Keys are ordered by Compare, and priorities are drawn from RNG.
+     * Allocator is one of the policies in node_allocator.hpp,
+     * Engine is one of the engines above,
+     * and Statistics one of the policies in order_statistics.hpp.
+     */
+    template< typename Key = int, typename Value = void, typename RNG = std::mt19937,
+        typename Compare = std::less<Key>, typename Allocator = malloc_allocator,
+        typename Engine = rotation_engine, typename Statistics = no_order_statistics >
     class treap {
-        std::unique_ptr<node> root;
+        using node_type = basic_node<Key, Value, Allocator, Statistics>;
+        typename Allocator::template arena<node_type> arena;
+        typename node_type::pointer root;
         RNG rng;
+        finger<typename node_type::pointer> last; // See insert(hint, key).
+        Compare comp;
+
+        // Value-only members are templates enabled by this.
+        template< typename V >
+        using if_map = std::enable_if_t<!std::is_void<V>::value, V>;
+
+        // Likewise for the order-statistics members.
+        template< typename S, typename T >
+        using if_sized = std::enable_if_t<std::is_same<S, order_statistics>::value, T>;
+
     public:
-        treap( RNG rng ) : rng(rng) {}
+        using key_type = Key;
+        using mapped_type = Value;
+
+        // Position of a key in the treap; valid until the next erase.
+        using position = const node_type *;
+
+        /* In-order iterators over the nodes (it->key, and it->value in maps);
+         * see in_order.hpp. Any change to the treap invalidates them.
+         */
+        using iterator = in_order::iterator<node_type>;
+        using const_iterator = iterator;
+
+        treap( RNG rng, const Compare & comp = Compare() ) : rng(rng), comp(comp) {}
+
+        // The finger refers to the old object's root, so it is not moved.
+        treap( treap && other ) :
+            arena( std::move(other.arena) ),
+            root( std::move(other.root) ),
+            rng( std::move(other.rng) ),
+            comp( std::move(other.comp) )
+        {}
+
+        ~treap() {
+            arena.release( root );
+        }
 
         // Returns 1 if the key was found in the treap, 0 otherwise.
-        int count( int key ) {
-            return ::treap::search(root, key) == nullptr ? 0 : 1;
+        int count( const Key & key ) {
+            return ::treap::search(root, key, comp) == nullptr ? 0 : 1;
+        }
+
+        /* Sets out[i] to count(keys[i]), for i in [0, n).
+         * The searches overlap their cache misses; see batch_lookup.hpp.
+         */
+        void count_batch( const Key * keys, std::size_t n, int * out ) const {
+            batch_lookup::count_batch( root, keys, n, out, comp );
         }
 
         /* Inserts the key in the treap.
          * Nothing is done if the key is already there.
+         * In a map, the value is default-constructed.
          */
-        void insert( int key ) {
-            ::treap::insert( root, key, rng() );
+        void insert( const Key & key ) {
+            last.clear();
+            Engine::insert( root, key, rng(), arena, comp );
+        }
+
+        /* Map interface.
+         * emplace constructs the value from args if the key is not in the map.
+         * It returns the value with the key, and whether it was inserted.
+         */
+        template< typename ... Args, typename V = Value >
+        std::pair<if_map<V> *, bool> emplace( const Key & key, Args && ... args ) {
+            last.clear();
+            auto ret = Engine::insert( root, key, rng(), arena, comp,
+                    std::forward<Args>(args)... );
+            return {&ret.first->value, ret.second};
+        }
+
+        // Returns the value with the key, default-constructing it if needed.
+        template< typename V = Value >
+        if_map<V> & operator[]( const Key & key ) {
+            return *emplace( key ).first;
+        }
+
+        // Returns the value with the key, or null if there is none.
+        template< typename V = Value >
+        if_map<V> * find( const Key & key ) {
+            auto & ptr = ::treap::search( root, key, comp );
+            return ptr ? &ptr->value : nullptr;
+        }
+
+        iterator begin() const {
+            return iterator::first( root.get() );
+        }
+
+        iterator end() const {
+            return iterator( root.get() );
+        }
+
+        // Iterator to the first key not less than (lower) or greater than (upper) key.
+        iterator lower_bound( const Key & key ) const {
+            return iterator::bound( root.get(), key, comp, false );
+        }
+
+        iterator upper_bound( const Key & key ) const {
+            return iterator::bound( root.get(), key, comp, true );
+        }
+
+        /* Calls f(node) for every key in [lo, hi), in order,
+         * without the overhead of an iterator.
+         */
+        template< typename F >
+        void for_each_in_range( const Key & lo, const Key & hi, F && f ) const {
+            in_order::for_each_in_range( root, lo, hi, f, comp );
+        }
+
+        /* std::set-like hinted insertion.
+         * The search starts from an internal finger,
+         * left at the key of the previous hinted insertion,
+         * so appending ascending keys costs expected amortized O(1).
+         * The finger is always correct, whatever the key;
+         * so the hint (usually end()) is not inspected.
+         * The node is always rotated into place, whatever the Engine;
+         * both engines build the same treap anyway.
+         * Returns the position of the key.
+         */
+        position insert( const iterator &, const Key & key ) {
+            return ::treap::insert_with_finger( root, key, rng(), arena, last, comp ).first;
         }
 
         /* Removes the given key from the treap.
          * Nothing is done if the key is not present.
          */
-        void erase( int key ) {
-            ::treap::remove( root, key );
+        void erase( const Key & key ) {
+            last.clear();
+            Engine::remove( root, key, comp );
+        }
+
+        /* Removes the keys in [lo, hi) by split and merge,
+         * in expected O(log n + k) for k keys, whatever the Engine.
+         */
+        void erase_range( const Key & lo, const Key & hi ) {
+            last.clear();
+            ::treap::erase_range( root, lo, hi, comp );
+        }
+
+        /* Order statistics, in expected O(log n).
+         * rank returns the number of keys smaller than key,
+         * select the position of the k-th smallest key (from 0), or null,
+         * and count_range the number of keys in [lo, hi).
+         */
+        template< typename S = Statistics >
+        if_sized<S, std::size_t> rank( const Key & key ) const {
+            return order_stats::rank( root, key, comp );
+        }
+
+        template< typename S = Statistics >
+        if_sized<S, position> select( std::size_t k ) const {
+            return order_stats::select( root, k );
+        }
+
+        template< typename S = Statistics >
+        if_sized<S, std::size_t> count_range( const Key & lo, const Key & hi ) const {
+            return comp(lo, hi) ? rank(hi) - rank(lo) : 0;
+        }
+
+        /* Copies the keys into a static search index (see frozen.hpp),
+         * faster to search but immutable.
+         * Only for treaps of int keys ordered by std::less.
+         */
+        frozen::eytzinger freeze() const {
+            static_assert( std::is_same<Key, int>::value &&
+                std::is_same<Compare, std::less<int>>::value,
+                "frozen::eytzinger only holds int keys in ascending order" );
+            std::vector<int> keys;
+            frozen::in_order_keys( root, keys );
+            return frozen::eytzinger( keys );
+        }
+
+        /* Replaces the contents of the treap with the keys in [first, last),
+         * which must be strictly ascending, in linear time.
+         */
+        template< typename InputIterator >
+        void assign_sorted( InputIterator first, InputIterator end ) {
+            this->last.clear();
+            arena.release( root );
+            root = ::treap::build_sorted( first, end, rng, arena );
+        }
+
+        /* Set operations with another treap, which is left empty.
+         * Nodes of 'other' are moved into this treap, never copied.
+         * Run these inside fork_join::pool::run to use several threads;
+         * parallel_depth is explained in default_parallel_depth.
+         */
+        void union_with( treap & other, int parallel_depth = default_parallel_depth ) {
+            last.clear();
+            other.last.clear();
+            arena.adopt( other.arena );
+            arena.begin_parallel_frees();
+            root = set_union( root, other.root, parallel_depth, comp );
+            arena.end_parallel_frees();
+        }
+
+        void intersect_with( treap & other, int parallel_depth = default_parallel_depth ) {
+            last.clear();
+            other.last.clear();
+            arena.adopt( other.arena );
+            arena.begin_parallel_frees();
+            root = set_intersection( root, other.root, parallel_depth, comp );
+            arena.end_parallel_frees();
+        }
+
+        void difference_with( treap & other, int parallel_depth = default_parallel_depth ) {
+            last.clear();
+            other.last.clear();
+            arena.adopt( other.arena );
+            arena.begin_parallel_frees();
+            root = set_difference( root, other.root, parallel_depth, comp );
+            arena.end_parallel_frees();
         }
     };
 }
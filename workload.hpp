@@ -0,0 +1,417 @@
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "generation.hpp"
+#include "speed_test.hpp"
+
+/* Workloads described by a spec instead of code: skewed lookups,
+ * hot and cold keys, sliding windows, and any sequence of such phases.
+ *
+ * The keys are 2, 4, ..., 2*keys. A spec is a list of phases, each a number
+ * of operations drawn from a list of steps: an operation type, a weight,
+ * and how the key is chosen. The steps are either drawn at random,
+ * in proportion to their weights, or repeated in order (a cycle),
+ * each one as many times in a row as its weight.
+ *
+ * The keys are chosen as
+ *  uniform              - any key, uniformly;
+ *  zipf <theta>         - a key by popularity (see generation::zipf);
+ *  hot <f> <p>          - a key among the fraction f of hot keys with probability p,
+ *                         and else among the cold ones;
+ *  miss                 - an odd key, never inserted;
+ *  fresh                - for insertions, the next key in a random order
+ *                         of all the keys, starting over once all were used;
+ *  oldest               - for removals, the oldest fresh key not yet removed
+ *                         as the oldest one, a FIFO eviction;
+ *  recent <w> [<theta>] - for searches, one of the last w fresh keys,
+ *                         uniformly, or by Zipf popularity of the newest ones.
+ * The hot keys and the popular ones are scattered over the key range,
+ * and are not the first fresh keys.
+ *
+ * The text form (see parse) has one directive per line:
+ *  keys <count>
+ *  phase <operations> [cycle]
+ *  <insert|erase|search|rank> <weight> [<key choice>]
+ *  scan <weight> <length> [<key choice>]
+ * where the steps belong to the phase above them, and # starts a comment.
+ */
+namespace workload {
+    enum class key_choice {
+        uniform,
+        zipf,
+        hot,
+        miss,
+        fresh,
+        oldest,
+        recent,
+    };
+
+    struct key_distribution {
+        key_choice choice = key_choice::uniform;
+        double theta = 0;       // zipf and recent.
+        double fraction = 0;    // hot: fraction of the keys which are hot.
+        double probability = 0; // hot: probability of choosing a hot key.
+        long long window = 0;   // recent.
+    };
+
+    struct step {
+        operation_type type;
+        double weight;
+        key_distribution keys;
+        int length = 0; // Keys visited by a range_scan.
+    };
+
+    struct phase {
+        long long operations = 0;
+        bool cycle = false; // Repeat the steps in order instead of drawing them.
+        std::vector<step> steps;
+    };
+
+    struct spec {
+        int keys = 1;
+        std::vector<phase> phases;
+
+        long long size() const {
+            long long ret = 0;
+            for( const phase & p : phases )
+                ret += p.operations;
+            return ret;
+        }
+    };
+
+    namespace detail {
+        // Kept for each operation until the sequential pass chooses its key.
+        enum pending : std::uint8_t {
+            none,
+            fresh,
+            oldest,
+            recent,
+        };
+
+        // Step ready to be drawn.
+        struct prepared {
+            step s;
+            double cumulative; // Weight of the steps up to this one.
+            generation::zipf popularity;
+            long long hot_keys;
+        };
+    }
+
+    /* Generates the test case of the spec, by chunks on 'threads' threads,
+     * as the test cases of speed_test.hpp; it only depends on the seed.
+     * The fresh, oldest and recent keys are chosen afterwards,
+     * in a sequential pass, as they depend on the operations before.
+     */
+    inline test_case generate( const spec & s, unsigned int seed, unsigned threads = 1 ) {
+        test_case ret( s.size() );
+        std::uint64_t keys = std::max( s.keys, 1 );
+        generation::random_permutation fresh_order( keys, seed, 0 );
+        generation::random_permutation popularity( keys, seed, 1 );
+
+        std::vector<long long> starts; // First operation of each phase.
+        std::vector<std::vector<detail::prepared>> phases;
+        bool sequential_pass = false;
+        long long start = 0;
+        for( const phase & p : s.phases ) {
+            starts.push_back( start );
+            start += p.operations;
+            std::vector<detail::prepared> steps;
+            double cumulative = 0;
+            for( const step & st : p.steps ) {
+                cumulative += st.weight;
+                std::uint64_t range = st.keys.choice == key_choice::recent ?
+                    std::max<long long>( st.keys.window, 1 ) : keys;
+                long long hot = std::llround( st.keys.fraction * keys );
+                steps.push_back( detail::prepared{ st, cumulative,
+                        generation::zipf( range, st.keys.theta ),
+                        std::min<long long>( std::max<long long>(hot, 1), keys ) } );
+                sequential_pass |= st.keys.choice == key_choice::fresh
+                    || st.keys.choice == key_choice::oldest
+                    || st.keys.choice == key_choice::recent;
+            }
+            phases.push_back( std::move(steps) );
+        }
+
+        // Only set by the steps that need the sequential pass.
+        std::vector<detail::pending> pending( sequential_pass ? ret.size() : 0, detail::none );
+
+        auto popular = [&]( std::uint64_t rank ) {
+            return 2 * int(popularity(rank)) + 2;
+        };
+
+        generation::for_each_chunk( ret.size(), threads,
+            [&]( std::size_t chunk, std::size_t first, std::size_t last ) {
+                std::mt19937 rng = generation::chunk_rng( seed, chunk );
+                std::uniform_int_distribution<std::uint64_t> any( 0, keys - 1 );
+                std::uniform_int_distribution<> miss( 0, keys );
+                std::size_t p = std::upper_bound( starts.begin(), starts.end(),
+                        (long long) first ) - starts.begin() - 1;
+                for( std::size_t i = first; i < last; i++ ) {
+                    while( p + 1 < starts.size() && (long long) i >= starts[p+1] )
+                        p++;
+                    const auto & steps = phases[p];
+                    double total = steps.back().cumulative;
+                    double pick = s.phases[p].cycle ?
+                        std::fmod( double(i - starts[p]), total ) + 0.5 :
+                        std::uniform_real_distribution<double>( 0, total )( rng );
+                    auto chosen = std::upper_bound( steps.begin(), steps.end() - 1, pick,
+                        []( double x, const detail::prepared & st ){ return x < st.cumulative; });
+                    const detail::prepared & st = *chosen;
+                    const key_distribution & d = st.s.keys;
+
+                    operation op{ st.s.type, 0 };
+                    switch( d.choice ) {
+                        case key_choice::uniform:
+                            op.key = 2 * int(any(rng)) + 2;
+                            break;
+                        case key_choice::zipf:
+                            op.key = popular( st.popularity(rng) );
+                            break;
+                        case key_choice::hot:
+                            if( std::uniform_real_distribution<double>()(rng) < d.probability
+                                    || st.hot_keys == (long long) keys )
+                                op.key = popular( std::uniform_int_distribution<long long>(
+                                            0, st.hot_keys - 1 )(rng) );
+                            else
+                                op.key = popular( std::uniform_int_distribution<long long>(
+                                            st.hot_keys, keys - 1 )(rng) );
+                            break;
+                        case key_choice::miss:
+                            op.key = 2 * miss(rng) + 1;
+                            break;
+                        case key_choice::fresh:
+                            pending[i] = detail::fresh;
+                            break;
+                        case key_choice::oldest:
+                            op.key = int(rng()); // For a miss, if there is no key left.
+                            pending[i] = detail::oldest;
+                            break;
+                        case key_choice::recent:
+                            op.key = d.theta > 0 ? int(st.popularity(rng)) :
+                                std::uniform_int_distribution<>( 0, std::max<long long>(d.window, 1) - 1 )(rng);
+                            pending[i] = detail::recent;
+                            break;
+                    }
+                    if( op.type == operation_type::range_scan )
+                        op = operation{ op.type, op.key, op.key + 2 * st.s.length };
+                    ret[i] = op;
+                }
+            });
+
+        if( !sequential_pass )
+            return ret;
+        long long fresh = 0, evicted = 0;
+        auto fresh_key = [&]( long long index ) {
+            return 2 * int(fresh_order(index % keys)) + 2;
+        };
+        auto miss_key = [&]( int random ) {
+            return 2 * int(std::uint32_t(random) % (keys + 1)) + 1;
+        };
+        for( std::size_t i = 0; i < ret.size(); i++ ) {
+            operation & op = ret[i];
+            switch( pending[i] ) {
+                case detail::none:
+                    break;
+                case detail::fresh:
+                    op.key = fresh_key( fresh++ );
+                    break;
+                case detail::oldest:
+                    op.key = evicted < fresh ? fresh_key( evicted++ ) : miss_key( op.key );
+                    break;
+                case detail::recent:
+                    op.key = op.key < fresh ? fresh_key( fresh - 1 - op.key ) : miss_key( op.key );
+                    break;
+            }
+        }
+        return ret;
+    }
+
+    /* Reads a spec in the text form; 'keys' is the default number of keys.
+     * Throws std::runtime_error on the first line it cannot read.
+     */
+    inline spec parse( std::istream & in, int keys ) {
+        spec ret;
+        ret.keys = keys;
+        std::string line;
+        int number = 0;
+        auto fail = [&]( const std::string & why ) {
+            throw std::runtime_error( "line " + std::to_string(number) + ": " + why );
+        };
+
+        while( std::getline(in, line) ) {
+            number++;
+            std::istringstream words( line.substr(0, line.find('#')) );
+            std::string name;
+            if( !(words >> name) )
+                continue;
+
+            if( name == "keys" ) {
+                if( !(words >> ret.keys) || ret.keys < 1 )
+                    fail( "keys needs a positive count" );
+            }
+            else if( name == "phase" ) {
+                phase p;
+                std::string mode;
+                if( !(words >> p.operations) || p.operations < 0 )
+                    fail( "phase needs a number of operations" );
+                if( words >> mode ) {
+                    if( mode != "cycle" )
+                        fail( "unknown phase mode " + mode );
+                    p.cycle = true;
+                }
+                ret.phases.push_back( p );
+            }
+            else {
+                step st;
+                if( name == "insert" )
+                    st.type = operation_type::insert;
+                else if( name == "erase" )
+                    st.type = operation_type::erase;
+                else if( name == "search" )
+                    st.type = operation_type::count;
+                else if( name == "rank" )
+                    st.type = operation_type::rank;
+                else if( name == "scan" )
+                    st.type = operation_type::range_scan;
+                else
+                    fail( "unknown directive " + name );
+                if( ret.phases.empty() )
+                    fail( name + " must follow a phase" );
+                if( !(words >> st.weight) || !(st.weight > 0) )
+                    fail( name + " needs a positive weight" );
+                if( ret.phases.back().cycle && st.weight != std::floor(st.weight) )
+                    fail( "the weights of a cycle are counts" );
+                if( st.type == operation_type::range_scan
+                        && (!(words >> st.length) || st.length < 1) )
+                    fail( "scan needs a positive length" );
+                if( st.type == operation_type::range_scan && st.length > operation::max_width / 2 )
+                    fail( "scan length above " + std::to_string(operation::max_width / 2) );
+
+                std::string choice = "uniform";
+                words >> choice;
+                key_distribution & d = st.keys;
+                bool ok = true;
+                if( choice == "uniform" )
+                    d.choice = key_choice::uniform;
+                else if( choice == "zipf" ) {
+                    d.choice = key_choice::zipf;
+                    ok = words >> d.theta && d.theta >= 0;
+                }
+                else if( choice == "hot" ) {
+                    d.choice = key_choice::hot;
+                    ok = words >> d.fraction >> d.probability && d.fraction > 0
+                        && d.fraction <= 1 && d.probability >= 0 && d.probability <= 1;
+                }
+                else if( choice == "miss" )
+                    d.choice = key_choice::miss;
+                else if( choice == "fresh" && st.type == operation_type::insert )
+                    d.choice = key_choice::fresh;
+                else if( choice == "oldest" && st.type == operation_type::erase )
+                    d.choice = key_choice::oldest;
+                else if( choice == "recent" && st.type == operation_type::count ) {
+                    d.choice = key_choice::recent;
+                    ok = words >> d.window && d.window > 0;
+                    if( ok && !(words >> d.theta) ) {
+                        d.theta = 0;
+                        words.clear();
+                    }
+                    ok = ok && d.theta >= 0;
+                }
+                else
+                    fail( "cannot choose the keys of " + name + " as " + choice );
+                std::string rest;
+                if( !ok || words >> rest )
+                    fail( "cannot read the keys of " + name );
+                ret.phases.back().steps.push_back( st );
+            }
+        }
+
+        if( ret.phases.empty() )
+            throw std::runtime_error( "no phase" );
+        for( const phase & p : ret.phases )
+            if( p.steps.empty() )
+                throw std::runtime_error( "a phase has no steps" );
+        return ret;
+    }
+
+    // Phase inserting 'values' fresh keys.
+    inline phase fill( long long values ) {
+        phase ret;
+        ret.operations = values;
+        ret.steps.push_back( step{ operation_type::insert, 1, {key_choice::fresh} } );
+        return ret;
+    }
+
+    /* 'values' insertions, then a mix of about 'search_successes' searches
+     * with Zipf popularity and 'search_failures' searches for odd keys.
+     */
+    inline spec zipf_search( int values, int search_successes, int search_failures,
+            double theta )
+    {
+        spec ret;
+        ret.keys = values;
+        ret.phases.push_back( fill(values) );
+        phase searches;
+        searches.operations = (long long) search_successes + search_failures;
+        key_distribution popular{ key_choice::zipf, theta };
+        if( search_successes > 0 )
+            searches.steps.push_back( step{ operation_type::count, double(search_successes), popular } );
+        if( search_failures > 0 )
+            searches.steps.push_back( step{ operation_type::count, double(search_failures),
+                    {key_choice::miss} } );
+        if( !searches.steps.empty() )
+            ret.phases.push_back( searches );
+        return ret;
+    }
+
+    /* Likewise, with the successful searches looking for the hot keys,
+     * a 'fraction' of them, with the given 'probability'.
+     */
+    inline spec hot_set_search( int values, int search_successes, int search_failures,
+            double fraction, double probability )
+    {
+        spec ret = zipf_search( values, search_successes, search_failures, 0 );
+        for( phase & p : ret.phases )
+            for( step & st : p.steps )
+                if( st.keys.choice == key_choice::zipf )
+                    st.keys = key_distribution{ key_choice::hot, 0, fraction, probability };
+        return ret;
+    }
+
+    /* 'window' insertions, then 'insertions' - 'window' times:
+     * an insertion, the removal of the oldest key, and 'lookups' searches
+     * among the 'window' keys in the tree, the newest ones being the most
+     * popular with Zipf 'theta' (uniformly if theta is 0).
+     * The tree keeps 'window' keys.
+     */
+    inline spec sliding_window( int insertions, int window, int lookups, double theta ) {
+        window = std::min( window, insertions );
+        spec ret;
+        ret.keys = insertions;
+        ret.phases.push_back( fill(window) );
+        phase steady;
+        steady.operations = (long long) (insertions - window) * (2 + lookups);
+        steady.cycle = true;
+        steady.steps.push_back( step{ operation_type::insert, 1, {key_choice::fresh} } );
+        steady.steps.push_back( step{ operation_type::erase, 1, {key_choice::oldest} } );
+        if( lookups > 0 )
+            steady.steps.push_back( step{ operation_type::count, double(lookups),
+                    {key_choice::recent, theta, 0, 0, window} } );
+        if( steady.operations > 0 )
+            ret.phases.push_back( steady );
+        return ret;
+    }
+}
+
+#endif // WORKLOAD_HPP